@@ -0,0 +1,72 @@
+#include "AllocationCounter.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+
+#include <malloc.h>
+
+// glibc's own implementations, which the wrappers below forward to
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void *pointer, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+}
+
+static std::atomic<long> allocation_count(0);
+// Plain data in the executable's static TLS block, so using it never allocates
+static thread_local long thread_allocation_count = 0;
+
+static inline void count_allocation() {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    thread_allocation_count++;
+}
+
+long get_allocation_count() {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+long get_thread_allocation_count() {
+    return thread_allocation_count;
+}
+
+extern "C" void* malloc(size_t size) noexcept {
+    count_allocation();
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) noexcept {
+    count_allocation();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void *pointer, size_t size) noexcept {
+    if (size != 0) {
+        count_allocation();
+    }
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" int posix_memalign(void **pointer, size_t alignment, size_t size) noexcept {
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    count_allocation();
+    void *allocated = __libc_memalign(alignment, size);
+    if (allocated == NULL) {
+        return ENOMEM;
+    }
+    *pointer = allocated;
+    return 0;
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size) noexcept {
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void* memalign(size_t alignment, size_t size) noexcept {
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
@@ -0,0 +1,19 @@
+#ifndef _ALLOCATION_COUNTER_HPP_
+#define _ALLOCATION_COUNTER_HPP_
+
+/**
+ * Number of heap allocations made so far, by any thread
+ *
+ * Only counted in programs which link AllocationCounter.cpp, which wraps glibc's malloc
+ * family (`malloc`, `calloc`, `realloc`, `posix_memalign`, `aligned_alloc` and
+ * `memalign`). That covers `operator new`, OpenCV's `cv::fastMalloc` and C libraries
+ * such as FFmpeg and the OpenCL runtime.
+ */
+long get_allocation_count();
+
+/**
+ * Number of heap allocations made so far by the calling thread
+ */
+long get_thread_allocation_count();
+
+#endif // _ALLOCATION_COUNTER_HPP_
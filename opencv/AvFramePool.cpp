@@ -0,0 +1,117 @@
+#include "AvFramePool.hpp"
+
+#include <iostream>
+
+extern "C" {
+    #include <libavutil/hwcontext.h>
+    #include <libavutil/imgutils.h>
+}
+
+#include "utils.hpp"
+
+using namespace std;
+
+AvFramePool::AvFramePool(shared_ptr<AVBufferRef> device_ctx, int pool_size):
+    m_device_ctx(device_ctx), m_pool_size(pool_size) {}
+
+AvFramePool::~AvFramePool() {
+    for (auto &entry : m_frames_ctxs) {
+        av_buffer_unref(&entry.second);
+    }
+    for (AVFrame *frame : m_free_frames) {
+        av_frame_free(&frame);
+    }
+}
+
+AVBufferRef* AvFramePool::get_frames_ctx(
+    AVPixelFormat format,
+    AVPixelFormat sw_format,
+    int width,
+    int height
+) {
+    Key key(format, sw_format, width, height);
+    auto existing = m_frames_ctxs.find(key);
+    if (existing != m_frames_ctxs.end()) {
+        lock_guard<mutex> lock(m_mutex);
+        m_stats.context_hits++;
+        return existing->second;
+    }
+
+    int err;
+    AVBufferRef *hw_frames_ref = av_hwframe_ctx_alloc(m_device_ctx.get());
+    if (hw_frames_ref == NULL) {
+        cerr << "Failed to allocate hwframes context\n";
+        throw AVERROR(ENOMEM);
+    }
+    AVHWFramesContext *hw_frames_ctx = (AVHWFramesContext *)(hw_frames_ref->data);
+    hw_frames_ctx->format = format;
+    hw_frames_ctx->sw_format = sw_format;
+    hw_frames_ctx->width = width;
+    hw_frames_ctx->height = height;
+    hw_frames_ctx->initial_pool_size = m_pool_size;
+    err = av_hwframe_ctx_init(hw_frames_ref);
+    if (err < 0) {
+        cerr << "Failed to init hwframes context:" << errString(err) << "\n";
+        av_buffer_unref(&hw_frames_ref);
+        throw err;
+    }
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stats.context_misses++;
+        m_stats.preallocated_bytes +=
+            (long) m_pool_size * av_image_get_buffer_size(sw_format, width, height, 1);
+    }
+    m_frames_ctxs[key] = hw_frames_ref;
+    return hw_frames_ref;
+}
+
+AVFrame* AvFramePool::get_frame() {
+    lock_guard<mutex> lock(m_mutex);
+    if (!m_free_frames.empty()) {
+        m_stats.frame_hits++;
+        AVFrame *frame = m_free_frames.back();
+        m_free_frames.pop_back();
+        return frame;
+    }
+    m_stats.frame_misses++;
+    AVFrame *frame = av_frame_alloc();
+    if (frame == NULL) {
+        cerr << "Failed to allocate frame\n";
+        throw AVERROR(ENOMEM);
+    }
+    return frame;
+}
+
+AVFrame* AvFramePool::get_hw_frame(
+    AVPixelFormat format,
+    AVPixelFormat sw_format,
+    int width,
+    int height
+) {
+    AVBufferRef *hw_frames_ref = get_frames_ctx(format, sw_format, width, height);
+    AVFrame *frame = get_frame();
+    int err = av_hwframe_get_buffer(hw_frames_ref, frame, 0);
+    if (err) {
+        cerr << "Failed to get buffer for hardware frame:" << errString(err) << "\n";
+        release_frame(frame);
+        throw err;
+    }
+    if (!frame->hw_frames_ctx) {
+        cerr << "Failed to get buffer for hardware frame\n";
+        release_frame(frame);
+        throw AVERROR(ENOMEM);
+    }
+    return frame;
+}
+
+void AvFramePool::release_frame(AVFrame *frame) {
+    av_frame_unref(frame);
+    lock_guard<mutex> lock(m_mutex);
+    m_free_frames.push_back(frame);
+}
+
+AvFramePoolStats AvFramePool::get_stats() {
+    lock_guard<mutex> lock(m_mutex);
+    return m_stats;
+}
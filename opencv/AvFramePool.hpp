@@ -0,0 +1,79 @@
+#ifndef _AV_FRAME_POOL_HPP_
+#define _AV_FRAME_POOL_HPP_
+
+extern "C" {
+    #include <libavutil/buffer.h>
+    #include <libavutil/frame.h>
+    #include <libavutil/pixfmt.h>
+}
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+/**
+ * Counters describing how well an `AvFramePool` is being reused
+ */
+class AvFramePoolStats {
+  public:
+    // Hardware frames contexts which were reused/created
+    long context_hits = 0;
+    long context_misses = 0;
+    // `AVFrame`s which were recycled/allocated
+    long frame_hits = 0;
+    long frame_misses = 0;
+    // Bytes of frame surfaces preallocated by the pool's hardware frames contexts (their
+    // initial pool size), not counting surfaces allocated beyond it
+    long preallocated_bytes = 0;
+};
+
+/**
+ * A long lived pool of hardware frames contexts and `AVFrame`s
+ *
+ * Hardware frames contexts are created once per (format, sw_format, width, height) and
+ * kept until the pool is destroyed, so their surfaces are recycled by libavutil's buffer
+ * pool rather than being reallocated for every frame. `AVFrame`s come back through
+ * `release_frame`, which may be called from another thread.
+ */
+class AvFramePool {
+    typedef std::tuple<AVPixelFormat, AVPixelFormat, int, int> Key;
+
+    std::shared_ptr<AVBufferRef> m_device_ctx;
+    int m_pool_size;
+    std::map<Key, AVBufferRef *> m_frames_ctxs;
+    // Guards the free frames and the statistics
+    std::mutex m_mutex;
+    std::vector<AVFrame *> m_free_frames;
+    AvFramePoolStats m_stats;
+
+  public:
+    AvFramePool(std::shared_ptr<AVBufferRef> device_ctx, int pool_size = 40);
+    ~AvFramePool();
+
+    /**
+     * Return the hardware frames context for the given parameters, creating it if needed.
+     * The pool keeps ownership of the returned reference.
+     */
+    AVBufferRef* get_frames_ctx(AVPixelFormat format, AVPixelFormat sw_format, int width, int height);
+
+    /**
+     * Return an empty `AVFrame`, recycled if possible
+     */
+    AVFrame* get_frame();
+
+    /**
+     * Return a hardware frame backed by the pooled frames context for the given parameters
+     */
+    AVFrame* get_hw_frame(AVPixelFormat format, AVPixelFormat sw_format, int width, int height);
+
+    /**
+     * Unreference the frame's buffers and keep the `AVFrame` for reuse
+     */
+    void release_frame(AVFrame *frame);
+
+    AvFramePoolStats get_stats();
+};
+
+#endif // _AV_FRAME_POOL_HPP_
@@ -22,6 +22,21 @@ class AvFrameSource {
      */
     virtual AVFrame* peek_frame() = 0;
 
+    /**
+     * Time base of the frames' timestamps, or 0/1 if they have none
+     */
+    virtual AVRational get_time_base() {
+        return AVRational { 0, 1 };
+    }
+
+    /**
+     * Give back a frame returned by `pull_frame` once it's no longer used, so that the
+     * source can recycle it. May be called from another thread than `pull_frame`.
+     */
+    virtual void release_frame(AVFrame *frame) {
+        av_frame_free(&frame);
+    }
+
     virtual ~AvFrameSource() = default;
 };
 
@@ -0,0 +1,66 @@
+#include "AvFrameSourceAsync.hpp"
+
+#include <iostream>
+
+using namespace std;
+
+AvFrameSourceAsync::AvFrameSourceAsync(
+    shared_ptr<AvFrameSource> source,
+    size_t capacity,
+    string name
+):
+    m_source(source),
+    m_name(name),
+    m_queue(capacity)
+{
+    m_thread = thread(&AvFrameSourceAsync::run, this);
+}
+
+AvFrameSourceAsync::~AvFrameSourceAsync() {
+    m_queue.close();
+    m_thread.join();
+
+    AVFrame *frame;
+    while (m_queue.try_pop(frame)) {
+        m_source->release_frame(frame);
+    }
+
+    m_queue.print_stats(m_name);
+}
+
+void AvFrameSourceAsync::run() {
+    while (!m_queue.is_closed()) {
+        AVFrame *frame;
+        try {
+            frame = m_source->pull_frame();
+        } catch (...) {
+            m_queue.end(current_exception());
+            return;
+        }
+
+        if (!m_queue.push(frame)) {
+            m_source->release_frame(frame);
+            return;
+        }
+    }
+}
+
+AVFrame* AvFrameSourceAsync::peek_frame() {
+    return m_queue.front();
+}
+
+AVFrame* AvFrameSourceAsync::pull_frame() {
+    return m_queue.pop();
+}
+
+double AvFrameSourceAsync::average_occupancy() {
+    return m_queue.average_occupancy();
+}
+
+AVRational AvFrameSourceAsync::get_time_base() {
+    return m_source->get_time_base();
+}
+
+void AvFrameSourceAsync::release_frame(AVFrame *frame) {
+    m_source->release_frame(frame);
+}
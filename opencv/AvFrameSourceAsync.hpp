@@ -0,0 +1,46 @@
+#ifndef _AV_FRAME_SOURCE_ASYNC_HPP_
+#define _AV_FRAME_SOURCE_ASYNC_HPP_
+
+#include "AvFrameSource.hpp"
+
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "BlockingSpscQueue.hpp"
+
+/**
+ * Reads ahead from another `AvFrameSource` on a dedicated thread
+ *
+ * Frames are passed through a bounded ring buffer, so the wrapped source blocks when
+ * the consumer falls `capacity` frames behind. Exceptions thrown by the wrapped source
+ * (including `EOF`) are rethrown to the consumer once the frames before them are used.
+ */
+class AvFrameSourceAsync: public AvFrameSource {
+    std::shared_ptr<AvFrameSource> m_source;
+    std::string m_name;
+    BlockingSpscQueue<AVFrame *> m_queue;
+    std::thread m_thread;
+
+    void run();
+  public:
+    AvFrameSourceAsync(
+      std::shared_ptr<AvFrameSource> source,
+      size_t capacity = 8,
+      std::string name = "async"
+    );
+    AVFrame* pull_frame();
+    AVFrame* peek_frame();
+    AVRational get_time_base();
+    void release_frame(AVFrame *frame);
+
+    /**
+     * The mean number of frames waiting in the queue when a frame was pulled.
+     * Close to the capacity means the consumer is the bottleneck, close to zero means
+     * the wrapped source is.
+     */
+    double average_occupancy();
+    ~AvFrameSourceAsync();
+};
+
+#endif // _AV_FRAME_SOURCE_ASYNC_HPP_
@@ -0,0 +1,159 @@
+#include "AvFrameSourceFileSw.hpp"
+
+#include <iostream>
+
+#include "utils.hpp"
+
+using namespace std;
+
+AvFrameSourceFileSw::AvFrameSourceFileSw(
+    std::string file_path,
+    int thread_count,
+    int thread_type
+) {
+    int err;
+    AVStream *video = NULL;
+
+    err = avformat_open_input(&this->format_ctx, file_path.c_str(), NULL, NULL);
+    if (err) {
+        cerr << "Failed to open input file:" << errString(err) << "\n";
+        throw err;
+    }
+
+    err = avformat_find_stream_info(this->format_ctx, NULL);
+    if (err < 0) {
+        cerr << "Failed to find input stream information:" << errString(err) << "\n";
+        throw err;
+    }
+
+    this->video_stream = av_find_best_stream(
+        this->format_ctx,
+        AVMEDIA_TYPE_VIDEO,
+        -1,
+        -1,
+        &this->decoder,
+        0
+    );
+    if (this->video_stream < 0) {
+        cerr << "Failed to find a video stream in the input file:" <<
+            errString(this->video_stream) << "\n";
+        throw this->video_stream;
+    }
+
+    this->gpmf_stream = get_gpmf_stream_id(this->format_ctx);
+    if (this->gpmf_stream != -1) {
+        cerr << "Found GoPro metadata stream in input\n";
+    }
+
+    this->decoder_ctx = avcodec_alloc_context3(this->decoder);
+    if (!this->decoder_ctx) {
+        err = AVERROR(ENOMEM);
+        cerr << "Failed to allocate decoder context:" << errString(err) << "\n";
+        throw err;
+    }
+
+    video = this->format_ctx->streams[this->video_stream];
+    err = avcodec_parameters_to_context(this->decoder_ctx, video->codecpar);
+    if (err < 0) {
+        cerr << "avcodec_parameters_to_context error:" << errString(err) << "\n";
+        throw err;
+    }
+
+    // Threading must be configured before the codec is opened
+    this->decoder_ctx->thread_count = thread_count;
+    this->decoder_ctx->thread_type = thread_type;
+
+    err = avcodec_open2(this->decoder_ctx, this->decoder, NULL);
+    if (err < 0) {
+        cerr << "Failed to open codec for decoding:" << errString(err) << "\n";
+        throw err;
+    }
+
+    cerr << "Software decoding with " << this->decoder_ctx->thread_count << " threads (" <<
+        ((this->decoder_ctx->active_thread_type & FF_THREAD_FRAME) ? "frame" :
+            (this->decoder_ctx->active_thread_type & FF_THREAD_SLICE) ? "slice" : "none") <<
+        " threading)\n";
+}
+
+AvFrameSourceFileSw::~AvFrameSourceFileSw() {
+    avformat_close_input(&this->format_ctx);
+    avcodec_free_context(&this->decoder_ctx);
+    av_frame_free(&this->next_frame);
+}
+
+void AvFrameSourceFileSw::read_input_packet() {
+    int err;
+    err = av_read_frame(this->format_ctx, &this->packet);
+    if (err < 0) {
+        // Enter draining mode, so that frames still queued in the frame threads are returned
+        this->input_ended = true;
+        err = avcodec_send_packet(this->decoder_ctx, NULL);
+        if (err < 0) {
+            cerr << "Failed to flush decoder:" << errString(err) << "\n";
+            throw err;
+        }
+        return;
+    }
+
+    if (packet.stream_index == this->video_stream) {
+        err = avcodec_send_packet(this->decoder_ctx, &packet);
+        if (err < 0) {
+            cerr << "Failed to decode frame:" << errString(err) << "\n";
+            throw err;
+        }
+    } else if (packet.stream_index == this->gpmf_stream) {
+        // TODO process GPMF packet
+    } else {
+        // TODO pass through audio
+    }
+
+    av_packet_unref(&this->packet);
+}
+
+AVFrame* AvFrameSourceFileSw::peek_frame() {
+    if (this->next_frame != NULL) {
+        return this->next_frame;
+    }
+
+    int err = 0;
+    this->next_frame = av_frame_alloc();
+    do {
+        err = avcodec_receive_frame(this->decoder_ctx, this->next_frame);
+        if (!err) {
+            break;
+        } else if (err == AVERROR(EAGAIN) && !this->input_ended) {
+            this->read_input_packet();
+        } else if (err == AVERROR_EOF) {
+            av_frame_free(&this->next_frame);
+            throw EOF;
+        } else {
+            av_frame_free(&this->next_frame);
+            cerr << "Failed to decode frame:" << errString(err) << "\n";
+            throw err;
+        }
+    } while (err == AVERROR(EAGAIN));
+
+    return this->next_frame;
+}
+
+AVFrame* AvFrameSourceFileSw::pull_frame() {
+    AVFrame *frame = this->peek_frame();
+    this->next_frame = NULL;
+    return frame;
+}
+
+AVRational AvFrameSourceFileSw::get_time_base() {
+    return this->format_ctx->streams[this->video_stream]->time_base;
+}
+
+void AvFrameSourceFileSw::seek(int64_t timestamp) {
+    av_frame_free(&this->next_frame);
+    int err = av_seek_frame(this->format_ctx, this->video_stream, timestamp, AVSEEK_FLAG_BACKWARD);
+    if (err < 0) {
+        cerr << "Failed to seek:" << errString(err) << "\n";
+        throw err;
+    }
+    // Drop frames from before the seek, and leave draining mode
+    avcodec_flush_buffers(this->decoder_ctx);
+    this->input_ended = false;
+}
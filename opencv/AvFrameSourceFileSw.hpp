@@ -0,0 +1,45 @@
+#ifndef _AV_FRAME_SOURCE_FILE_SW_HPP_
+#define _AV_FRAME_SOURCE_FILE_SW_HPP_
+
+
+#include "AvFrameSource.hpp"
+
+#include <string>
+
+/**
+ * Reads software decoded `AVFrame`s from a video file, using libavcodec's
+ * frame and/or slice threading to spread decoding across CPU cores
+ */
+class AvFrameSourceFileSw: public AvFrameSource {
+    AVFormatContext *format_ctx = NULL;
+    int video_stream = -1;
+    int gpmf_stream = -1;
+    AVCodecContext *decoder_ctx = NULL;
+    AVCodec *decoder = NULL;
+    AVFrame *next_frame = NULL;
+    AVPacket packet;
+    bool input_ended = false;
+
+    void read_input_packet();
+  public:
+    /**
+     * `thread_count` of 0 lets libavcodec pick one thread per core.
+     * `thread_type` is a combination of `FF_THREAD_FRAME` and `FF_THREAD_SLICE`.
+     */
+    AvFrameSourceFileSw(
+      std::string file_path,
+      int thread_count = 0,
+      int thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE
+    );
+    AVFrame* pull_frame();
+    AVFrame* peek_frame();
+    AVRational get_time_base();
+
+    /**
+     * Continue from the keyframe at or before `timestamp` (in `get_time_base()` units)
+     */
+    void seek(int64_t timestamp);
+    ~AvFrameSourceFileSw();
+};
+
+#endif // _AV_FRAME_SOURCE_FILE_SW_HPP_
@@ -6,19 +6,6 @@
 
 using namespace std;
 
-int get_gpmf_stream_id(AVFormatContext *format_ctx) {
-    int result = -1;
-    for (unsigned int i = 0; i < format_ctx->nb_streams; i++) {
-        AVStream *stream = format_ctx->streams[i];
-        AVDictionaryEntry *entry = av_dict_get(stream->metadata, "handler_name", NULL, 0);
-        if (entry != NULL && strcmp(entry->value, "	GoPro MET") == 0) {
-            result = i;
-            break;
-        }
-    }
-    return result;
-}
-
 static enum AVPixelFormat get_vaapi_format(
     AVCodecContext *ctx,
     const enum AVPixelFormat *pix_fmts
@@ -159,3 +146,7 @@ AVFrame* AvFrameSourceFileVaapi::pull_frame() {
     this->next_frame = NULL;
     return frame;
 }
+
+AVRational AvFrameSourceFileVaapi::get_time_base() {
+    return this->format_ctx->streams[this->video_stream]->time_base;
+}
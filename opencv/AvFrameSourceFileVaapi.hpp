@@ -26,6 +26,7 @@ class AvFrameSourceFileVaapi: public AvFrameSource {
     AvFrameSourceFileVaapi(std::string file_path, std::shared_ptr<AVBufferRef> vaapi_device_ctx);
     AVFrame* pull_frame();
     AVFrame* peek_frame();
+    AVRational get_time_base();
     ~AvFrameSourceFileVaapi();
 };
 
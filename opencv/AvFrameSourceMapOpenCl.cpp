@@ -2,76 +2,126 @@
 
 #include <iostream>
 
+extern "C" {
+    #include <libavutil/hwcontext.h>
+}
+
 #include "utils.hpp"
 
 using namespace std;
 
 AvFrameSourceMapOpenCl::AvFrameSourceMapOpenCl(
     std::shared_ptr<AvFrameSource> source,
-    std::shared_ptr<AVBufferRef> ocl_device_ctx
-) {
+    std::shared_ptr<AVBufferRef> ocl_device_ctx,
+    int pool_size
+): frame_pool(ocl_device_ctx, pool_size) {
     this->source = source;
     this->ocl_device_ctx = ocl_device_ctx;
 }
 
-AVFrame* AvFrameSourceMapOpenCl::opencl_frame_from_vaapi_frame(AVFrame *vaapi_frame) {
-    int err;
-    AVFrame *tmp_frame = av_frame_alloc();
-    if (tmp_frame == NULL) {
-        cerr << "Failed to allocate temp frame\n";
+AvFrameSourceMapOpenCl::~AvFrameSourceMapOpenCl() {
+    if (this->next_frame != NULL) {
+        this->frame_pool.release_frame(this->next_frame);
     }
-
-    err = av_hwframe_transfer_data(tmp_frame, vaapi_frame, 0);
-    if (err) {
-        cerr << "Failed to copy VAAPI frames to memory:" << errString(err) << "\n";
-        throw err;
+    if (this->transfer_frame != NULL) {
+        this->frame_pool.release_frame(this->transfer_frame);
     }
 
-    AVFrame *ocl_frame = av_frame_alloc();
-    if (ocl_frame == NULL) {
-        cerr << "Failed to allocate OpenCL frame\n";
-    }
+    AvFramePoolStats stats = this->frame_pool.get_stats();
+    fprintf(
+        stderr,
+        "OpenCL frame pool: contexts %ld hit/%ld miss, frames %ld hit/%ld miss, %.1f MiB preallocated\n",
+        stats.context_hits,
+        stats.context_misses,
+        stats.frame_hits,
+        stats.frame_misses,
+        stats.preallocated_bytes / (1024. * 1024.)
+    );
+}
 
-    AVBufferRef *hw_frames_ref = av_hwframe_ctx_alloc(this->ocl_device_ctx.get());
-    AVHWFramesContext * ocl_hw_frames_ctx = (AVHWFramesContext *)(hw_frames_ref->data);
-    ocl_hw_frames_ctx->format = AV_PIX_FMT_OPENCL;
-    ocl_hw_frames_ctx->sw_format = AV_PIX_FMT_NV12;
-    ocl_hw_frames_ctx->width = vaapi_frame->width;
-    ocl_hw_frames_ctx->height = vaapi_frame->height;
-    ocl_hw_frames_ctx->initial_pool_size = 40;
-    err = av_hwframe_ctx_init(hw_frames_ref);
-    if (err < 0) {
-        cerr << "Failed init context OpenCL frame:" << errString(err) << "\n";
-        av_buffer_unref(&hw_frames_ref);
-        throw err;
+AVFrame* AvFrameSourceMapOpenCl::opencl_frame_from_vaapi_frame(AVFrame *vaapi_frame) {
+    int err;
+    AVHWFramesContext *vaapi_frames_ctx = (AVHWFramesContext *) vaapi_frame->hw_frames_ctx->data;
+    AVPixelFormat sw_format = vaapi_frames_ctx->sw_format;
+
+    // Keep the transfer buffers between frames unless the stream parameters change
+    if (
+        this->transfer_frame != NULL && (
+            this->transfer_frame->format != sw_format ||
+            this->transfer_frame->width != vaapi_frame->width ||
+            this->transfer_frame->height != vaapi_frame->height
+        )
+    ) {
+        this->frame_pool.release_frame(this->transfer_frame);
+        this->transfer_frame = NULL;
+    }
+    if (this->transfer_frame == NULL) {
+        this->transfer_frame = this->frame_pool.get_frame();
+        this->transfer_frame->format = sw_format;
+        this->transfer_frame->width = vaapi_frame->width;
+        this->transfer_frame->height = vaapi_frame->height;
+        err = av_frame_get_buffer(this->transfer_frame, 0);
+        if (err) {
+            cerr << "Failed to allocate transfer frame:" << errString(err) << "\n";
+            throw err;
+        }
     }
 
-    err = av_hwframe_get_buffer(hw_frames_ref, ocl_frame, 0);
+    err = av_hwframe_transfer_data(this->transfer_frame, vaapi_frame, 0);
     if (err) {
-        cerr << "Failed to get buffer for OpenCL frame:" << errString(err) << "\n";
+        cerr << "Failed to copy VAAPI frames to memory:" << errString(err) << "\n";
         throw err;
     }
-    if (!ocl_frame->hw_frames_ctx) {
-        cerr << "Failed to get buffer for OpenCL frame\n";
-        throw AVERROR(ENOMEM);
-    }
 
-    err = av_hwframe_transfer_data(ocl_frame, tmp_frame, 0);
+    AVFrame *ocl_frame = this->frame_pool.get_hw_frame(
+        AV_PIX_FMT_OPENCL,
+        sw_format,
+        vaapi_frame->width,
+        vaapi_frame->height
+    );
+
+    err = av_hwframe_transfer_data(ocl_frame, this->transfer_frame, 0);
     if (err) {
         cerr << "Failed to copy memory to OpenCL frames:" << errString(err) << "\n";
+        this->frame_pool.release_frame(ocl_frame);
         throw err;
     }
+    // Timestamps etc. aren't transferred with the data
+    av_frame_copy_props(ocl_frame, vaapi_frame);
 
     return ocl_frame;
 }
 
 AVFrame* AvFrameSourceMapOpenCl::peek_frame() {
-    return this->opencl_frame_from_vaapi_frame(this->source->peek_frame());
+    if (this->next_frame != NULL) {
+        return this->next_frame;
+    }
+    AVFrame *vaapi_frame = this->source->pull_frame();
+    try {
+        this->next_frame = this->opencl_frame_from_vaapi_frame(vaapi_frame);
+    } catch (int err) {
+        av_frame_free(&vaapi_frame);
+        throw err;
+    }
+    av_frame_free(&vaapi_frame);
+    return this->next_frame;
 }
 
 AVFrame* AvFrameSourceMapOpenCl::pull_frame() {
-    AVFrame *vaapi_frame = this->source->pull_frame();
-    AVFrame *opencl_frame = this->opencl_frame_from_vaapi_frame(vaapi_frame);
-    av_frame_free(&vaapi_frame);
+    AVFrame *opencl_frame = this->peek_frame();
+    this->next_frame = NULL;
     return opencl_frame;
 }
+
+AvFramePoolStats AvFrameSourceMapOpenCl::get_pool_stats() {
+    return this->frame_pool.get_stats();
+}
+
+AVRational AvFrameSourceMapOpenCl::get_time_base() {
+    return this->source->get_time_base();
+}
+
+void AvFrameSourceMapOpenCl::release_frame(AVFrame *frame) {
+    // Keeps the AVFrame, and returns its surface to the frames context's buffer pool
+    this->frame_pool.release_frame(frame);
+}
@@ -7,20 +7,31 @@
 #include <string>
 #include <memory>
 
+#include "AvFramePool.hpp"
+
 /**
  * Maps VAAPI backed `AVFrame`s to OpenCL
  */
 class AvFrameSourceMapOpenCl: public AvFrameSource {
     std::shared_ptr<AvFrameSource> source;
     std::shared_ptr<AVBufferRef> ocl_device_ctx = NULL;
+    AvFramePool frame_pool;
+    // Reused system memory frame for the VAAPI -> memory -> OpenCL copy
+    AVFrame *transfer_frame = NULL;
+    AVFrame *next_frame = NULL;
     AVFrame* opencl_frame_from_vaapi_frame(AVFrame *vaapi_frame);
   public:
     AvFrameSourceMapOpenCl(
       std::shared_ptr<AvFrameSource> source,
-      std::shared_ptr<AVBufferRef> ocl_device_ctx
+      std::shared_ptr<AVBufferRef> ocl_device_ctx,
+      int pool_size = 40
     );
     AVFrame* pull_frame();
     AVFrame* peek_frame();
+    AVRational get_time_base();
+    void release_frame(AVFrame *frame);
+    AvFramePoolStats get_pool_stats();
+    ~AvFrameSourceMapOpenCl();
 };
 
-#endif // _AV_FRAME_SOURCE_MAP_OPENCL_HPP_
\ No newline at end of file
+#endif // _AV_FRAME_SOURCE_MAP_OPENCL_HPP_
@@ -6,7 +6,7 @@ using namespace std;
 using namespace std::chrono;
 
 AvFrameSourceProfile::AvFrameSourceProfile(shared_ptr<AvFrameSource> source, string name):
-    m_source(source), m_profiler(Profiler(name)) {}
+    m_source(source), m_profiler(name) {}
 
 AVFrame* AvFrameSourceProfile::peek_frame() {
     return m_source->peek_frame();
@@ -18,3 +18,11 @@ AVFrame* AvFrameSourceProfile::pull_frame() {
     m_profiler.after_exit();
     return result;
 }
+
+AVRational AvFrameSourceProfile::get_time_base() {
+    return m_source->get_time_base();
+}
+
+void AvFrameSourceProfile::release_frame(AVFrame *frame) {
+    m_source->release_frame(frame);
+}
@@ -10,6 +10,9 @@
 
 #include "Profiler.hpp"
 
+/**
+ * Records the time taken by each `pull_frame()` of a source, see `Profiler`
+ */
 class AvFrameSourceProfile: public AvFrameSource {
     std::shared_ptr<AvFrameSource> m_source;
     Profiler m_profiler;
@@ -17,6 +20,8 @@ class AvFrameSourceProfile: public AvFrameSource {
     AvFrameSourceProfile(std::shared_ptr<AvFrameSource> source, std::string name);
     AVFrame* pull_frame();
     AVFrame* peek_frame();
+    AVRational get_time_base();
+    void release_frame(AVFrame *frame);
 };
 
 #endif // _AV_FRAME_SOURCE_PROFILE_HPP_
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "AvFrameSourceSynthetic.hpp"
+
+#include <cstdio>
+#include <iostream>
+
+#include "utils.hpp"
+
+using namespace std;
+using namespace cv;
+
+AvFrameSourceSynthetic::AvFrameSourceSynthetic(
+    Camera camera,
+    SyntheticMotion motion,
+    long num_frames,
+    AVRational frame_rate,
+    unsigned int seed
+):
+    m_scene(camera, seed),
+    m_motion(motion),
+    m_size(camera.size),
+    m_num_frames(num_frames),
+    m_frame_rate(frame_rate)
+{
+    if (m_size.width % 2 || m_size.height % 2) {
+        cerr << "Odd frame dimensions are not supported: " << m_size.width << "x" <<
+            m_size.height << "\n";
+        throw -1;
+    }
+}
+
+AvFrameSourceSynthetic::~AvFrameSourceSynthetic() {
+    av_frame_free(&m_next_frame);
+}
+
+AVFrame* AvFrameSourceSynthetic::peek_frame() {
+    if (m_next_frame != NULL) {
+        return m_next_frame;
+    }
+    if (m_frame_index >= m_num_frames) {
+        throw EOF;
+    }
+
+    m_next_frame = av_frame_alloc();
+    if (m_next_frame == NULL) {
+        cerr << "Failed to allocate frame\n";
+        throw AVERROR(ENOMEM);
+    }
+    m_next_frame->format = AV_PIX_FMT_NV12;
+    m_next_frame->width = m_size.width;
+    m_next_frame->height = m_size.height;
+    int err = av_frame_get_buffer(m_next_frame, 0);
+    if (err < 0) {
+        av_frame_free(&m_next_frame);
+        cerr << "Failed to allocate frame buffer:" << errString(err) << "\n";
+        throw err;
+    }
+    m_next_frame->pts = m_frame_index;
+
+    m_scene.render(
+        get_orientation(m_frame_index),
+        Mat(m_size, CV_8U, m_next_frame->data[0], m_next_frame->linesize[0]),
+        Mat(m_size / 2, CV_8UC2, m_next_frame->data[1], m_next_frame->linesize[1])
+    );
+    return m_next_frame;
+}
+
+AVFrame* AvFrameSourceSynthetic::pull_frame() {
+    AVFrame *frame = peek_frame();
+    m_next_frame = NULL;
+    m_frame_index++;
+    return frame;
+}
+
+AVRational AvFrameSourceSynthetic::get_time_base() {
+    return av_inv_q(m_frame_rate);
+}
+
+Matx33d AvFrameSourceSynthetic::get_orientation(long index) {
+    return m_motion.get_orientation(index * av_q2d(get_time_base()));
+}
@@ -0,0 +1,43 @@
+#ifndef _AV_FRAME_SOURCE_SYNTHETIC_HPP_
+#define _AV_FRAME_SOURCE_SYNTHETIC_HPP_
+
+#include "AvFrameSource.hpp"
+
+#include <opencv2/core.hpp>
+
+#include "Camera.hpp"
+#include "SyntheticScene.hpp"
+
+/**
+ * Renders software NV12 `AVFrame`s of a `SyntheticScene`, with the camera following a
+ * known `SyntheticMotion`, so that the pipeline can run without a video file or a
+ * hardware decoder
+ */
+class AvFrameSourceSynthetic: public AvFrameSource {
+    SyntheticScene m_scene;
+    SyntheticMotion m_motion;
+    cv::Size m_size;
+    long m_num_frames;
+    AVRational m_frame_rate;
+    long m_frame_index = 0;
+    AVFrame *m_next_frame = NULL;
+  public:
+    AvFrameSourceSynthetic(
+        Camera camera,
+        SyntheticMotion motion = SyntheticMotion(),
+        long num_frames = 300,
+        AVRational frame_rate = AVRational { 30, 1 },
+        unsigned int seed = 0
+    );
+    ~AvFrameSourceSynthetic();
+    AVFrame* pull_frame();
+    AVFrame* peek_frame();
+    AVRational get_time_base();
+
+    /**
+     * The true camera orientation (camera to world rotation) of frame `index`
+     */
+    cv::Matx33d get_orientation(long index);
+};
+
+#endif // _AV_FRAME_SOURCE_SYNTHETIC_HPP_
@@ -0,0 +1,170 @@
+#ifndef _BLOCKING_SPSC_QUEUE_HPP_
+#define _BLOCKING_SPSC_QUEUE_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+#include <string>
+
+#include "SpscRing.hpp"
+
+/**
+ * A bounded queue from one producer thread to one consumer thread, which blocks the
+ * producer while it's full and the consumer while it's empty
+ *
+ * Items are passed through an `SpscRing`, and the lock is only used to sleep, never to
+ * access the ring. The producer ends the queue with an exception (e.g. `EOF`), which is
+ * rethrown to the consumer once the items before it are used. The consumer closes the
+ * queue to stop the producer.
+ */
+template <typename T>
+class BlockingSpscQueue {
+    SpscRing<T> m_ring;
+
+    std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+
+    std::atomic<bool> m_closed;
+    std::atomic<bool> m_ended;
+    std::exception_ptr m_error;
+
+    // Statistics
+    long m_num_pulled = 0;
+    long m_occupancy_sum = 0;
+    std::atomic<long> m_producer_waits;
+    long m_consumer_waits = 0;
+
+  public:
+    explicit BlockingSpscQueue(size_t capacity):
+        m_ring(capacity),
+        m_closed(false),
+        m_ended(false),
+        m_producer_waits(0)
+    {
+    }
+
+    /**
+     * Producer only: add an item, waiting while the queue is full. Returns false without
+     * adding it if the queue was closed.
+     */
+    bool push(const T &value) {
+        while (!m_ring.try_push(value)) {
+            // Backpressure: wait for the consumer to make space
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_producer_waits++;
+            m_not_full.wait(lock, [this]() {
+                return m_closed || m_ring.size() < m_ring.capacity();
+            });
+            if (m_closed) {
+                return false;
+            }
+        }
+        {
+            // Synchronise with a consumer which is about to wait
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    /**
+     * Producer only: end the queue, so that the consumer gets `error` once it has
+     * used the items already pushed
+     */
+    void end(std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_error = error;
+            m_ended = true;
+        }
+        m_not_empty.notify_one();
+    }
+
+    /**
+     * Producer only: whether the consumer has closed the queue
+     */
+    bool is_closed() {
+        return m_closed;
+    }
+
+    /**
+     * Consumer only: the oldest item, without removing it, waiting for one if the queue
+     * is empty. Rethrows the producer's error if the queue has ended.
+     */
+    T &front() {
+        T *item;
+        while ((item = m_ring.front()) == NULL) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_ended && m_ring.size() == 0) {
+                std::rethrow_exception(m_error);
+            }
+            m_consumer_waits++;
+            m_not_empty.wait(lock, [this]() {
+                return m_ended || m_ring.size() > 0;
+            });
+        }
+        return *item;
+    }
+
+    /**
+     * Consumer only: remove and return the oldest item, like `front`
+     */
+    T pop() {
+        front();
+        m_occupancy_sum += m_ring.size();
+        m_num_pulled++;
+        T value{};
+        m_ring.try_pop(value);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+        m_not_full.notify_one();
+        return value;
+    }
+
+    /**
+     * Consumer only: remove the oldest item without waiting, or return false if the
+     * queue is empty, e.g. to release the items left once the producer has stopped
+     */
+    bool try_pop(T &value) {
+        return m_ring.try_pop(value);
+    }
+
+    /**
+     * Consumer only: stop the producer, which stops waiting for space and fails its
+     * pushes from now on
+     */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_not_full.notify_all();
+    }
+
+    /**
+     * The mean number of items waiting in the queue when an item was popped. Close to
+     * the capacity means the consumer is the bottleneck, close to zero means the
+     * producer is.
+     */
+    double average_occupancy() {
+        return m_num_pulled == 0 ? 0 : 1. * m_occupancy_sum / m_num_pulled;
+    }
+
+    void print_stats(const std::string &name) {
+        fprintf(
+            stderr,
+            "%s: average queue occupancy %.1f/%zu, producer blocked %ld times, consumer blocked %ld times\n",
+            name.c_str(),
+            average_occupancy(),
+            m_ring.capacity(),
+            m_producer_waits.load(),
+            m_consumer_waits
+        );
+    }
+};
+
+#endif // _BLOCKING_SPSC_QUEUE_HPP_
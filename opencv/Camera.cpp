@@ -0,0 +1,219 @@
+#include "Camera.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <opencv2/calib3d.hpp>
+
+using namespace std;
+using namespace cv;
+
+// Published values from
+// https://community.gopro.com/t5/en/HERO4-Field-of-View-FOV-Information/ta-p/390285
+const int GOPRO_H5B_FOV_H_43W_NOSTAB = 122.6;
+const int GOPRO_H5B_FOV_V_43W_NOSTAB = 94.4;
+const int GOPRO_H5B_FOV_H_169W_NOSTAB = 118.2;
+const int GOPRO_H5B_FOV_V_169W_NOSTAB = 69.5;
+
+Camera get_preset_camera(CameraPreset preset, Size input_size) {
+    Mat camera_matrix = Mat::eye(3, 3, CV_64F);
+
+    // Default: principal point is at the centre
+    camera_matrix.at<double>(0, 2) = (input_size.width - 1.) / 2;
+    camera_matrix.at<double>(1, 2) = (input_size.height - 1.) / 2;
+
+    // Default: zero distortion coefficients
+    Mat distortion_coefficients = Mat::zeros(4, 1, CV_64F);
+
+    switch (preset) {
+        case GOPRO_H4B_WIDE43_PUBLISHED:
+            camera_matrix.at<double>(0, 0) = input_size.width /
+                (GOPRO_H5B_FOV_H_43W_NOSTAB * CV_PI / 180);
+            camera_matrix.at<double>(1, 1) = input_size.height /
+                (GOPRO_H5B_FOV_V_43W_NOSTAB * CV_PI / 180);
+            break;
+        case GOPRO_H4B_WIDE169_PUBLISHED:
+            camera_matrix.at<double>(0, 0) = input_size.width /
+                (GOPRO_H5B_FOV_H_169W_NOSTAB * CV_PI / 180);
+            camera_matrix.at<double>(1, 1) = input_size.height /
+                (GOPRO_H5B_FOV_V_169W_NOSTAB * CV_PI / 180);
+            break;
+        case GOPRO_H4B_WIDE43_MEASURED:
+            // Measured values for GoPro Hero 4 Black with 4:3 "Wide" FOV setting and stabilisation disabled
+            camera_matrix.at<double>(0, 2) = 967.37 * input_size.width / 1920;
+            camera_matrix.at<double>(1, 2) = 711.07 * input_size.height / 1440;
+            camera_matrix.at<double>(0, 0) = 942.96 * input_size.height / 1440;
+            camera_matrix.at<double>(1, 1) = 942.53 * input_size.height / 1440;
+            break;
+        case GOPRO_H4B_WIDE43_MEASURED_STABILISATION:
+            // Measured values for GoPro Hero 4 Black with 4:3 "Wide" FOV setting and stabilisation enabled
+            camera_matrix.at<double>(0, 2) = 965.90 * input_size.width / 1920;
+            camera_matrix.at<double>(1, 2) = 712.94 * input_size.height / 1440;
+            camera_matrix.at<double>(0, 0) = 1045.58 * input_size.height / 1440;
+            camera_matrix.at<double>(1, 1) = 1045.64 * input_size.height / 1440;
+            break;
+        case GOPRO_H4B_WIDE169_MEASURED:
+            // Measured values for GoPro Hero 4 Black with 16 "Wide" FOV setting and stabilisation disabled
+            camera_matrix.at<double>(0, 2) = 1361.80 * input_size.width / 2704;
+            camera_matrix.at<double>(1, 2) = 745.19 * input_size.height / 1520;
+            camera_matrix.at<double>(0, 0) = 1392.49 * input_size.height / 1520;
+            camera_matrix.at<double>(1, 1) = 1383.47 * input_size.height / 1520;
+            break;
+        case GOPRO_H4B_WIDE169_MEASURED_STABILISATION:
+            // Measured values for GoPro Hero 4 Black with 16 "Wide" FOV setting and stabilisation enabled
+            camera_matrix.at<double>(0, 2) = 1357.49 * input_size.width / 2704;
+            camera_matrix.at<double>(1, 2) = 736.74 * input_size.height / 1520;
+            camera_matrix.at<double>(0, 0) = 1626.67 * input_size.height / 1520;
+            camera_matrix.at<double>(1, 1) = 1619.46 * input_size.height / 1520;
+            break;
+    }
+
+    Camera camera;
+    camera.model = FISHEYE;
+    camera.matrix = camera_matrix;
+    camera.distortion_coefficients = distortion_coefficients;
+    camera.size = input_size;
+    return camera;
+}
+
+Camera get_output_camera(Camera input_camera, double scale, bool crop_borders, double zoom) {
+    Size input_size = input_camera.size;
+
+    // Find the coordinates of the corners and edge midpoints in the identity camera
+    vector<Point2d> extreme_points;
+    fisheye::undistortPoints(
+        vector<Point2d>({
+            // corners
+            Point2d(0, 0),
+            Point2d(0, input_size.height - 1),
+            Point2d(input_size.width - 1, 0),
+            Point2d(input_size.width - 1, input_size.height - 1),
+
+            // midpoint of edges
+            Point2d(input_camera.matrix(0, 2), 0),
+            Point2d(input_size.width - 1, input_camera.matrix(1, 2)),
+            Point2d(input_camera.matrix(0, 2), input_size.height - 1),
+            Point2d(0, input_camera.matrix(1, 2)),
+        }),
+        extreme_points,
+        input_camera.matrix,
+        input_camera.distortion_coefficients
+    );
+
+    // Find a bounding rectangle in the identity camera which maps to all points in the input
+    auto compare_x = [](const Point2d &point1, const Point2d &point2) {
+        return point1.x < point2.x;
+    };
+    auto compare_y = [](const Point2d &point1, const Point2d &point2) {
+        return point1.y < point2.y;
+    };
+    int start_point = crop_borders ? 4 : 0;
+    double max_x = max_element(
+        begin(extreme_points) + start_point,
+        end(extreme_points),
+        compare_x
+    )->x;
+    double min_x = min_element(
+        begin(extreme_points) + start_point,
+        end(extreme_points),
+        compare_x
+    )->x;
+    double max_y = max_element(
+        begin(extreme_points) + start_point,
+        end(extreme_points),
+        compare_y
+    )->y;
+    double min_y = min_element(
+        begin(extreme_points) + start_point,
+        end(extreme_points),
+        compare_y
+    )->y;
+
+    // Find (roughly) the average scale on the diagonal between the before/after cameras
+    Point input_diagonal = Point2d(input_size.width - 1, input_size.height - 1);
+    double input_diagonal_length = sqrt(
+        1. * input_diagonal.x * input_diagonal.x + input_diagonal.y * input_diagonal.y
+    );
+    Point output_diagonal = extreme_points[3] - extreme_points[0];
+    double output_diagonal_length = sqrt(
+        1. * output_diagonal.x * output_diagonal.x + output_diagonal.y * output_diagonal.y
+    );
+    scale *= input_diagonal_length / output_diagonal_length;
+
+    // Create output camera matrix, with the center positioned to ideally fit the remapped input
+    Matx33d matrix = Matx33d::eye();
+    matrix(0, 0) = scale;
+    matrix(1, 1) = scale;
+    matrix(0, 2) = scale * - min_x / zoom;
+    matrix(1, 2) = scale * - min_y / zoom;
+
+    Camera camera;
+    camera.model = RECTILINEAR;
+    camera.matrix = matrix;
+    camera.distortion_coefficients = Mat::zeros(4, 1, CV_64F);
+    camera.size = Size(scale * (max_x - min_x) / zoom, scale * (max_y - min_y) / zoom);
+    return camera;
+}
+
+Camera resize_camera(Camera camera, Size size) {
+    double scale_x = 1. * size.width / camera.size.width;
+    double scale_y = 1. * size.height / camera.size.height;
+    Camera resized = camera;
+    resized.matrix(0, 0) *= scale_x;
+    resized.matrix(1, 1) *= scale_y;
+    // Pixel centres are at integer coordinates, so scale about the image's top left corner
+    resized.matrix(0, 2) = (camera.matrix(0, 2) + 0.5) * scale_x - 0.5;
+    resized.matrix(1, 2) = (camera.matrix(1, 2) + 0.5) * scale_y - 0.5;
+    resized.size = size;
+    return resized;
+}
+
+void undistort_points(const Camera &camera, const vector<Point2f> &distorted, vector<Point2f> &undistorted) {
+    double fx = camera.matrix(0, 0);
+    double fy = camera.matrix(1, 1);
+    double cx = camera.matrix(0, 2);
+    double cy = camera.matrix(1, 2);
+    const Mat &coefficients = camera.distortion_coefficients;
+    double k1 = coefficients.at<double>(0);
+    double k2 = coefficients.at<double>(1);
+    double k3 = coefficients.at<double>(2);
+    double k4 = coefficients.at<double>(3);
+
+    undistorted.resize(distorted.size());
+    for (size_t i = 0; i < distorted.size(); i++) {
+        double x = (distorted[i].x - cx) / fx;
+        double y = (distorted[i].y - cy) / fy;
+        double theta_d = min(sqrt(x * x + y * y), CV_PI / 2);
+
+        // Solve theta_d = theta * (1 + k1 theta^2 + ... + k4 theta^8) for theta with
+        // Newton's method, as fisheye::undistortPoints does by default
+        double scale = 1;
+        bool converged = true;
+        if (theta_d > 1e-8) {
+            double theta = theta_d;
+            converged = false;
+            for (int iteration = 0; iteration < 10; iteration++) {
+                double theta2 = theta * theta;
+                double theta4 = theta2 * theta2;
+                double theta6 = theta4 * theta2;
+                double theta8 = theta6 * theta2;
+                double correction = (theta * (1 + k1 * theta2 + k2 * theta4 + k3 * theta6 + k4 * theta8) - theta_d) /
+                    (1 + 3 * k1 * theta2 + 5 * k2 * theta4 + 7 * k3 * theta6 + 9 * k4 * theta8);
+                theta -= correction;
+                if (fabs(correction) < 1e-8) {
+                    converged = true;
+                    break;
+                }
+            }
+            scale = theta > 0 ? tan(theta) / theta_d : -1;
+        }
+        // Like fisheye::undistortPoints, points which don't converge or flip to the other
+        // side of the centre are marked as far outside the image
+        if (converged && scale > 0) {
+            undistorted[i] = Point2f(x * scale, y * scale);
+        } else {
+            undistorted[i] = Point2f(-1e6, -1e6);
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef _CAMERA_HPP_
+#define _CAMERA_HPP_
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+enum CameraPreset {
+    GOPRO_H4B_WIDE43_PUBLISHED,
+    GOPRO_H4B_WIDE43_MEASURED,
+    GOPRO_H4B_WIDE43_MEASURED_STABILISATION,
+    GOPRO_H4B_WIDE169_PUBLISHED,
+    GOPRO_H4B_WIDE169_MEASURED,
+    GOPRO_H4B_WIDE169_MEASURED_STABILISATION
+};
+
+enum CameraModel {
+  RECTILINEAR,
+  FISHEYE
+};
+
+class Camera {
+  public:
+    CameraModel model;
+    cv::Matx33d matrix;
+    cv::Mat distortion_coefficients;
+    cv::Size size;
+};
+
+Camera get_preset_camera(CameraPreset preset, cv::Size input_size);
+
+Camera get_output_camera(Camera input_camera, double scale, bool crop_borders, double zoom);
+
+/**
+ * The same camera, with images resized to `size`
+ */
+Camera resize_camera(Camera camera, cv::Size size);
+
+/**
+ * Normalised image coordinates (bearings with z = 1) of pixels in a fisheye camera,
+ * like `cv::fisheye::undistortPoints`, but without temporary matrices: `undistorted` is
+ * only allocated if it's smaller than `distorted`
+ */
+void undistort_points(
+  const Camera &camera,
+  const std::vector<cv::Point2f> &distorted,
+  std::vector<cv::Point2f> &undistorted
+);
+
+#endif // _CAMERA_HPP_
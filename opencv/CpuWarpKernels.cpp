@@ -0,0 +1,86 @@
+#include "CpuWarpKernels.hpp"
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+void warp_rows_scalar(const CpuWarpParams &params, int row_begin, int row_end) {
+    for (int row = row_begin; row < row_end; row++) {
+        uint8_t *dst_row = params.dst + row * params.dst_step;
+        for (int col = 0; col < params.dst_cols; col++) {
+            float src_x, src_y;
+            find_source_coordinates_scalar(params, col, row, src_x, src_y);
+            sample_nv12_to_bgr(params, src_x, src_y, dst_row + col * 3);
+        }
+    }
+}
+
+#if defined(__aarch64__)
+/**
+ * NEON has no gathers, so the projection is vectorised four pixels at a time and the
+ * sampling is done per pixel
+ */
+void warp_rows_neon(const CpuWarpParams &params, int row_begin, int row_end) {
+    const float *r = params.rotation;
+    const float lane_offsets[] = { 0, 1, 2, 3 };
+    const float32x4_t lanes = vld1q_f32(lane_offsets);
+    const float32x4_t one = vdupq_n_f32(1);
+    const float32x4_t half_pi = vdupq_n_f32(M_PI / 2);
+    const float32x4_t inverse_map_focal_x = vdupq_n_f32(1 / params.map_focal_x);
+
+    for (int row = row_begin; row < row_end; row++) {
+        uint8_t *dst_row = params.dst + row * params.dst_step;
+        float vy = (row - params.map_center_y) / params.map_focal_y;
+        float32x4_t row_x = vdupq_n_f32(r[1] * vy + r[2]);
+        float32x4_t row_y = vdupq_n_f32(r[4] * vy + r[5]);
+        float32x4_t row_z = vdupq_n_f32(r[7] * vy + r[8]);
+
+        int col = 0;
+        for (; col + 4 <= params.dst_cols; col += 4) {
+            float32x4_t map_x = vaddq_f32(vdupq_n_f32(col), lanes);
+            float32x4_t vx = vmulq_f32(
+                vsubq_f32(map_x, vdupq_n_f32(params.map_center_x)),
+                inverse_map_focal_x
+            );
+            float32x4_t rx = vfmaq_n_f32(row_x, vx, r[0]);
+            float32x4_t ry = vfmaq_n_f32(row_y, vx, r[3]);
+            float32x4_t rz = vfmaq_n_f32(row_z, vx, r[6]);
+            float32x4_t cx = vdivq_f32(rx, rz);
+            float32x4_t cy = vdivq_f32(ry, rz);
+
+            float32x4_t radius_squared = vfmaq_f32(vmulq_f32(cx, cx), cy, cy);
+            float32x4_t radius = vsqrtq_f32(radius_squared);
+            uint32x4_t is_large = vcgtq_f32(radius, one);
+            // atan(r) / r = Q(r^2) for r <= 1, (pi/2 - t * Q(t^2)) * t with t = 1/r otherwise
+            float32x4_t t = vdivq_f32(one, vmaxq_f32(radius, one));
+            float32x4_t s = vbslq_f32(is_large, vmulq_f32(t, t), radius_squared);
+            float32x4_t q = vdupq_n_f32(ATAN_COEFFICIENTS[4]);
+            for (int i = 3; i >= 0; i--) {
+                q = vfmaq_f32(vdupq_n_f32(ATAN_COEFFICIENTS[i]), q, s);
+            }
+            float32x4_t large_correction = vmulq_f32(vfmsq_f32(half_pi, t, q), t);
+            float32x4_t correction = vbslq_f32(is_large, large_correction, q);
+
+            float src_x[4], src_y[4];
+            vst1q_f32(src_x, vfmaq_n_f32(
+                vdupq_n_f32(params.src_center_x),
+                vmulq_f32(cx, correction),
+                params.src_focal_x
+            ));
+            vst1q_f32(src_y, vfmaq_n_f32(
+                vdupq_n_f32(params.src_center_y),
+                vmulq_f32(cy, correction),
+                params.src_focal_y
+            ));
+            for (int i = 0; i < 4; i++) {
+                sample_nv12_to_bgr(params, src_x[i], src_y[i], dst_row + (col + i) * 3);
+            }
+        }
+        for (; col < params.dst_cols; col++) {
+            float src_x, src_y;
+            find_source_coordinates_scalar(params, col, row, src_x, src_y);
+            sample_nv12_to_bgr(params, src_x, src_y, dst_row + col * 3);
+        }
+    }
+}
+#endif
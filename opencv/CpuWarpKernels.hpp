@@ -0,0 +1,152 @@
+#ifndef _CPU_WARP_KERNELS_HPP_
+#define _CPU_WARP_KERNELS_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+/**
+ * Everything a CPU warp kernel needs to warp rows of an NV12 image to BGR.
+ * The projection is the same as `find_source_coordinates` in createMap.cl.
+ */
+class CpuWarpParams {
+  public:
+    // NV12 input
+    const uint8_t *luma;
+    const uint8_t *chroma;
+    int src_step;
+    int src_cols;
+    int src_rows;
+
+    // BGR output
+    uint8_t *dst;
+    int dst_step;
+    int dst_cols;
+
+    float src_center_x, src_center_y, src_focal_x, src_focal_y;
+    float map_center_x, map_center_y, map_focal_x, map_focal_y;
+    // Row major
+    float rotation[9];
+
+    bool nearest;
+};
+
+/**
+ * Warp output rows [row_begin, row_end)
+ */
+typedef void (*CpuWarpRowsFunction)(const CpuWarpParams &params, int row_begin, int row_end);
+
+void warp_rows_scalar(const CpuWarpParams &params, int row_begin, int row_end);
+#if defined(__aarch64__)
+void warp_rows_neon(const CpuWarpParams &params, int row_begin, int row_end);
+#endif
+#ifdef HAVE_CPU_WARP_AVX2
+void warp_rows_avx2(const CpuWarpParams &params, int row_begin, int row_end);
+#endif
+
+// The helpers below have internal linkage: they're compiled into the AVX2 kernel's
+// translation unit with -mavx2 -mfma too, and the linker must not pick that copy for
+// the others
+
+static inline void find_source_coordinates_scalar(
+    const CpuWarpParams &p,
+    float map_x,
+    float map_y,
+    float &src_x,
+    float &src_y
+) {
+    float vx = (map_x - p.map_center_x) / p.map_focal_x;
+    float vy = (map_y - p.map_center_y) / p.map_focal_y;
+    const float *r = p.rotation;
+    float rx = r[0] * vx + r[1] * vy + r[2];
+    float ry = r[3] * vx + r[4] * vy + r[5];
+    float rz = r[6] * vx + r[7] * vy + r[8];
+    float cx = rx / rz;
+    float cy = ry / rz;
+    float radius = std::sqrt(cx * cx + cy * cy);
+    float fisheye_correction = radius == 0 ? 1 : std::atan(radius) / radius;
+    src_x = p.src_center_x + cx * fisheye_correction * p.src_focal_x;
+    src_y = p.src_center_y + cy * fisheye_correction * p.src_focal_y;
+}
+
+static inline uint8_t saturate_to_uint8(float value) {
+    return (uint8_t) std::min(std::max(std::lrint(value), 0L), 255L);
+}
+
+/**
+ * BT.601 limited range, matching cvtColor(COLOR_YUV2BGR_NV12) and createMap.cl
+ */
+static inline void write_bgr_from_yuv(float y, float u, float v, uint8_t *dst_pixel) {
+    float luma_scaled = 1.164f * std::max(y - 16.f, 0.f);
+    u -= 128.f;
+    v -= 128.f;
+    dst_pixel[0] = saturate_to_uint8(luma_scaled + 2.018f * u);
+    dst_pixel[1] = saturate_to_uint8(luma_scaled - 0.813f * v - 0.391f * u);
+    dst_pixel[2] = saturate_to_uint8(luma_scaled + 1.596f * v);
+}
+
+/**
+ * Find the top left sample and weight for interpolating at `location` along an axis
+ * with `size` samples, keeping both samples in bounds
+ */
+static inline void find_interpolation_sample(float location, int size, bool nearest, int &index, float &weight) {
+    location = std::min(std::max(location, 0.f), size - 1.f);
+    if (nearest) {
+        location = std::nearbyint(location);
+    }
+    index = std::min((int) location, size - 2);
+    weight = location - index;
+}
+
+static inline float lerp(float a, float b, float weight) {
+    return a + (b - a) * weight;
+}
+
+/**
+ * Bilinearly (or nearest neighbour) sample an NV12 image and write one BGR pixel.
+ * Like remap with BORDER_CONSTANT, locations outside the source are black.
+ */
+static inline void sample_nv12_to_bgr(const CpuWarpParams &p, float src_x, float src_y, uint8_t *dst_pixel) {
+    if (src_x < 0 || src_x > p.src_cols - 1 || src_y < 0 || src_y > p.src_rows - 1) {
+        dst_pixel[0] = 0;
+        dst_pixel[1] = 0;
+        dst_pixel[2] = 0;
+        return;
+    }
+
+    int x0, y0;
+    float wx, wy;
+    find_interpolation_sample(src_x, p.src_cols, p.nearest, x0, wx);
+    find_interpolation_sample(src_y, p.src_rows, p.nearest, y0, wy);
+    const uint8_t *luma_row0 = p.luma + y0 * p.src_step;
+    const uint8_t *luma_row1 = luma_row0 + p.src_step;
+    float y = lerp(
+        lerp(luma_row0[x0], luma_row0[x0 + 1], wx),
+        lerp(luma_row1[x0], luma_row1[x0 + 1], wx),
+        wy
+    );
+
+    // Chroma samples are centred between each 2x2 block of luma samples
+    find_interpolation_sample(src_x * 0.5f - 0.25f, p.src_cols / 2, p.nearest, x0, wx);
+    find_interpolation_sample(src_y * 0.5f - 0.25f, p.src_rows / 2, p.nearest, y0, wy);
+    const uint8_t *chroma_row0 = p.chroma + y0 * p.src_step + x0 * 2;
+    const uint8_t *chroma_row1 = chroma_row0 + p.src_step;
+    float u = lerp(
+        lerp(chroma_row0[0], chroma_row0[2], wx),
+        lerp(chroma_row1[0], chroma_row1[2], wx),
+        wy
+    );
+    float v = lerp(
+        lerp(chroma_row0[1], chroma_row0[3], wx),
+        lerp(chroma_row1[1], chroma_row1[3], wx),
+        wy
+    );
+
+    write_bgr_from_yuv(y, u, v, dst_pixel);
+}
+
+// Minimax polynomial for atan(x) / x with |x| <= 1 (Abramowitz & Stegun 4.4.47,
+// |error| <= 1e-5 radians), in terms of x^2
+const float ATAN_COEFFICIENTS[] = { 0.9998660f, -0.3302995f, 0.1801410f, -0.0851330f, 0.0208351f };
+
+#endif // _CPU_WARP_KERNELS_HPP_
@@ -0,0 +1,182 @@
+/**
+ * AVX2/FMA warp kernel. This file is compiled with -mavx2 -mfma, and only called
+ * after checking that the CPU supports them.
+ */
+#include "CpuWarpKernels.hpp"
+
+#include <immintrin.h>
+
+/**
+ * Find the top left samples and weights for interpolating at `location` along an axis
+ * with `size` samples, as in find_interpolation_sample
+ */
+static inline void find_interpolation_samples(
+    __m256 location,
+    int size,
+    bool nearest,
+    __m256i &index,
+    __m256 &weight
+) {
+    location = _mm256_min_ps(_mm256_max_ps(location, _mm256_setzero_ps()), _mm256_set1_ps(size - 1.f));
+    if (nearest) {
+        location = _mm256_round_ps(location, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    }
+    __m256 index_float = _mm256_min_ps(_mm256_floor_ps(location), _mm256_set1_ps(size - 2.f));
+    index = _mm256_cvttps_epi32(index_float);
+    weight = _mm256_sub_ps(location, index_float);
+}
+
+static inline __m256 byte_to_float(__m256i words, int byte) {
+    return _mm256_cvtepi32_ps(_mm256_and_si256(
+        _mm256_srli_epi32(words, byte * 8),
+        _mm256_set1_epi32(0xff)
+    ));
+}
+
+static inline __m256 lerp(__m256 a, __m256 b, __m256 weight) {
+    return _mm256_fmadd_ps(_mm256_sub_ps(b, a), weight, a);
+}
+
+static inline __m256i clamp_to_uint8(__m256 value) {
+    value = _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(255));
+    return _mm256_cvtps_epi32(value);
+}
+
+void warp_rows_avx2(const CpuWarpParams &params, int row_begin, int row_end) {
+    const float *r = params.rotation;
+    const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1);
+    const __m256 half_pi = _mm256_set1_ps(M_PI / 2);
+    const __m256i src_step = _mm256_set1_epi32(params.src_step);
+
+    for (int row = row_begin; row < row_end; row++) {
+        uint8_t *dst_row = params.dst + row * params.dst_step;
+        float vy = (row - params.map_center_y) / params.map_focal_y;
+        __m256 row_x = _mm256_set1_ps(r[1] * vy + r[2]);
+        __m256 row_y = _mm256_set1_ps(r[4] * vy + r[5]);
+        __m256 row_z = _mm256_set1_ps(r[7] * vy + r[8]);
+
+        int col = 0;
+        for (; col + 8 <= params.dst_cols; col += 8) {
+            // Projection
+            __m256 map_x = _mm256_add_ps(_mm256_set1_ps(col), lanes);
+            __m256 vx = _mm256_div_ps(
+                _mm256_sub_ps(map_x, _mm256_set1_ps(params.map_center_x)),
+                _mm256_set1_ps(params.map_focal_x)
+            );
+            __m256 rx = _mm256_fmadd_ps(_mm256_set1_ps(r[0]), vx, row_x);
+            __m256 ry = _mm256_fmadd_ps(_mm256_set1_ps(r[3]), vx, row_y);
+            __m256 rz = _mm256_fmadd_ps(_mm256_set1_ps(r[6]), vx, row_z);
+            __m256 inverse_rz = _mm256_div_ps(one, rz);
+            __m256 cx = _mm256_mul_ps(rx, inverse_rz);
+            __m256 cy = _mm256_mul_ps(ry, inverse_rz);
+
+            // atan(r) / r = Q(r^2) for r <= 1, (pi/2 - t * Q(t^2)) * t with t = 1/r otherwise
+            __m256 radius_squared = _mm256_fmadd_ps(cx, cx, _mm256_mul_ps(cy, cy));
+            __m256 radius = _mm256_sqrt_ps(radius_squared);
+            __m256 is_large = _mm256_cmp_ps(radius, one, _CMP_GT_OQ);
+            __m256 t = _mm256_div_ps(one, _mm256_max_ps(radius, one));
+            __m256 s = _mm256_blendv_ps(radius_squared, _mm256_mul_ps(t, t), is_large);
+            __m256 q = _mm256_set1_ps(ATAN_COEFFICIENTS[4]);
+            for (int i = 3; i >= 0; i--) {
+                q = _mm256_fmadd_ps(q, s, _mm256_set1_ps(ATAN_COEFFICIENTS[i]));
+            }
+            __m256 large_correction = _mm256_mul_ps(_mm256_fnmadd_ps(t, q, half_pi), t);
+            __m256 correction = _mm256_blendv_ps(q, large_correction, is_large);
+
+            __m256 src_x = _mm256_fmadd_ps(
+                _mm256_mul_ps(cx, correction),
+                _mm256_set1_ps(params.src_focal_x),
+                _mm256_set1_ps(params.src_center_x)
+            );
+            __m256 src_y = _mm256_fmadd_ps(
+                _mm256_mul_ps(cy, correction),
+                _mm256_set1_ps(params.src_focal_y),
+                _mm256_set1_ps(params.src_center_y)
+            );
+            __m256 inside = _mm256_and_ps(
+                _mm256_and_ps(
+                    _mm256_cmp_ps(src_x, zero, _CMP_GE_OQ),
+                    _mm256_cmp_ps(src_x, _mm256_set1_ps(params.src_cols - 1.f), _CMP_LE_OQ)
+                ),
+                _mm256_and_ps(
+                    _mm256_cmp_ps(src_y, zero, _CMP_GE_OQ),
+                    _mm256_cmp_ps(src_y, _mm256_set1_ps(params.src_rows - 1.f), _CMP_LE_OQ)
+                )
+            );
+
+            // Luma: gather 4 bytes at each top left sample, of which the first 2 are used
+            __m256i x0, y0;
+            __m256 wx, wy;
+            find_interpolation_samples(src_x, params.src_cols, params.nearest, x0, wx);
+            find_interpolation_samples(src_y, params.src_rows, params.nearest, y0, wy);
+            __m256i offset = _mm256_add_epi32(_mm256_mullo_epi32(y0, src_step), x0);
+            __m256i top = _mm256_i32gather_epi32((const int *) params.luma, offset, 1);
+            __m256i bottom = _mm256_i32gather_epi32(
+                (const int *) params.luma,
+                _mm256_add_epi32(offset, src_step),
+                1
+            );
+            __m256 luma = lerp(
+                lerp(byte_to_float(top, 0), byte_to_float(top, 1), wx),
+                lerp(byte_to_float(bottom, 0), byte_to_float(bottom, 1), wx),
+                wy
+            );
+
+            // Chroma: each gather returns U0 V0 U1 V1
+            __m256 chroma_x = _mm256_fmsub_ps(src_x, _mm256_set1_ps(0.5f), _mm256_set1_ps(0.25f));
+            __m256 chroma_y = _mm256_fmsub_ps(src_y, _mm256_set1_ps(0.5f), _mm256_set1_ps(0.25f));
+            find_interpolation_samples(chroma_x, params.src_cols / 2, params.nearest, x0, wx);
+            find_interpolation_samples(chroma_y, params.src_rows / 2, params.nearest, y0, wy);
+            offset = _mm256_add_epi32(_mm256_mullo_epi32(y0, src_step), _mm256_slli_epi32(x0, 1));
+            top = _mm256_i32gather_epi32((const int *) params.chroma, offset, 1);
+            bottom = _mm256_i32gather_epi32(
+                (const int *) params.chroma,
+                _mm256_add_epi32(offset, src_step),
+                1
+            );
+            __m256 u = lerp(
+                lerp(byte_to_float(top, 0), byte_to_float(top, 2), wx),
+                lerp(byte_to_float(bottom, 0), byte_to_float(bottom, 2), wx),
+                wy
+            );
+            __m256 v = lerp(
+                lerp(byte_to_float(top, 1), byte_to_float(top, 3), wx),
+                lerp(byte_to_float(bottom, 1), byte_to_float(bottom, 3), wx),
+                wy
+            );
+
+            // BT.601 limited range, as in write_bgr_from_yuv
+            __m256 luma_scaled = _mm256_mul_ps(
+                _mm256_set1_ps(1.164f),
+                _mm256_max_ps(_mm256_sub_ps(luma, _mm256_set1_ps(16)), zero)
+            );
+            u = _mm256_sub_ps(u, _mm256_set1_ps(128));
+            v = _mm256_sub_ps(v, _mm256_set1_ps(128));
+            __m256 blue = _mm256_fmadd_ps(_mm256_set1_ps(2.018f), u, luma_scaled);
+            __m256 green = _mm256_fnmadd_ps(
+                _mm256_set1_ps(0.391f),
+                u,
+                _mm256_fnmadd_ps(_mm256_set1_ps(0.813f), v, luma_scaled)
+            );
+            __m256 red = _mm256_fmadd_ps(_mm256_set1_ps(1.596f), v, luma_scaled);
+
+            alignas(32) int32_t bgr[3][8];
+            _mm256_store_si256((__m256i *) bgr[0], clamp_to_uint8(_mm256_and_ps(blue, inside)));
+            _mm256_store_si256((__m256i *) bgr[1], clamp_to_uint8(_mm256_and_ps(green, inside)));
+            _mm256_store_si256((__m256i *) bgr[2], clamp_to_uint8(_mm256_and_ps(red, inside)));
+            uint8_t *dst_pixel = dst_row + col * 3;
+            for (int i = 0; i < 8; i++) {
+                dst_pixel[i * 3] = bgr[0][i];
+                dst_pixel[i * 3 + 1] = bgr[1][i];
+                dst_pixel[i * 3 + 2] = bgr[2][i];
+            }
+        }
+        for (; col < params.dst_cols; col++) {
+            float src_x, src_y;
+            find_source_coordinates_scalar(params, col, row, src_x, src_y);
+            sample_nv12_to_bgr(params, src_x, src_y, dst_row + col * 3);
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#include "CpuWarper.hpp"
+
+#include <iostream>
+
+using namespace cv;
+using namespace std;
+
+// Aim for a block's output rows and the input rows they sample to fit in L2
+const int CACHE_BLOCK_BYTES = 256 * 1024;
+
+CpuWarpRowsFunction find_warp_rows_function(CpuWarpIsa isa) {
+#ifdef HAVE_CPU_WARP_AVX2
+    bool has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if ((isa == CPU_WARP_ISA_AUTO || isa == CPU_WARP_ISA_AVX2) && has_avx2) {
+        cerr << "CPU warp using AVX2\n";
+        return warp_rows_avx2;
+    }
+#endif
+#if defined(__aarch64__)
+    if (isa == CPU_WARP_ISA_AUTO || isa == CPU_WARP_ISA_NEON) {
+        cerr << "CPU warp using NEON\n";
+        return warp_rows_neon;
+    }
+#endif
+    if (isa != CPU_WARP_ISA_AUTO && isa != CPU_WARP_ISA_SCALAR) {
+        cerr << "Requested CPU warp instruction set is unavailable\n";
+    }
+    cerr << "CPU warp using scalar code\n";
+    return warp_rows_scalar;
+}
+
+CpuWarper::CpuWarper(
+    Camera input_camera,
+    Camera output_camera,
+    InterpolationFlags interpolation,
+    CpuWarpIsa isa
+):
+    m_input_camera(input_camera),
+    m_output_camera(output_camera),
+    m_nearest(interpolation == INTER_NEAREST),
+    m_warp_rows(find_warp_rows_function(isa))
+{
+    if (interpolation != INTER_LINEAR && interpolation != INTER_NEAREST) {
+        cerr << "CPU warp only supports linear or nearest interpolation, using linear\n";
+    }
+    // Each output row (3 bytes per pixel) samples roughly one row of luma and half a row
+    // of interleaved chroma
+    int bytes_per_row = output_camera.size.width * 3 + input_camera.size.width * 3 / 2;
+    m_block_rows = max(1, min(64, CACHE_BLOCK_BYTES / bytes_per_row));
+}
+
+void CpuWarper::warp(const Mat &input_nv12, Mat &output_bgr, const Matx33d &rotation) {
+    CV_Assert(input_nv12.type() == CV_8U && input_nv12.rows % 3 == 0);
+    output_bgr.create(m_output_camera.size, CV_8UC3);
+
+    CpuWarpParams params;
+    params.src_rows = input_nv12.rows * 2 / 3;
+    params.src_cols = input_nv12.cols;
+    params.src_step = input_nv12.step;
+    params.luma = input_nv12.ptr(0);
+    params.chroma = input_nv12.ptr(params.src_rows);
+    params.dst = output_bgr.ptr(0);
+    params.dst_step = output_bgr.step;
+    params.dst_cols = output_bgr.cols;
+    params.src_center_x = m_input_camera.matrix(0, 2);
+    params.src_center_y = m_input_camera.matrix(1, 2);
+    params.src_focal_x = m_input_camera.matrix(0, 0);
+    params.src_focal_y = m_input_camera.matrix(1, 1);
+    params.map_center_x = m_output_camera.matrix(0, 2);
+    params.map_center_y = m_output_camera.matrix(1, 2);
+    params.map_focal_x = m_output_camera.matrix(0, 0);
+    params.map_focal_y = m_output_camera.matrix(1, 1);
+    for (int i = 0; i < 9; i++) {
+        params.rotation[i] = rotation(i / 3, i % 3);
+    }
+    params.nearest = m_nearest;
+
+    int rows = output_bgr.rows;
+    int block_rows = m_block_rows;
+    int num_blocks = (rows + block_rows - 1) / block_rows;
+    CpuWarpRowsFunction warp_rows = m_warp_rows;
+    parallel_for_(Range(0, num_blocks), [&](const Range &blocks) {
+        for (int block = blocks.start; block < blocks.end; block++) {
+            warp_rows(params, block * block_rows, min(rows, (block + 1) * block_rows));
+        }
+    }, num_blocks);
+}
@@ -0,0 +1,44 @@
+#ifndef _CPU_WARPER_HPP_
+#define _CPU_WARPER_HPP_
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "CpuWarpKernels.hpp"
+#include "Camera.hpp"
+
+enum CpuWarpIsa {
+  CPU_WARP_ISA_AUTO,
+  CPU_WARP_ISA_SCALAR,
+  CPU_WARP_ISA_NEON,
+  CPU_WARP_ISA_AVX2
+};
+
+/**
+ * Warps NV12 frames to BGR on the CPU, for hosts without (or with slow) OpenCL
+ *
+ * Output rows are split into blocks sized to stay in cache, which are warped in
+ * parallel on OpenCV's thread pool by a kernel for the best instruction set available.
+ */
+class CpuWarper {
+    Camera m_input_camera;
+    Camera m_output_camera;
+    bool m_nearest;
+    CpuWarpRowsFunction m_warp_rows;
+    int m_block_rows;
+  public:
+    CpuWarper(
+      Camera input_camera,
+      Camera output_camera,
+      cv::InterpolationFlags interpolation = cv::INTER_LINEAR,
+      CpuWarpIsa isa = CPU_WARP_ISA_AUTO
+    );
+
+    /**
+     * Warp an NV12 frame (luma rows followed by chroma rows) to a BGR frame of the output
+     * camera's size, for a rotation of the output camera
+     */
+    void warp(const cv::Mat &input_nv12, cv::Mat &output_bgr, const cv::Matx33d &rotation);
+};
+
+#endif // _CPU_WARPER_HPP_
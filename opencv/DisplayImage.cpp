@@ -3,33 +3,44 @@
 #include <opencv2/highgui.hpp>
 
 #include <iostream>
+#include <string>
 #include <math.h>
 
 #include "hw_init.hpp"
 #include "AvFrameSourceProfile.hpp"
+#include "AvFrameSourceAsync.hpp"
 #include "AvFrameSourceFileVaapi.hpp"
 #include "AvFrameSourceMapOpenCl.hpp"
+#include "AvFrameSourceFileSw.hpp"
 #include "FrameSourceProfile.hpp"
+#include "Profiler.hpp"
+#include "Tracer.hpp"
 #include "FrameSourceFfmpegOpenCl.hpp"
+#include "FrameSourceFfmpegSw.hpp"
 #include "FrameSourceWarp.hpp"
+#include "FrameSourceTrajectoryWarp.hpp"
+#include "analysis.hpp"
+#include "render.hpp"
 
 using namespace std;
 using namespace cv;
 
 #define DRM_DEVICE_PATH "/dev/dri/renderD128"
 
-int main (int argc, char* argv[])
-{
-    if (argc < 2) {
-        std::cout << "\n\tUsage: " << argv[0] << " <filename>\n\n";
-        return 1;
-    }
-
-    if (!is_vaapi_and_opencl_supported()) {
-        cerr << "Error: FFmpeg was built without VAAPI or OpenCL support\n";
-        return 2;
+/**
+ * Optionally move an `AvFrameSource` chain onto its own thread
+ */
+shared_ptr<AvFrameSource> read_ahead(shared_ptr<AvFrameSource> source, int read_ahead_frames) {
+    if (read_ahead_frames <= 0) {
+        return source;
     }
+    return make_shared<AvFrameSourceProfile>(
+        make_unique<AvFrameSourceAsync>(source, read_ahead_frames, "ffmpeg-read-ahead"),
+        "ffmpeg-read-ahead"
+    );
+}
 
+shared_ptr<FrameSource> create_vaapi_source(string file_path, int read_ahead_frames) {
     // Set up compatible hardware contexts
     auto av_buffer_deleter = [](AVBufferRef *ref) { av_buffer_unref(&ref); };
     auto vaapi_device_ctx = shared_ptr<AVBufferRef>(create_vaapi_context(), av_buffer_deleter);
@@ -40,26 +51,263 @@ int main (int argc, char* argv[])
     init_opencv_from_opencl_context(opencl_device_ctx.get());
 
     auto vaapi_source = make_shared<AvFrameSourceProfile>(
-        make_unique<AvFrameSourceFileVaapi>(argv[1], vaapi_device_ctx),
+        make_unique<AvFrameSourceFileVaapi>(file_path, vaapi_device_ctx),
         "ffmpeg-vaapi"
     );
     auto opencl_source = make_shared<AvFrameSourceProfile>(
         make_unique<AvFrameSourceMapOpenCl>(vaapi_source, opencl_device_ctx),
         "ffmpeg-opencl"
     );
-    auto ffmpeg_source = make_shared<FrameSourceProfile>(
-        std::make_unique<FrameSourceFfmpegOpenCl>(opencl_source),
+    return make_shared<FrameSourceProfile>(
+        std::make_unique<FrameSourceFfmpegOpenCl>(read_ahead(opencl_source, read_ahead_frames)),
         "opencv-mapped"
     );
-    auto warped_source = make_shared<FrameSourceProfile>(
-        make_unique<FrameSourceWarp>(ffmpeg_source, GOPRO_H4B_WIDE43_MEASURED, 0.5, false, 1.0, 30),
-        "opencv-warped"
+}
+
+shared_ptr<FrameSource> create_sw_source(
+    string file_path,
+    int decode_threads,
+    int read_ahead_frames
+) {
+    // OpenCV uses its default OpenCL device (if any), e.g. a CPU ICD such as PoCL
+    auto sw_source = make_shared<AvFrameSourceProfile>(
+        make_unique<AvFrameSourceFileSw>(file_path, decode_threads),
+        "ffmpeg-sw"
     );
+    return make_shared<FrameSourceProfile>(
+        std::make_unique<FrameSourceFfmpegSw>(read_ahead(sw_source, read_ahead_frames)),
+        "opencv-uploaded"
+    );
+}
+
+void print_usage(char *program) {
+    std::cout << "\n\tUsage: " << program << " <filename> [options]\n\n" <<
+        "\t--decode=vaapi|sw     Decode with VA-API (default) or in software\n" <<
+        "\t--decode-threads=N    Software decoding threads (default 0: one per core)\n" <<
+        "\t--read-ahead=N        Decode up to N frames ahead on another thread (default 8, 0 disables)\n" <<
+        "\t--warp=MODE           maps: float pixel maps + remap (default)\n" <<
+        "\t                      maps-fixed: fixed point pixel maps + remap\n" <<
+        "\t                      fused: one kernel sampling NV12 directly\n" <<
+        "\t                      mesh: fused, interpolating a coarse mesh of the projection\n" <<
+        "\t                      cpu: vectorised CPU kernel, no OpenCL required\n" <<
+        "\t--mesh-spacing=N      Mesh spacing in pixels (default 0: choose automatically)\n" <<
+        "\t--analysis-scale=S    Estimate motion at S (0 < S <= 1) times the input resolution (default 1)\n" <<
+        "\t--motion-queue=N      Estimate motion on another thread, up to N frames ahead (default 4, 0 disables)\n" <<
+        "\t--stabilise=MODE      smooth: smooth the motion with lookahead (default)\n" <<
+        "\t                      kalman: Kalman filter without lookahead, for low latency\n" <<
+        "\t--lookahead-device-mb=N  Keep up to N MiB of buffered frames in device memory (default: all)\n" <<
+        "\t--lookahead-host-mb=N    Spill up to N MiB of buffered frames to pinned host memory (default 0)\n" <<
+        "\t--lookahead-scratch=DIR  Spill the remaining buffered frames to a scratch file in DIR\n" <<
+        "\t--analyse=FILE        Only measure the camera motion, and write it to a trajectory FILE\n" <<
+        "\t--analysis-workers=N  Analyse chunks of the video on N threads with software decoding\n" <<
+        "\t                      (default 0: one per core, 1 analyses the whole video in order)\n" <<
+        "\t--trajectory=FILE     Stabilise with the motion in a trajectory FILE, without lookahead\n" <<
+        "\t--render=FILE         Encode the video stabilised with --trajectory to FILE, instead of displaying it\n" <<
+        "\t--render-workers=N    Render segments of the video on N threads (default 0: one per core)\n" <<
+        "\t--encoder=NAME        Software encoder for --render (default libx264)\n" <<
+        "\t--encoder-options=OPTS  Encoder options as key=value pairs separated by ':' (e.g. crf=18:preset=fast)\n" <<
+        "\t--profile-interval=S  Print profiling summaries at most every S seconds (default 1, 0 disables)\n" <<
+        "\t--profile-json=FILE   Write the per-stage timing statistics to a JSON FILE at exit\n" <<
+        "\t--profile-csv=FILE    Write the per-stage timing statistics to a CSV FILE at exit\n" <<
+        "\t--trace=FILE          Write a timeline of host stages and OpenCL device work to FILE at exit,\n" <<
+        "\t                      in Chrome trace format (open with chrome://tracing or ui.perfetto.dev)\n\n";
+}
+
+int main (int argc, char* argv[])
+{
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    string decode = "vaapi";
+    int decode_threads = 0;
+    int read_ahead_frames = 8;
+    WarpMode warp_mode = WARP_MODE_MAPS;
+    int mesh_spacing = 0;
+    double analysis_scale = 1;
+    StabiliseMode stabilise_mode = STABILISE_MODE_SMOOTH;
+    int motion_queue_frames = 4;
+    TieredFrameStoreConfig lookahead;
+    string analyse_path;
+    int analysis_workers = 0;
+    string trajectory_path;
+    string render_path;
+    int render_workers = 0;
+    string encoder_name = "libx264";
+    string encoder_options;
+    string profile_json_path;
+    string profile_csv_path;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        size_t equals = arg.find('=');
+        string name = arg.substr(0, equals);
+        string value = equals == string::npos ? "" : arg.substr(equals + 1);
+        if (name == "--decode" && (value == "vaapi" || value == "sw")) {
+            decode = value;
+        } else if (name == "--decode-threads") {
+            decode_threads = stoi(value);
+        } else if (name == "--read-ahead") {
+            read_ahead_frames = stoi(value);
+        } else if (name == "--warp" && parse_warp_mode(value, warp_mode)) {
+        } else if (name == "--mesh-spacing") {
+            mesh_spacing = stoi(value);
+        } else if (name == "--analysis-scale") {
+            analysis_scale = stod(value);
+            // Negated, so that NaN is rejected too
+            if (!(analysis_scale > 0 && analysis_scale <= 1)) {
+                cerr << "Invalid analysis scale, must be in (0, 1]: " << value << "\n";
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (name == "--motion-queue") {
+            motion_queue_frames = stoi(value);
+        } else if (name == "--stabilise" && value == "smooth") {
+            stabilise_mode = STABILISE_MODE_SMOOTH;
+        } else if (name == "--stabilise" && value == "kalman") {
+            stabilise_mode = STABILISE_MODE_KALMAN;
+        } else if (name == "--lookahead-device-mb") {
+            lookahead.device_budget_bytes = stoul(value) * 1024 * 1024;
+        } else if (name == "--lookahead-host-mb") {
+            lookahead.host_budget_bytes = stoul(value) * 1024 * 1024;
+        } else if (name == "--lookahead-scratch") {
+            lookahead.scratch_directory = value;
+        } else if (name == "--analyse") {
+            analyse_path = value;
+        } else if (name == "--analysis-workers") {
+            analysis_workers = stoi(value);
+        } else if (name == "--trajectory") {
+            trajectory_path = value;
+        } else if (name == "--render") {
+            render_path = value;
+        } else if (name == "--render-workers") {
+            render_workers = stoi(value);
+        } else if (name == "--encoder") {
+            encoder_name = value;
+        } else if (name == "--encoder-options") {
+            encoder_options = value;
+        } else if (name == "--profile-interval") {
+            Profiler::set_report_interval(stod(value));
+        } else if (name == "--profile-json") {
+            profile_json_path = value;
+        } else if (name == "--profile-csv") {
+            profile_csv_path = value;
+        } else if (name == "--trace") {
+            Tracer::enable(value);
+        } else {
+            cerr << "Unknown option: " << arg << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!profile_json_path.empty() || !profile_csv_path.empty()) {
+        Profiler::write_stats_at_exit(profile_json_path, profile_csv_path);
+    }
+
+    if (!analyse_path.empty() && analysis_workers != 1) {
+        long num_frames = analyse_trajectory_parallel(
+            argv[1],
+            analyse_path,
+            GOPRO_H4B_WIDE43_MEASURED,
+            0.5,
+            analysis_scale,
+            analysis_workers
+        );
+        cerr << "Wrote the trajectory of " << num_frames << " frames to " << analyse_path << "\n";
+        return 0;
+    }
+
+    if (!render_path.empty()) {
+        if (trajectory_path.empty()) {
+            cerr << "--render requires a --trajectory\n";
+            return 1;
+        }
+        long num_frames = render_trajectory_parallel(
+            argv[1],
+            trajectory_path,
+            render_path,
+            GOPRO_H4B_WIDE43_MEASURED,
+            0.5,
+            false,
+            1.0,
+            30,
+            INTER_LINEAR,
+            warp_mode,
+            mesh_spacing,
+            encoder_name,
+            encoder_options,
+            render_workers
+        );
+        cerr << "Rendered " << num_frames << " frames to " << render_path << "\n";
+        return 0;
+    }
+
+    shared_ptr<FrameSource> ffmpeg_source;
+    if (decode == "sw") {
+        ffmpeg_source = create_sw_source(argv[1], decode_threads, read_ahead_frames);
+    } else {
+        if (!is_vaapi_and_opencl_supported()) {
+            cerr << "Error: FFmpeg was built without VAAPI or OpenCL support\n";
+            return 2;
+        }
+        ffmpeg_source = create_vaapi_source(argv[1], read_ahead_frames);
+    }
+    // After the VA-API source binds its OpenCL context
+    Tracer::enable_opencl_profiling();
+
+    if (!analyse_path.empty()) {
+        long num_frames = analyse_trajectory(
+            ffmpeg_source,
+            analyse_path,
+            GOPRO_H4B_WIDE43_MEASURED,
+            0.5,
+            analysis_scale
+        );
+        cerr << "Wrote the trajectory of " << num_frames << " frames to " << analyse_path << "\n";
+        return 0;
+    }
+
+    shared_ptr<FrameSource> warped_source;
+    if (!trajectory_path.empty()) {
+        warped_source = make_shared<FrameSourceProfile>(
+            make_unique<FrameSourceTrajectoryWarp>(
+                ffmpeg_source,
+                make_shared<Trajectory>(trajectory_path),
+                GOPRO_H4B_WIDE43_MEASURED,
+                0.5,
+                false,
+                1.0,
+                30,
+                INTER_LINEAR,
+                warp_mode,
+                mesh_spacing
+            ),
+            "opencv-warped"
+        );
+    } else {
+        warped_source = make_shared<FrameSourceProfile>(
+            make_unique<FrameSourceWarp>(
+                ffmpeg_source,
+                GOPRO_H4B_WIDE43_MEASURED,
+                0.5,
+                false,
+                1.0,
+                30,
+                INTER_LINEAR,
+                warp_mode,
+                mesh_spacing,
+                analysis_scale,
+                lookahead,
+                stabilise_mode,
+                motion_queue_frames
+            ),
+            "opencv-warped"
+        );
+    }
 
     UMat frame;
     while (true) {
         try {
-            cerr << "read frame\n";
             frame = warped_source->pull_frame();
             imshow("fast", frame);
             waitKey(1);
@@ -0,0 +1,230 @@
+#include "FeatureGrid.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+using namespace std;
+using namespace cv;
+
+// FAST threshold, and the lower threshold tried in cells where nothing passes it
+const int FAST_THRESHOLD = 20;
+const int FAST_MIN_THRESHOLD = 7;
+
+// FAST can't detect corners within 3 pixels of the edge of the image it's given
+const int FAST_BORDER = 3;
+
+// FAST's circle of 16 pixels of radius 3 around each candidate, as (x, y) offsets in order
+// around it, and the length of the arc which must be brighter or darker than the centre
+const int FAST_CIRCLE[16][2] = {
+    { 0, -3 }, { 1, -3 }, { 2, -2 }, { 3, -1 }, { 3, 0 }, { 3, 1 }, { 2, 2 }, { 1, 3 },
+    { 0, 3 }, { -1, 3 }, { -2, 2 }, { -3, 1 }, { -3, 0 }, { -3, -1 }, { -2, -2 }, { -1, -3 },
+};
+const int FAST_ARC = 9;
+
+FeatureGrid::FeatureGrid(
+    Size image_size,
+    double min_distance,
+    int columns,
+    int rows,
+    int corners_per_cell
+):
+    m_image_size(image_size),
+    m_columns(columns),
+    m_rows(rows),
+    m_corners_per_cell(corners_per_cell),
+    m_min_distance(min_distance),
+    m_cell_corners(columns * rows)
+{
+    // Detection images are at most full resolution, so their cells' regions are at most
+    // this size (allowing for rounding the cell to whole pixels)
+    Size largest_cell;
+    for (int cell = 0; cell < columns * rows; cell++) {
+        Rect cell_rect = get_cell_rect(cell);
+        largest_cell.width = max(largest_cell.width, cell_rect.width);
+        largest_cell.height = max(largest_cell.height, cell_rect.height);
+    }
+    reserve_detection(Size(
+        largest_cell.width + 2 * FAST_BORDER + 2,
+        largest_cell.height + 2 * FAST_BORDER + 2
+    ));
+    for (vector<Point2f> &cell_corners : m_cell_corners) {
+        cell_corners.reserve(corners_per_cell);
+    }
+    m_kept_corners.reserve(columns * rows * corners_per_cell);
+}
+
+void FeatureGrid::reserve_detection(Size size) {
+    m_scores.create(size, CV_32S);
+    // Non-maximum suppression leaves at most one corner in each 2x2 block
+    m_keypoints.reserve((size.width + 1) / 2 * ((size.height + 1) / 2));
+}
+
+void FeatureGrid::detect_corners(const Mat &image, int threshold) {
+    m_keypoints.clear();
+    if (image.cols > m_scores.cols || image.rows > m_scores.rows) {
+        reserve_detection(Size(max(image.cols, m_scores.cols), max(image.rows, m_scores.rows)));
+    }
+    Mat scores = m_scores(Rect(0, 0, image.cols, image.rows));
+    for (int y = 0; y < scores.rows; y++) {
+        memset(scores.ptr<int>(y), 0, scores.cols * sizeof(int));
+    }
+
+    int offsets[16];
+    for (int i = 0; i < 16; i++) {
+        offsets[i] = FAST_CIRCLE[i][1] * (int) image.step + FAST_CIRCLE[i][0];
+    }
+    for (int y = FAST_BORDER; y < image.rows - FAST_BORDER; y++) {
+        const uchar *row = image.ptr<uchar>(y);
+        int *score_row = scores.ptr<int>(y);
+        for (int x = FAST_BORDER; x < image.cols - FAST_BORDER; x++) {
+            const uchar *centre = row + x;
+            int value = centre[0];
+
+            // Any arc of 9 includes at least 2 of the 4 pixels at the compass points
+            int num_brighter = 0;
+            int num_darker = 0;
+            for (int i = 0; i < 16; i += 4) {
+                num_brighter += centre[offsets[i]] > value + threshold;
+                num_darker += centre[offsets[i]] < value - threshold;
+            }
+            if (num_brighter < 2 && num_darker < 2) {
+                continue;
+            }
+
+            // The score is the largest threshold which the best arc would pass
+            int differences[16];
+            for (int i = 0; i < 16; i++) {
+                differences[i] = centre[offsets[i]] - value;
+            }
+            int score = 0;
+            for (int start = 0; start < 16; start++) {
+                int brighter = INT_MAX;
+                int darker = INT_MAX;
+                for (int i = 0; i < FAST_ARC; i++) {
+                    int difference = differences[(start + i) & 15];
+                    brighter = min(brighter, difference);
+                    darker = min(darker, -difference);
+                }
+                score = max(score, max(brighter, darker));
+            }
+            if (score > threshold) {
+                score_row[x] = score;
+            }
+        }
+    }
+
+    // Keep corners with a higher score than all their neighbours
+    for (int y = FAST_BORDER; y < image.rows - FAST_BORDER; y++) {
+        const int *above = scores.ptr<int>(y - 1);
+        const int *score_row = scores.ptr<int>(y);
+        const int *below = scores.ptr<int>(y + 1);
+        for (int x = FAST_BORDER; x < image.cols - FAST_BORDER; x++) {
+            int score = score_row[x];
+            if (
+                score > 0 &&
+                score > score_row[x - 1] && score > score_row[x + 1] &&
+                score > above[x - 1] && score > above[x] && score > above[x + 1] &&
+                score > below[x - 1] && score > below[x] && score > below[x + 1]
+            ) {
+                m_keypoints.push_back(KeyPoint((float) x, (float) y, 7.f, -1, (float) score));
+            }
+        }
+    }
+}
+
+int FeatureGrid::get_cell(Point2f point) {
+    if (point.x < 0 || point.y < 0 || point.x >= m_image_size.width || point.y >= m_image_size.height) {
+        return -1;
+    }
+    int column = min((int) (point.x * m_columns / m_image_size.width), m_columns - 1);
+    int row = min((int) (point.y * m_rows / m_image_size.height), m_rows - 1);
+    return row * m_columns + column;
+}
+
+Rect FeatureGrid::get_cell_rect(int cell) {
+    int column = cell % m_columns;
+    int row = cell / m_columns;
+    int x = column * m_image_size.width / m_columns;
+    int y = row * m_image_size.height / m_rows;
+    return Rect(
+        x,
+        y,
+        (column + 1) * m_image_size.width / m_columns - x,
+        (row + 1) * m_image_size.height / m_rows - y
+    );
+}
+
+int FeatureGrid::get_max_corners() {
+    return m_columns * m_rows * m_corners_per_cell;
+}
+
+int FeatureGrid::replenish(const Mat &detection_image, float scale, vector<Point2f> &corners) {
+    // Keep the first corners in each cell, as they've been tracked the longest
+    for (vector<Point2f> &cell_corners : m_cell_corners) {
+        cell_corners.clear();
+    }
+    m_kept_corners.clear();
+    for (Point2f corner : corners) {
+        int cell = get_cell(corner);
+        if (cell == -1 || (int) m_cell_corners[cell].size() >= m_corners_per_cell) {
+            continue;
+        }
+        m_cell_corners[cell].push_back(corner);
+        m_kept_corners.push_back(corner);
+    }
+    corners.swap(m_kept_corners);
+
+    int num_detected_cells = 0;
+    Rect image_rect(Point(0, 0), detection_image.size());
+    double min_distance_squared = m_min_distance * m_min_distance;
+    for (int cell = 0; cell < m_columns * m_rows; cell++) {
+        vector<Point2f> &cell_corners = m_cell_corners[cell];
+        if ((int) cell_corners.size() >= m_corners_per_cell) {
+            continue;
+        }
+        num_detected_cells++;
+
+        Rect cell_rect = get_cell_rect(cell);
+        Rect detection_rect(
+            Point(cvFloor(cell_rect.x / scale), cvFloor(cell_rect.y / scale)),
+            Point(cvCeil(cell_rect.br().x / scale), cvCeil(cell_rect.br().y / scale))
+        );
+        Rect roi = Rect(
+            detection_rect.tl() - Point(FAST_BORDER, FAST_BORDER),
+            detection_rect.br() + Point(FAST_BORDER, FAST_BORDER)
+        ) & image_rect;
+        detect_corners(detection_image(roi), FAST_THRESHOLD);
+        if (m_keypoints.empty()) {
+            detect_corners(detection_image(roi), FAST_MIN_THRESHOLD);
+        }
+        sort(m_keypoints.begin(), m_keypoints.end(), [](const KeyPoint &a, const KeyPoint &b) {
+            return a.response > b.response;
+        });
+
+        // Non-maximum suppression within the cell: take the strongest corners, skipping
+        // any too close to a corner already in the cell
+        for (const KeyPoint &keypoint : m_keypoints) {
+            if ((int) cell_corners.size() >= m_corners_per_cell) {
+                break;
+            }
+            Point2f corner = (keypoint.pt + Point2f(roi.tl())) * scale;
+            if (get_cell(corner) != cell) {
+                continue;
+            }
+            bool is_isolated = true;
+            for (Point2f other : cell_corners) {
+                Point2f difference = corner - other;
+                if (difference.dot(difference) < min_distance_squared) {
+                    is_isolated = false;
+                    break;
+                }
+            }
+            if (is_isolated) {
+                cell_corners.push_back(corner);
+                corners.push_back(corner);
+            }
+        }
+    }
+    return num_detected_cells;
+}
@@ -0,0 +1,64 @@
+#ifndef _FEATURE_GRID_HPP_
+#define _FEATURE_GRID_HPP_
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+/**
+ * Keeps a set of tracked corners spread over the frame, by dividing it into a grid of
+ * cells and only detecting new corners in cells which have lost some
+ *
+ * New corners are found with the FAST detector in each depleted cell, and the strongest
+ * ones at least `min_distance` from the cell's other corners are added. This spreads
+ * the cost of detection over frames, rather than detecting corners over the whole frame
+ * every few frames, and keeps corners from bunching up in textured areas.
+ *
+ * The detector is FAST-9 with non-maximum suppression, like `cv::FAST`, but with its
+ * score buffer and keypoints sized for the largest cell up front, so that detection
+ * doesn't allocate.
+ */
+class FeatureGrid {
+    cv::Size m_image_size;
+    int m_columns;
+    int m_rows;
+    int m_corners_per_cell;
+    double m_min_distance;
+
+    // Reused between calls
+    std::vector<std::vector<cv::Point2f>> m_cell_corners;
+    std::vector<cv::KeyPoint> m_keypoints;
+    std::vector<cv::Point2f> m_kept_corners;
+    // FAST scores (CV_32S) of the cell being detected in, 0 for non-corners
+    cv::Mat m_scores;
+
+    int get_cell(cv::Point2f point);
+    cv::Rect get_cell_rect(int cell);
+    void reserve_detection(cv::Size size);
+    void detect_corners(const cv::Mat &image, int threshold);
+  public:
+    FeatureGrid(
+      // Size of the images corners are tracked in
+      cv::Size image_size,
+      // Smallest distance between corners in a cell, in image pixels
+      double min_distance = 30,
+      int columns = 8,
+      int rows = 6,
+      int corners_per_cell = 4
+    );
+
+    /**
+     * Drop corners outside the image or in cells with too many corners, then detect new
+     * corners in cells with too few. `detection_image` is the image at `1 / scale` of the
+     * full resolution, e.g. a pyramid level.
+     *
+     * Returns the number of cells corners were detected in.
+     */
+    int replenish(const cv::Mat &detection_image, float scale, std::vector<cv::Point2f> &corners);
+
+    /**
+     * The most corners `replenish` keeps
+     */
+    int get_max_corners();
+};
+
+#endif // _FEATURE_GRID_HPP_
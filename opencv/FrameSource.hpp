@@ -1,6 +1,8 @@
 #ifndef _FRAME_SOURCE_HPP_
 #define _FRAME_SOURCE_HPP_
 
+#include <cmath>
+
 #include <opencv2/core.hpp>
 
 /**
@@ -20,6 +22,14 @@ class FrameSource {
      */
     virtual cv::UMat peek_frame() = 0;
 
+    /**
+     * Presentation time in seconds of the frame last returned by `pull_frame`, or NaN
+     * if it isn't known
+     */
+    virtual double get_frame_time() {
+        return NAN;
+    }
+
     virtual ~FrameSource() = default;
 };
 
@@ -5,6 +5,7 @@
 #include <CL/opencl.hpp>
 
 #include "utils.hpp"
+#include "Tracer.hpp"
 
 using namespace cv;
 using namespace std;
@@ -61,6 +62,7 @@ int convert_ocl_images_to_nv12_umat(cl_mem cl_luma, cl_mem cl_chroma, UMat& dst)
     size_t src_origin[3] = { 0, 0, 0 };
     size_t luma_region[3] = { luma_w, luma_h, 1 };
     size_t chroma_region[3] = { chroma_w, chroma_h, 1 };
+    TraceDeviceSpan span("copy-image-to-buffer");
     ret = clEnqueueCopyImageToBuffer(
         queue,
         cl_luma,
@@ -114,13 +116,19 @@ UMat FrameSourceFfmpegOpenCl::peek_frame() {
         throw err;
     }
 
-    av_frame_free(&av_frame);
+    this->next_frame_time = get_av_frame_time(av_frame, this->source->get_time_base());
+    this->source->release_frame(av_frame);
     this->next_frame = frame;
     return this->next_frame;
 }
 
 UMat FrameSourceFfmpegOpenCl::pull_frame() {
     UMat frame = this->peek_frame();
+    this->frame_time = this->next_frame_time;
     this->next_frame = UMat();
     return frame;
 }
+
+double FrameSourceFfmpegOpenCl::get_frame_time() {
+    return this->frame_time;
+}
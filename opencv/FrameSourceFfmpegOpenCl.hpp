@@ -12,9 +12,12 @@
 class FrameSourceFfmpegOpenCl: public FrameSource {
     std::shared_ptr<AvFrameSource> source;
     cv::UMat next_frame;
+    double next_frame_time = NAN;
+    double frame_time = NAN;
   public:
     cv::UMat pull_frame();
     cv::UMat peek_frame();
+    double get_frame_time();
     FrameSourceFfmpegOpenCl(std::shared_ptr<AvFrameSource> source);
 };
 
@@ -0,0 +1,87 @@
+#include "FrameSourceFfmpegSw.hpp"
+
+#include <iostream>
+
+#include "utils.hpp"
+
+extern "C" {
+    #include <libavutil/pixdesc.h>
+}
+
+using namespace cv;
+using namespace std;
+
+int convert_sw_frame_to_nv12_umat(AVFrame *frame, UMat& dst) {
+    int width = frame->width;
+    int height = frame->height;
+    if (width % 2 || height % 2) {
+        cerr << "Odd frame dimensions are not supported: " << width << "x" << height << "\n";
+        return 1;
+    }
+
+    dst.create(height * 3 / 2, width, CV_8U);
+    {
+        // Write straight into the (mapped) destination to avoid an intermediate copy
+        Mat dst_mat = dst.getMat(ACCESS_WRITE);
+        Mat dst_luma = dst_mat(Rect(0, 0, width, height));
+        Mat dst_chroma(height / 2, width / 2, CV_8UC2, dst_mat.ptr(height), dst_mat.step);
+
+        Mat(height, width, CV_8U, frame->data[0], frame->linesize[0]).copyTo(dst_luma);
+
+        switch (frame->format) {
+            case AV_PIX_FMT_NV12:
+                Mat(height / 2, width / 2, CV_8UC2, frame->data[1], frame->linesize[1])
+                    .copyTo(dst_chroma);
+                break;
+            case AV_PIX_FMT_YUV420P:
+            case AV_PIX_FMT_YUVJ420P: {
+                Mat chroma_planes[] = {
+                    Mat(height / 2, width / 2, CV_8U, frame->data[1], frame->linesize[1]),
+                    Mat(height / 2, width / 2, CV_8U, frame->data[2], frame->linesize[2]),
+                };
+                merge(chroma_planes, 2, dst_chroma);
+                break;
+            }
+            default:
+                cerr << "Unsupported software pixel format: " <<
+                    av_get_pix_fmt_name((AVPixelFormat) frame->format) << "\n";
+                return 1;
+        }
+    }
+    return 0;
+}
+
+FrameSourceFfmpegSw::FrameSourceFfmpegSw(std::shared_ptr<AvFrameSource> source) {
+    this->source = source;
+}
+
+UMat FrameSourceFfmpegSw::peek_frame() {
+    if (!this->next_frame.empty()) {
+        return this->next_frame;
+    }
+    int err;
+    AVFrame *av_frame = this->source->pull_frame();
+    UMat frame;
+
+    err = convert_sw_frame_to_nv12_umat(av_frame, frame);
+    this->next_frame_time = get_av_frame_time(av_frame, this->source->get_time_base());
+    this->source->release_frame(av_frame);
+    if (err) {
+        cerr << "Failed to upload software AVFrame to opencv\n";
+        throw err;
+    }
+
+    this->next_frame = frame;
+    return this->next_frame;
+}
+
+UMat FrameSourceFfmpegSw::pull_frame() {
+    UMat frame = this->peek_frame();
+    this->frame_time = this->next_frame_time;
+    this->next_frame = UMat();
+    return frame;
+}
+
+double FrameSourceFfmpegSw::get_frame_time() {
+    return this->frame_time;
+}
@@ -0,0 +1,27 @@
+#ifndef _FRAME_SOURCE_FFMPEG_SW_HPP_
+#define _FRAME_SOURCE_FFMPEG_SW_HPP_
+
+#include <memory>
+
+#include "FrameSource.hpp"
+#include "AvFrameSource.hpp"
+
+/**
+ * Uploads software (system memory) `AVFrame`s into NV12 `cv::UMat`s
+ *
+ * The UMat lives on whatever device OpenCV's default OpenCL context uses (e.g. a CPU
+ * ICD such as PoCL), or in host memory if OpenCL is unavailable.
+ */
+class FrameSourceFfmpegSw: public FrameSource {
+    std::shared_ptr<AvFrameSource> source;
+    cv::UMat next_frame;
+    double next_frame_time = NAN;
+    double frame_time = NAN;
+  public:
+    cv::UMat pull_frame();
+    cv::UMat peek_frame();
+    double get_frame_time();
+    FrameSourceFfmpegSw(std::shared_ptr<AvFrameSource> source);
+};
+
+#endif // _FRAME_SOURCE_FFMPEG_SW_HPP_
@@ -6,7 +6,7 @@ using namespace cv;
 using namespace std;
 
 FrameSourceProfile::FrameSourceProfile(shared_ptr<FrameSource> source, string name):
-    m_source(source), m_profiler(Profiler(name)) {}
+    m_source(source), m_profiler(name) {}
 
 UMat FrameSourceProfile::peek_frame() {
     return m_source->peek_frame();
@@ -18,3 +18,7 @@ UMat FrameSourceProfile::pull_frame() {
     m_profiler.after_exit();
     return result;
 }
+
+double FrameSourceProfile::get_frame_time() {
+    return m_source->get_frame_time();
+}
@@ -10,6 +10,9 @@
 
 #include "Profiler.hpp"
 
+/**
+ * Records the time taken by each `pull_frame()` of a source, see `Profiler`
+ */
 class FrameSourceProfile: public FrameSource {
     std::shared_ptr<FrameSource> m_source;
     Profiler m_profiler;
@@ -17,6 +20,7 @@ class FrameSourceProfile: public FrameSource {
     FrameSourceProfile(std::shared_ptr<FrameSource> source, std::string name);
     cv::UMat pull_frame();
     cv::UMat peek_frame();
+    double get_frame_time();
 };
 
 #endif // _FRAME_SOURCE_PROFILE_HPP_
\ No newline at end of file
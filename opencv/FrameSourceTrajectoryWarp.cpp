@@ -0,0 +1,59 @@
+#include "FrameSourceTrajectoryWarp.hpp"
+
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+using namespace cv;
+
+FrameSourceTrajectoryWarp::FrameSourceTrajectoryWarp(
+    shared_ptr<FrameSource> source,
+    shared_ptr<Trajectory> trajectory,
+    CameraPreset input_camera,
+    double scale,
+    bool crop_borders,
+    double zoom,
+    int smooth_radius,
+    InterpolationFlags interpolation,
+    WarpMode warp_mode,
+    int mesh_spacing
+):
+    m_source(source)
+{
+    UMat first_frame = m_source->peek_frame();
+    Size frame_size(first_frame.cols, first_frame.rows * 2 / 3);
+    if (frame_size != trajectory->get_frame_size()) {
+        cerr << "Trajectory was measured on " << trajectory->get_frame_size() <<
+            " frames, but the input is " << frame_size << "\n";
+        throw -1;
+    }
+    Camera camera = get_preset_camera(input_camera, frame_size);
+    m_warper = make_shared<FrameWarper>(
+        camera,
+        get_output_camera(camera, scale, crop_borders, zoom),
+        interpolation,
+        warp_mode,
+        mesh_spacing
+    );
+    m_warp_rotations = get_warp_rotations(*trajectory, smooth_radius);
+}
+
+UMat FrameSourceTrajectoryWarp::pull_frame() {
+    if (m_frame_index == 0) {
+        m_source->pull_frame();
+        m_frame_index++;
+    }
+    if (m_frame_index >= m_warp_rotations.size()) {
+        throw EOF;
+    }
+    UMat frame = m_source->pull_frame();
+    return m_warper->warp(frame, m_warp_rotations[m_frame_index++]);
+}
+
+UMat FrameSourceTrajectoryWarp::peek_frame() {
+    return pull_frame();
+}
+
+double FrameSourceTrajectoryWarp::get_frame_time() {
+    return m_source->get_frame_time();
+}
@@ -0,0 +1,47 @@
+#ifndef _FRAME_SOURCE_TRAJECTORY_WARP_HPP_
+#define _FRAME_SOURCE_TRAJECTORY_WARP_HPP_
+
+#include <memory>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "Camera.hpp"
+#include "FrameSource.hpp"
+#include "FrameWarper.hpp"
+#include "Trajectory.hpp"
+
+/**
+ * Stabilises frames with a trajectory measured beforehand (see `analyse_trajectory`),
+ * so frames are warped as soon as they're read, without a lookahead buffer
+ *
+ * The output is the same as `FrameSourceWarp`'s with the same settings, including
+ * skipping the first input frame.
+ */
+class FrameSourceTrajectoryWarp: public FrameSource {
+    std::shared_ptr<FrameSource> m_source;
+    std::shared_ptr<FrameWarper> m_warper;
+
+    // Rotation of the output camera for each input frame
+    std::vector<cv::Matx33d> m_warp_rotations;
+    size_t m_frame_index = 0;
+  public:
+    FrameSourceTrajectoryWarp(
+      std::shared_ptr<FrameSource> source,
+      std::shared_ptr<Trajectory> trajectory,
+      CameraPreset input_camera,
+      double scale = 1,
+      bool crop_borders = false,
+      double zoom = 1,
+      int smooth_radius = 30,
+      cv::InterpolationFlags interpolation = cv::INTER_LINEAR,
+      WarpMode warp_mode = WARP_MODE_MAPS,
+      // Mesh spacing in output pixels, or 0 to choose one within 0.1 pixels of error
+      int mesh_spacing = 0
+    );
+    cv::UMat pull_frame();
+    cv::UMat peek_frame();
+    double get_frame_time();
+};
+
+#endif // _FRAME_SOURCE_TRAJECTORY_WARP_HPP_
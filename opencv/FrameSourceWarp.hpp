@@ -3,34 +3,28 @@
 
 #include <deque>
 #include <memory>
-#include <queue>
+#include <string>
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/core/ocl.hpp>
-#include <gram_savitzky_golay/spatial_filters.h>
 
+#include "Camera.hpp"
 #include "FrameSource.hpp"
-
-enum CameraPreset {
-    GOPRO_H4B_WIDE43_PUBLISHED,
-    GOPRO_H4B_WIDE43_MEASURED,
-    GOPRO_H4B_WIDE43_MEASURED_STABILISATION,
-    GOPRO_H4B_WIDE169_PUBLISHED,
-    GOPRO_H4B_WIDE169_MEASURED,
-    GOPRO_H4B_WIDE169_MEASURED_STABILISATION
-};
-
-enum CameraModel {
-  RECTILINEAR,
-  FISHEYE
-};
-
-class Camera {
-  public:
-    CameraModel model;
-    cv::Matx33d matrix;
-    cv::Mat distortion_coefficients;
-    cv::Size size;
+#include "FrameWarper.hpp"
+#include "KalmanStabiliser.hpp"
+#include "MotionEstimator.hpp"
+#include "MotionEstimatorThread.hpp"
+#include "RotationSmoother.hpp"
+#include "SpscRing.hpp"
+#include "TieredFrameStore.hpp"
+
+enum StabiliseMode {
+  // Savitzky-Golay smoothing centred on each frame, which needs `smooth_radius` frames
+  // of lookahead
+  STABILISE_MODE_SMOOTH,
+  // Causal Kalman filter smoothing, so each frame is output as soon as its motion is
+  // measured, with no lookahead buffer (e.g. for live streams)
+  STABILISE_MODE_KALMAN
 };
 
 /**
@@ -39,46 +33,28 @@ class Camera {
  */
 class FrameSourceWarp: public FrameSource {
     std::shared_ptr<FrameSource> m_source;
-
-    // Properties of the input camera
-    Camera m_input_camera;
-
-    // Optimized pixel mapping table from output camera to input camera
-    cv::UMat m_map_x;
-    cv::UMat m_map_y;
-    cv::ocl::Kernel m_remap_kernel;
-
-    // Properties of the output camera
-    Camera m_output_camera;
-
-    // Current frame index
-    long m_frame_index = 0;
-
-    // The last input frame
-    cv::UMat m_last_input_frame;
-    cv::Mat m_measured_rotation;
-    std::vector<cv::Point2f> m_last_input_frame_corners;
+    // Only used from this thread if there's no motion estimation thread
+    std::shared_ptr<MotionEstimator> m_motion_estimator;
+    std::shared_ptr<MotionEstimatorThread> m_motion_thread;
+    long m_num_measured_frames = 0;
+    cv::Matx33d m_last_orientation;
+    cv::Matx33d m_frame_orientation;
+    std::shared_ptr<FrameWarper> m_warper;
 
     // Settings
     unsigned int m_smooth_radius;
-    cv::InterpolationFlags m_interpolation;
+    StabiliseMode m_stabilise_mode;
 
     // Stabilization lookahead buffer
-    gram_sg::RotationFilter m_rotation_filter;
-    std::queue<cv::UMat> m_buffered_frames;
-    std::queue<cv::Mat> m_buffered_rotations;
-    cv::Mat m_last_frame_rotation;
+    RotationSmoother m_rotation_filter;
+    TieredFrameStore m_buffered_frames; // NV12
+    SpscRing<cv::Matx33d> m_buffered_rotations;
 
-    // The last input frame for which corners were detected from scratch
-    long m_last_key_frame_index = -1;
+    KalmanStabiliser m_kalman_stabiliser;
 
-    void consume_frame(cv::UMat input_frame);
-    cv::UMat warp_frame(cv::UMat input, cv::Mat rotation);
-    int guess_camera_rotation(
-      std::vector<cv::Point2f> points_prev,
-      std::vector<cv::Point2f> points_current,
-      cv::OutputArray rotation
-    );
+    MeasuredFrame measure_frame();
+    void consume_frame(MeasuredFrame measured);
+    cv::UMat pull_frame_kalman();
   public:
     FrameSourceWarp(
       std::shared_ptr<FrameSource> source,
@@ -87,10 +63,34 @@ class FrameSourceWarp: public FrameSource {
       bool crop_borders = false,
       double zoom = 1,
       int smooth_radius = 30,
-      cv::InterpolationFlags interpolation = cv::INTER_LINEAR
+      cv::InterpolationFlags interpolation = cv::INTER_LINEAR,
+      WarpMode warp_mode = WARP_MODE_MAPS,
+      // Mesh spacing in output pixels, or 0 to choose one within 0.1 pixels of error
+      int mesh_spacing = 0,
+      // Resolution of the luma plane used for motion estimation, relative to the input
+      double analysis_scale = 1,
+      // Where buffered frames are kept, by default all in device memory
+      TieredFrameStoreConfig lookahead = TieredFrameStoreConfig(),
+      // With STABILISE_MODE_KALMAN, smooth_radius and lookahead are unused
+      StabiliseMode stabilise_mode = STABILISE_MODE_SMOOTH,
+      // Measure motion on another thread, up to this many frames ahead of warping, or
+      // on the calling thread if 0
+      int motion_queue_frames = 4
     );
     cv::UMat pull_frame();
     cv::UMat peek_frame();
+
+    /**
+     * Largest amount of memory held by buffered (NV12) frames so far, in all tiers
+     */
+    size_t get_peak_lookahead_bytes();
+
+    /**
+     * The measured camera orientation of the frame last returned by `pull_frame`,
+     * relative to the first input frame (which is only used as the reference, so the
+     * first output frame is the second input frame)
+     */
+    cv::Matx33d get_frame_orientation();
 };
 
 #endif // _FRAME_SOURCE_WARP_HPP_
@@ -0,0 +1,348 @@
+#include "FrameWarper.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <cerrno>
+#include <cstring>
+
+#include <CL/opencl.hpp>
+
+#include <opencv2/calib3d.hpp>
+
+#include "CpuWarper.hpp"
+#include "Tracer.hpp"
+
+using namespace std;
+using namespace cv;
+
+string read_string_from_file(string file_name) {
+    ifstream kernel_stream(file_name, ios::in | ios::binary);
+    if (kernel_stream.fail()) {
+        cerr << "Failed to open file \"" << file_name << "\": " << strerror(errno) << endl;
+        throw(errno);
+    }
+    return string((istreambuf_iterator<char>(kernel_stream)), istreambuf_iterator<char>());
+}
+
+bool parse_warp_mode(const string &name, WarpMode &warp_mode) {
+    if (name == "maps") {
+        warp_mode = WARP_MODE_MAPS;
+    } else if (name == "maps-fixed") {
+        warp_mode = WARP_MODE_MAPS_FIXED;
+    } else if (name == "fused") {
+        warp_mode = WARP_MODE_FUSED;
+    } else if (name == "mesh") {
+        warp_mode = WARP_MODE_MESH;
+    } else if (name == "cpu") {
+        warp_mode = WARP_MODE_CPU;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool select_opencl_and_warp_mode(bool use_opencl, string &warp, WarpMode &warp_mode) {
+    ocl::setUseOpenCL(use_opencl && ocl::haveOpenCL());
+    if (warp.empty()) {
+        warp = ocl::useOpenCL() ? "maps" : "cpu";
+    } else if (warp != "cpu" && !ocl::useOpenCL()) {
+        cerr << "--warp=" << warp << " needs OpenCL, which isn't available\n";
+        return false;
+    }
+    return parse_warp_mode(warp, warp_mode);
+}
+
+ocl::Program read_opencl_program_from_file(string file_name, string program_opts) {
+    ocl::ProgramSource program_source(read_string_from_file(file_name));
+    ocl::Context context = ocl::Context::getDefault(false);
+    string err;
+    ocl::Program program = context.getProg(program_source, program_opts, err);
+    if (!err.empty()) {
+        cerr << "Failed to read OpenCL program from file " << file_name <<
+            " with opts \"" << program_opts << "\":\n" << err << endl;
+        throw err;
+    }
+    return program;
+}
+
+FrameWarper::FrameWarper(
+    Camera input_camera,
+    Camera output_camera,
+    InterpolationFlags interpolation,
+    WarpMode warp_mode,
+    int mesh_spacing
+):
+    m_input_camera(input_camera),
+    m_output_camera(output_camera),
+    m_interpolation(interpolation),
+    m_warp_mode(warp_mode),
+    m_mesh_spacing(mesh_spacing)
+{
+    if (m_warp_mode == WARP_MODE_CPU) {
+        // Don't touch OpenCL at all, it may not be available
+        m_cpu_warper = make_shared<CpuWarper>(m_input_camera, m_output_camera, m_interpolation);
+        return;
+    }
+
+    bool samples_nv12 = m_warp_mode == WARP_MODE_FUSED || m_warp_mode == WARP_MODE_MESH;
+    if (samples_nv12 && m_interpolation != INTER_LINEAR && m_interpolation != INTER_NEAREST) {
+        cerr << "Fused warp only supports linear or nearest interpolation, using linear\n";
+        m_interpolation = INTER_LINEAR;
+    }
+
+    ocl::Program program = read_opencl_program_from_file(
+        "createMap.cl",
+        m_interpolation == INTER_NEAREST ? "-D NEAREST" : ""
+    );
+    if (m_warp_mode == WARP_MODE_FUSED) {
+        m_fused_warp_kernel = ocl::Kernel("warpNv12", program);
+    } else if (m_warp_mode == WARP_MODE_MESH) {
+        if (m_mesh_spacing <= 0) {
+            m_mesh_spacing = choose_mesh_spacing(m_input_camera, m_output_camera, 0.1);
+        }
+        cerr << "Mesh warp with " << m_mesh_spacing << "px spacing, maximum error " <<
+            measure_mesh_error(m_input_camera, m_output_camera, m_mesh_spacing) << "px\n";
+        m_mesh = UMat(
+            (m_output_camera.size.height - 1 + m_mesh_spacing - 1) / m_mesh_spacing + 1,
+            (m_output_camera.size.width - 1 + m_mesh_spacing - 1) / m_mesh_spacing + 1,
+            CV_32FC2
+        );
+        m_mesh_kernel = ocl::Kernel("createMesh", program);
+        m_fused_warp_kernel = ocl::Kernel("warpNv12Mesh", program);
+    } else if (m_warp_mode == WARP_MODE_MAPS_FIXED) {
+        m_map_x = UMat(m_output_camera.size, CV_16SC2);
+        m_map_y = UMat(m_output_camera.size, CV_16UC1);
+        m_remap_kernel = ocl::Kernel("createMapFixed", program);
+    } else {
+        m_map_x = UMat(m_output_camera.size, CV_32F);
+        m_map_y = UMat(m_output_camera.size, CV_32F);
+        m_remap_kernel = ocl::Kernel("createMap", program);
+    }
+}
+
+/**
+ * Set the camera and rotation arguments shared by all of the projection kernels in
+ * createMap.cl, starting at argument `index`. Returns the index of the next argument.
+ */
+int set_projection_args(
+    ocl::Kernel &kernel,
+    int index,
+    const Camera &input_camera,
+    const Camera &output_camera,
+    const Matx33d &rotation
+) {
+    float values[] = {
+        (float) input_camera.matrix(0, 2),
+        (float) input_camera.matrix(1, 2),
+        (float) input_camera.matrix(0, 0),
+        (float) input_camera.matrix(1, 1),
+        (float) output_camera.matrix(0, 2),
+        (float) output_camera.matrix(1, 2),
+        (float) output_camera.matrix(0, 0),
+        (float) output_camera.matrix(1, 1),
+    };
+    for (float value : values) {
+        index = kernel.set(index, (cl_float) value);
+    }
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            index = kernel.set(index, (cl_float) rotation(i, j));
+        }
+    }
+    return index;
+}
+
+Point2d find_source_coordinates(
+    const Camera &input_camera,
+    const Camera &output_camera,
+    const Matx33d &rotation,
+    Point2d output_point
+) {
+    // Same as find_source_coordinates in createMap.cl, but in double precision
+    Vec3d vector_identity(
+        (output_point.x - output_camera.matrix(0, 2)) / output_camera.matrix(0, 0),
+        (output_point.y - output_camera.matrix(1, 2)) / output_camera.matrix(1, 1),
+        1
+    );
+    Vec3d vector_rotated = rotation * vector_identity;
+    Point2d coordinates_rotated(
+        vector_rotated[0] / vector_rotated[2],
+        vector_rotated[1] / vector_rotated[2]
+    );
+    double radius_identity = sqrt(coordinates_rotated.dot(coordinates_rotated));
+    double fisheye_correction = radius_identity == 0 ? 1 : atan(radius_identity) / radius_identity;
+    return Point2d(
+        input_camera.matrix(0, 2) + coordinates_rotated.x * fisheye_correction * input_camera.matrix(0, 0),
+        input_camera.matrix(1, 2) + coordinates_rotated.y * fisheye_correction * input_camera.matrix(1, 1)
+    );
+}
+
+static double measure_mesh_error(
+    const Camera &input_camera,
+    const Camera &output_camera,
+    int spacing,
+    const Matx33d &rotation
+) {
+    // Bilinear interpolation error peaks inside cells, so check a 3x3 lattice of
+    // points within each cell against the exact projection
+    double max_error = 0;
+    int width = output_camera.size.width;
+    int height = output_camera.size.height;
+    for (int cell_y = 0; cell_y < height - 1; cell_y += spacing) {
+        for (int cell_x = 0; cell_x < width - 1; cell_x += spacing) {
+            Point2d n00 = find_source_coordinates(input_camera, output_camera, rotation,
+                Point2d(cell_x, cell_y));
+            Point2d n01 = find_source_coordinates(input_camera, output_camera, rotation,
+                Point2d(cell_x + spacing, cell_y));
+            Point2d n10 = find_source_coordinates(input_camera, output_camera, rotation,
+                Point2d(cell_x, cell_y + spacing));
+            Point2d n11 = find_source_coordinates(input_camera, output_camera, rotation,
+                Point2d(cell_x + spacing, cell_y + spacing));
+            for (int i = 1; i < 4; i++) {
+                for (int j = 1; j < 4; j++) {
+                    double wx = j / 4., wy = i / 4.;
+                    Point2d interpolated =
+                        (n00 * (1 - wx) + n01 * wx) * (1 - wy) +
+                        (n10 * (1 - wx) + n11 * wx) * wy;
+                    Point2d exact = find_source_coordinates(input_camera, output_camera, rotation,
+                        Point2d(cell_x + wx * spacing, cell_y + wy * spacing));
+                    max_error = max(max_error, norm(interpolated - exact));
+                }
+            }
+        }
+    }
+    return max_error;
+}
+
+double measure_mesh_error(const Camera &input_camera, const Camera &output_camera, int spacing) {
+    // Corrections are small rotations, which push the output towards the strongly
+    // distorted edges of the input, so check those as well as the identity
+    double max_error = 0;
+    double angle = 5 * CV_PI / 180;
+    vector<Vec3d> rotation_vectors = {
+        Vec3d(0, 0, 0),
+        Vec3d(angle, 0, 0),
+        Vec3d(0, angle, 0),
+        Vec3d(0, 0, angle),
+        Vec3d(angle, angle, angle),
+    };
+    for (Vec3d rotation_vector : rotation_vectors) {
+        Matx33d rotation;
+        Rodrigues(rotation_vector, rotation);
+        max_error = max(
+            max_error,
+            measure_mesh_error(input_camera, output_camera, spacing, rotation)
+        );
+    }
+    return max_error;
+}
+
+int choose_mesh_spacing(const Camera &input_camera, const Camera &output_camera, double max_error) {
+    for (int spacing = 64; spacing > 1; spacing /= 2) {
+        if (measure_mesh_error(input_camera, output_camera, spacing) <= max_error) {
+            return spacing;
+        }
+    }
+    return 1;
+}
+
+void create_maps(
+    ocl::Kernel &kernel,
+    const Camera &input_camera,
+    const Camera &output_camera,
+    const Matx33d &rotation,
+    UMat &map1,
+    UMat &map2
+) {
+    size_t global_size[2] = { (size_t) map1.cols, (size_t) map1.rows };
+    int arg_index = kernel.set(0, ocl::KernelArg::WriteOnly(map1));
+    arg_index = kernel.set(arg_index, ocl::KernelArg::WriteOnlyNoSize(map2));
+    set_projection_args(kernel, arg_index, input_camera, output_camera, rotation);
+    if (!kernel.run(2, global_size, NULL, true)) {
+        std::cerr << "executing kernel failed" << std::endl;
+        throw -1;
+    }
+}
+
+UMat FrameWarper::warp_frame_maps(UMat input_nv12_frame, const Matx33d &rotation) {
+    UMat output_camera_frame;
+
+    {
+        TraceDeviceSpan span("create-map");
+        create_maps(m_remap_kernel, m_input_camera, m_output_camera, rotation, m_map_x, m_map_y);
+    }
+
+    // Only one BGR frame exists at a time, however long the lookahead
+    {
+        TraceDeviceSpan span("nv12-to-bgr");
+        cvtColor(input_nv12_frame, m_input_bgr_frame, COLOR_YUV2BGR_NV12);
+    }
+    TraceDeviceSpan span("remap");
+    remap(
+        m_input_bgr_frame,
+        output_camera_frame,
+        m_map_x,
+        // Fixed point maps with nearest interpolation only use the integer part
+        m_warp_mode == WARP_MODE_MAPS_FIXED && m_interpolation == INTER_NEAREST ? UMat() : m_map_y,
+        m_interpolation
+    );
+    return output_camera_frame;
+}
+
+UMat FrameWarper::warp_frame_fused(UMat input_nv12_frame, const Matx33d &rotation) {
+    UMat output_camera_frame(m_output_camera.size, CV_8UC3);
+    size_t global_size[2] = {
+        (size_t) output_camera_frame.cols,
+        (size_t) output_camera_frame.rows
+    };
+    int arg_index;
+
+    if (m_warp_mode == WARP_MODE_MESH) {
+        // Evaluate the exact projection on the coarse mesh only
+        size_t mesh_size[2] = { (size_t) m_mesh.cols, (size_t) m_mesh.rows };
+        TraceDeviceSpan span("create-mesh");
+        arg_index = m_mesh_kernel.set(0, ocl::KernelArg::WriteOnly(m_mesh));
+        arg_index = m_mesh_kernel.set(arg_index, (cl_int) m_mesh_spacing);
+        set_projection_args(m_mesh_kernel, arg_index, m_input_camera, m_output_camera, rotation);
+        if (!m_mesh_kernel.run(2, mesh_size, NULL, false)) {
+            std::cerr << "executing mesh kernel failed" << std::endl;
+            throw -1;
+        }
+
+        arg_index = m_fused_warp_kernel.set(0, ocl::KernelArg::ReadOnly(input_nv12_frame));
+        arg_index = m_fused_warp_kernel.set(arg_index, ocl::KernelArg::WriteOnly(output_camera_frame));
+        arg_index = m_fused_warp_kernel.set(arg_index, ocl::KernelArg::ReadOnly(m_mesh));
+        m_fused_warp_kernel.set(arg_index, (cl_int) m_mesh_spacing);
+    } else {
+        arg_index = m_fused_warp_kernel.set(0, ocl::KernelArg::ReadOnly(input_nv12_frame));
+        arg_index = m_fused_warp_kernel.set(arg_index, ocl::KernelArg::WriteOnly(output_camera_frame));
+        set_projection_args(m_fused_warp_kernel, arg_index, m_input_camera, m_output_camera, rotation);
+    }
+
+    TraceDeviceSpan span("warp-fused");
+    if (!m_fused_warp_kernel.run(2, global_size, NULL, false)) {
+        std::cerr << "executing fused warp kernel failed" << std::endl;
+        throw -1;
+    }
+    return output_camera_frame;
+}
+
+UMat FrameWarper::warp_frame_cpu(UMat input_nv12_frame, const Matx33d &rotation) {
+    UMat output_camera_frame(m_output_camera.size, CV_8UC3);
+    {
+        Mat input = input_nv12_frame.getMat(ACCESS_READ);
+        Mat output = output_camera_frame.getMat(ACCESS_WRITE);
+        m_cpu_warper->warp(input, output, rotation);
+    }
+    return output_camera_frame;
+}
+
+UMat FrameWarper::warp(UMat input_nv12_frame, const Matx33d &rotation) {
+    if (m_warp_mode == WARP_MODE_CPU) {
+        return warp_frame_cpu(input_nv12_frame, rotation);
+    }
+    if (m_warp_mode == WARP_MODE_FUSED || m_warp_mode == WARP_MODE_MESH) {
+        return warp_frame_fused(input_nv12_frame, rotation);
+    }
+    return warp_frame_maps(input_nv12_frame, rotation);
+}
@@ -0,0 +1,125 @@
+#ifndef _FRAME_WARPER_HPP_
+#define _FRAME_WARPER_HPP_
+
+#include <memory>
+#include <string>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core/ocl.hpp>
+
+#include "Camera.hpp"
+
+class CpuWarper;
+
+enum WarpMode {
+  // Generate float pixel maps with the createMap kernel, then convert to BGR and remap
+  WARP_MODE_MAPS,
+  // Like WARP_MODE_MAPS, but with OpenCV's packed fixed point maps (6 bytes per pixel
+  // rather than 8), which also lets remap use its fixed point path
+  WARP_MODE_MAPS_FIXED,
+  // Sample the NV12 input and write BGR output in a single kernel, without maps
+  WARP_MODE_FUSED,
+  // Like WARP_MODE_FUSED, but only evaluate the projection on a coarse mesh and
+  // interpolate between mesh nodes
+  WARP_MODE_MESH,
+  // Sample NV12 directly with a vectorised, multithreaded CPU kernel (no OpenCL needed)
+  WARP_MODE_CPU
+};
+
+/**
+ * The warp mode for a `--warp` option value: maps, maps-fixed, fused, mesh or cpu.
+ * Returns false if `name` isn't one of them.
+ */
+bool parse_warp_mode(const std::string &name, WarpMode &warp_mode);
+
+/**
+ * Use OpenCL if `use_opencl` and it's available, then choose the warp mode named `warp`,
+ * or if it's empty, maps with OpenCL and cpu without (and set `warp` to its name).
+ * Returns false, having printed why, if the mode needs OpenCL and it's not in use.
+ */
+bool select_opencl_and_warp_mode(bool use_opencl, std::string &warp, WarpMode &warp_mode);
+
+cv::ocl::Program read_opencl_program_from_file(std::string file_name, std::string program_opts);
+
+/**
+ * Fill remap tables for a rotation, using the createMap (`map1`/`map2` are CV_32F x/y
+ * maps) or createMapFixed (`map1` is CV_16SC2, `map2` is CV_16UC1) kernel from createMap.cl
+ */
+void create_maps(
+  cv::ocl::Kernel &kernel,
+  const Camera &input_camera,
+  const Camera &output_camera,
+  const cv::Matx33d &rotation,
+  cv::UMat &map1,
+  cv::UMat &map2
+);
+
+/**
+ * Find the location in the input camera which maps to a point in the output camera,
+ * for a given rotation of the output camera (as in createMap.cl)
+ */
+cv::Point2d find_source_coordinates(
+  const Camera &input_camera,
+  const Camera &output_camera,
+  const cv::Matx33d &rotation,
+  cv::Point2d output_point
+);
+
+/**
+ * Find the largest distance (in input pixels) between the exact projection and its
+ * bilinear interpolation from a mesh with the given spacing, over a range of rotations
+ */
+double measure_mesh_error(const Camera &input_camera, const Camera &output_camera, int spacing);
+
+/**
+ * Find the largest power of two mesh spacing with error within `max_error` input pixels
+ */
+int choose_mesh_spacing(const Camera &input_camera, const Camera &output_camera, double max_error);
+
+/**
+ * Reprojects NV12 frames from the input camera into BGR frames from the output camera,
+ * for a given rotation of the output camera
+ */
+class FrameWarper {
+    Camera m_input_camera;
+    Camera m_output_camera;
+
+    // Settings
+    cv::InterpolationFlags m_interpolation;
+    WarpMode m_warp_mode;
+    int m_mesh_spacing;
+
+    // Optimized pixel mapping table from output camera to input camera (x and y, or
+    // packed xy and interpolation table indices for WARP_MODE_MAPS_FIXED)
+    cv::UMat m_map_x;
+    cv::UMat m_map_y;
+    cv::ocl::Kernel m_remap_kernel;
+    cv::ocl::Kernel m_fused_warp_kernel;
+
+    // Coarse mesh of source locations for WARP_MODE_MESH
+    cv::UMat m_mesh;
+    cv::ocl::Kernel m_mesh_kernel;
+
+    // Native warp for WARP_MODE_CPU
+    std::shared_ptr<CpuWarper> m_cpu_warper;
+
+    // BGR conversion of the frame being warped, for the map based warps
+    cv::UMat m_input_bgr_frame;
+
+    cv::UMat warp_frame_maps(cv::UMat input_nv12, const cv::Matx33d &rotation);
+    cv::UMat warp_frame_fused(cv::UMat input_nv12, const cv::Matx33d &rotation);
+    cv::UMat warp_frame_cpu(cv::UMat input_nv12, const cv::Matx33d &rotation);
+  public:
+    FrameWarper(
+      Camera input_camera,
+      Camera output_camera,
+      cv::InterpolationFlags interpolation = cv::INTER_LINEAR,
+      WarpMode warp_mode = WARP_MODE_MAPS,
+      // Mesh spacing in output pixels, or 0 to choose one within 0.1 pixels of error
+      int mesh_spacing = 0
+    );
+
+    cv::UMat warp(cv::UMat input_nv12, const cv::Matx33d &rotation);
+};
+
+#endif // _FRAME_WARPER_HPP_
@@ -0,0 +1,78 @@
+#include "KalmanStabiliser.hpp"
+
+#include <Eigen/Geometry>
+
+#include "MotionEstimator.hpp"
+
+using namespace std;
+using namespace cv;
+
+typedef Matx<double, 6, 6> Matx66d;
+typedef Matx<double, 6, 3> Matx63d;
+
+/**
+ * Rotation vector of a rotation matrix, like `cv::Rodrigues` but without allocating
+ */
+static Vec3d rotation_vector_from_matrix(const Matx33d &rotation) {
+    Eigen::AngleAxisd angle_axis(eigen_mat_from_matx(rotation));
+    Eigen::Vector3d rotation_vector = angle_axis.angle() * angle_axis.axis();
+    return Vec3d(rotation_vector(0), rotation_vector(1), rotation_vector(2));
+}
+
+/**
+ * Rotation matrix of a rotation vector, like `cv::Rodrigues` but without allocating
+ */
+static Matx33d matrix_from_rotation_vector(const Vec3d &rotation_vector) {
+    double angle = cv::norm(rotation_vector);
+    if (angle == 0) {
+        return Matx33d::eye();
+    }
+    Eigen::Vector3d axis(rotation_vector[0], rotation_vector[1], rotation_vector[2]);
+    return matx_from_eigen_mat(Eigen::AngleAxisd(angle, axis / angle).toRotationMatrix());
+}
+
+KalmanStabiliser::KalmanStabiliser(double process_noise, double measurement_noise):
+    m_process_noise(process_noise),
+    m_measurement_noise(measurement_noise),
+    m_covariance(Matx66d::eye()),
+    m_orientation(Matx33d::eye())
+{
+}
+
+Matx33d KalmanStabiliser::add(const Matx33d &measured) {
+    if (!m_initialised) {
+        // Start at rest at the first orientation
+        m_orientation = measured;
+        m_initialised = true;
+        return m_orientation;
+    }
+
+    // Predict: the rotation advances by the angular velocity
+    Matx66d transition = Matx66d::eye();
+    for (int i = 0; i < 3; i++) {
+        transition(i, i + 3) = 1;
+    }
+    m_state = transition * m_state;
+    m_covariance = transition * m_covariance * transition.t() + m_process_noise * Matx66d::eye();
+
+    // Measure the rotation from the last smoothed orientation, which is small while the
+    // filter keeps up with the camera. Only the rotation is measured, so the measurement
+    // matrix just selects the first 3 rows/columns.
+    Vec3d measured_rotation = rotation_vector_from_matrix(measured * m_orientation.t());
+    Matx63d covariance_measured = m_covariance.get_minor<6, 3>(0, 0);
+    Matx33d innovation_covariance = covariance_measured.get_minor<3, 3>(0, 0) +
+        m_measurement_noise * Matx33d::eye();
+    Matx63d gain = covariance_measured * innovation_covariance.inv();
+    Vec3d innovation = measured_rotation - Vec3d(m_state[0], m_state[1], m_state[2]);
+    m_state += gain * innovation;
+    m_covariance -= gain * covariance_measured.t();
+
+    Vec3d rotation(m_state[0], m_state[1], m_state[2]);
+    m_orientation = matrix_from_rotation_vector(rotation) * m_orientation;
+
+    // The next rotation is relative to the new smoothed orientation
+    for (int i = 0; i < 3; i++) {
+        m_state[i] = 0;
+    }
+    return m_orientation;
+}
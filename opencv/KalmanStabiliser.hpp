@@ -0,0 +1,40 @@
+#ifndef _KALMAN_STABILISER_HPP_
+#define _KALMAN_STABILISER_HPP_
+
+#include <opencv2/core.hpp>
+
+/**
+ * Smooths camera orientations causally, with a constant angular velocity Kalman filter,
+ * so each frame can be stabilised as soon as its orientation is measured
+ *
+ * The state is the rotation vector of the smoothed orientation relative to the previous
+ * smoothed orientation, and the angular velocity (both per frame, on each axis). After
+ * each update the rotation is folded into the smoothed orientation, so the filter only
+ * sees small angles and never wraps around. Unlike `RotationSmoother` this lags behind
+ * intentional camera motion, but needs no lookahead.
+ *
+ * The filter is the same as a `cv::KalmanFilter` with 6 states and 3 measurements, but
+ * with fixed size matrices, so that adding an orientation never allocates.
+ */
+class KalmanStabiliser {
+    double m_process_noise;
+    double m_measurement_noise;
+    // (rotation, angular velocity) and its error covariance
+    cv::Vec<double, 6> m_state;
+    cv::Matx<double, 6, 6> m_covariance;
+    cv::Matx33d m_orientation;
+    bool m_initialised = false;
+  public:
+    /**
+     * Lower `process_noise` relative to `measurement_noise` gives smoother output which
+     * lags further behind the camera
+     */
+    KalmanStabiliser(double process_noise = 1e-5, double measurement_noise = 1e-1);
+
+    /**
+     * Add the next measured orientation, returning the smoothed orientation
+     */
+    cv::Matx33d add(const cv::Matx33d &measured_orientation);
+};
+
+#endif // _KALMAN_STABILISER_HPP_
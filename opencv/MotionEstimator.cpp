@@ -0,0 +1,175 @@
+#include "MotionEstimator.hpp"
+
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "Tracer.hpp"
+
+using namespace std;
+using namespace cv;
+
+double get_inlier_threshold(const Camera &input_camera, double output_scale) {
+    // The output focal length only depends on the scale, not on cropping or zoom
+    Camera output_camera = get_output_camera(input_camera, output_scale, false, 1);
+    return 8.0 / output_camera.matrix(0, 0);
+}
+
+// Optical flow parameters, which must be the same for building pyramids and tracking
+const Size OPTICAL_FLOW_WINDOW(21, 21);
+const int OPTICAL_FLOW_MAX_LEVEL = 3;
+
+// Detect corners on a reduced resolution pyramid level (0 is full resolution)
+const int CORNER_DETECTION_LEVEL = 1;
+
+MotionEstimator::MotionEstimator(
+    Camera input_camera,
+    double analysis_scale,
+    double inlier_threshold
+):
+    m_input_camera(input_camera),
+    m_analysis_camera(resize_camera(input_camera, Size(
+        cvRound(input_camera.size.width * analysis_scale),
+        cvRound(input_camera.size.height * analysis_scale)
+    ))),
+    m_last_input_pyramid(m_analysis_camera.size, OPTICAL_FLOW_MAX_LEVEL, OPTICAL_FLOW_WINDOW),
+    m_input_pyramid(m_analysis_camera.size, OPTICAL_FLOW_MAX_LEVEL, OPTICAL_FLOW_WINDOW),
+    m_tracker(OPTICAL_FLOW_WINDOW),
+    m_measured_rotation(Matx33d::eye()),
+    m_last_frame_rotation(Matx33d::eye()),
+    m_feature_grid(m_analysis_camera.size, 30. * analysis_scale)
+{
+    m_rotation_estimator.set_threshold(inlier_threshold);
+
+    // Sized for the most corners up front, so that frames don't allocate
+    size_t max_corners = m_feature_grid.get_max_corners();
+    for (vector<Point2f> *points : {
+        &m_last_input_frame_corners,
+        &m_tracked_corners,
+        &m_prev_points,
+        &m_current_points,
+        &m_prev_corners_identity,
+        &m_corners_identity
+    }) {
+        points->reserve(max_corners);
+    }
+    m_tracked_status.reserve(max_corners);
+}
+
+void MotionEstimator::replenish_corners(const OpticalFlowPyramid &pyramid) {
+    int level = min(CORNER_DETECTION_LEVEL, (int) pyramid.images.size() - 1);
+    m_feature_grid.replenish(pyramid.images[level], 1 << level, m_last_input_frame_corners);
+}
+
+void MotionEstimator::track_corners() {
+    // Given a set of points in the previous frame, calculate optical flow to the current frame
+    m_tracker.track(
+        m_last_input_pyramid,
+        m_input_pyramid,
+        m_last_input_frame_corners,
+        m_tracked_corners,
+        m_tracked_status
+    );
+
+    // Keep the point pairs for which optical flow was found
+    m_prev_points.clear();
+    m_current_points.clear();
+    for (size_t i = 0; i < m_tracked_status.size(); i++) {
+        if (m_tracked_status[i]) {
+            m_prev_points.push_back(m_last_input_frame_corners[i]);
+            m_current_points.push_back(m_tracked_corners[i]);
+        }
+    }
+}
+
+Eigen::Matrix3d eigen_mat_from_matx(const Matx33d &matx) {
+    // Matx is row major
+    return Eigen::Map<const Eigen::Matrix<double, 3, 3, Eigen::RowMajor>>(matx.val);
+}
+
+Matx33d matx_from_eigen_mat(const Eigen::Matrix3d &eigen_mat) {
+    Matx33d matx;
+    Eigen::Map<Eigen::Matrix<double, 3, 3, Eigen::RowMajor>>(matx.val) = eigen_mat;
+    return matx;
+}
+
+int MotionEstimator::guess_camera_rotation(Matx33d &rotation) {
+    // Normalised image coordinates, i.e. bearings with z = 1
+    undistort_points(m_analysis_camera, m_prev_points, m_prev_corners_identity);
+    undistort_points(m_analysis_camera, m_current_points, m_corners_identity);
+
+    m_rotation_estimator.resize(m_prev_corners_identity.size());
+    for (size_t i = 0; i < m_prev_corners_identity.size(); ++i) {
+        m_rotation_estimator.set_point(
+            i,
+            Eigen::Vector3f(m_prev_corners_identity[i].x, m_prev_corners_identity[i].y, 1),
+            Eigen::Vector3f(m_corners_identity[i].x, m_corners_identity[i].y, 1)
+        );
+    }
+
+    Eigen::Matrix3d estimated_rotation;
+    int num_inliers = m_rotation_estimator.estimate(estimated_rotation);
+    rotation = matx_from_eigen_mat(estimated_rotation);
+    return num_inliers;
+}
+
+Matx33d MotionEstimator::add_frame(UMat input_frame) {
+    // The luma plane of the NV12 frame
+    UMat frame_gray(input_frame, Rect(0, 0, input_frame.cols, input_frame.rows * 2 / 3));
+
+    // Motion is estimated on a (possibly) reduced resolution copy of the luma, which is
+    // resized on the device with OpenCL, or by the pyramid otherwise
+    UMat analysis_frame = frame_gray;
+    if (m_analysis_camera.size != m_input_camera.size && ocl::useOpenCL()) {
+        TraceDeviceSpan span("analysis-resize");
+        resize(frame_gray, m_analysis_frame, m_analysis_camera.size, 0, 0, INTER_AREA);
+        analysis_frame = m_analysis_frame;
+    }
+    {
+        // Unmapped before the frame is used again
+        Mat analysis_image = analysis_frame.getMat(ACCESS_READ);
+        m_input_pyramid.build(analysis_image);
+    }
+
+    if (m_frame_index == 0) {
+        replenish_corners(m_input_pyramid);
+    } else {
+        /**
+         * Corners are followed with optical flow for as long as they can be. Before each
+         * frame, areas of the last frame which have lost their corners get new ones.
+         */
+        replenish_corners(m_last_input_pyramid);
+
+        // Use optical flow to see where the corners moved since the last frame
+        track_corners();
+
+        // Calculate the camera rotation since the last frame with RANSAC
+        Matx33d rotation_since_last_frame;
+        m_last_num_inliers = guess_camera_rotation(rotation_since_last_frame);
+        if (m_last_num_inliers < 40) {
+            // Assume the camera kept moving like in the last frame (if any)
+            m_last_num_inliers = 0;
+            rotation_since_last_frame = m_last_frame_rotation;
+        }
+        m_last_frame_rotation = rotation_since_last_frame;
+        m_measured_rotation = rotation_since_last_frame * m_measured_rotation;
+        m_last_input_frame_corners.swap(m_current_points);
+    }
+
+    // This frame's pyramid becomes the previous frame's, and the old one is overwritten
+    // by the next frame's
+    swap(m_last_input_pyramid, m_input_pyramid);
+    ++m_frame_index;
+    return m_measured_rotation;
+}
+
+Matx33d MotionEstimator::get_measured_rotation() {
+    return m_measured_rotation;
+}
+
+long MotionEstimator::get_num_frames() {
+    return m_frame_index;
+}
+
+int MotionEstimator::get_last_num_inliers() {
+    return m_last_num_inliers;
+}
@@ -0,0 +1,93 @@
+#ifndef _MOTION_ESTIMATOR_HPP_
+#define _MOTION_ESTIMATOR_HPP_
+
+#include <vector>
+#include <opencv2/core.hpp>
+#include <Eigen/Core>
+
+#include "Camera.hpp"
+#include "FeatureGrid.hpp"
+#include "OpticalFlow.hpp"
+#include "RotationEstimator.hpp"
+
+Eigen::Matrix3d eigen_mat_from_matx(const cv::Matx33d &matx);
+
+cv::Matx33d matx_from_eigen_mat(const Eigen::Matrix3d &eigen_mat);
+
+/**
+ * Inlier threshold for a video rendered at `output_scale` (see `get_output_camera`),
+ * accepting corners within 8 output pixels of a rotation's prediction
+ */
+double get_inlier_threshold(const Camera &input_camera, double output_scale);
+
+/**
+ * Measures the rotation of the camera through a sequence of frames, by following
+ * corners with optical flow and fitting a rotation to their motion between frames
+ */
+class MotionEstimator {
+    // Properties of the input camera
+    Camera m_input_camera;
+
+    // The input camera, resized to the resolution used for motion estimation
+    Camera m_analysis_camera;
+
+    // Current frame index
+    long m_frame_index = 0;
+
+    // Optical flow pyramids of the last and current input frames' luma
+    OpticalFlowPyramid m_last_input_pyramid;
+    OpticalFlowPyramid m_input_pyramid;
+    OpticalFlowTracker m_tracker;
+    cv::UMat m_analysis_frame;
+
+    cv::Matx33d m_measured_rotation;
+    cv::Matx33d m_last_frame_rotation;
+    std::vector<cv::Point2f> m_last_input_frame_corners;
+    FeatureGrid m_feature_grid;
+    RotationEstimator m_rotation_estimator;
+    int m_last_num_inliers = 0;
+
+    // Per frame buffers, reused so that frames don't allocate once they've grown. Corners
+    // tracked from the last frame to the current frame are kept as two arrays of
+    // matching points.
+    std::vector<cv::Point2f> m_tracked_corners;
+    std::vector<uchar> m_tracked_status;
+    std::vector<cv::Point2f> m_prev_points;
+    std::vector<cv::Point2f> m_current_points;
+    std::vector<cv::Point2f> m_prev_corners_identity;
+    std::vector<cv::Point2f> m_corners_identity;
+
+    void replenish_corners(const OpticalFlowPyramid &pyramid);
+    void track_corners();
+    int guess_camera_rotation(cv::Matx33d &rotation);
+  public:
+    MotionEstimator(
+      Camera input_camera,
+      // Resolution of the luma plane used for motion estimation, relative to the input
+      double analysis_scale = 1,
+      // Largest angle (in radians) between a corner's predicted and tracked positions
+      // for it to count towards a rotation
+      double inlier_threshold = 0.01
+    );
+
+    /**
+     * Measure the camera orientation of the next (NV12) frame, relative to the first
+     * frame, which is the identity
+     */
+    cv::Matx33d add_frame(cv::UMat input_frame);
+
+    cv::Matx33d get_measured_rotation();
+
+    /**
+     * Number of frames added so far
+     */
+    long get_num_frames();
+
+    /**
+     * Number of corners consistent with the last frame's rotation, or 0 if it could
+     * not be measured and the previous frame's motion was assumed to continue
+     */
+    int get_last_num_inliers();
+};
+
+#endif // _MOTION_ESTIMATOR_HPP_
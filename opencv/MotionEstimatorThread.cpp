@@ -0,0 +1,77 @@
+#include "MotionEstimatorThread.hpp"
+
+#include <opencv2/core/ocl.hpp>
+
+#include "OpenClSync.hpp"
+#include "Tracer.hpp"
+
+using namespace std;
+using namespace cv;
+
+MotionEstimatorThread::MotionEstimatorThread(
+    shared_ptr<FrameSource> source,
+    shared_ptr<MotionEstimator> motion_estimator,
+    size_t capacity
+):
+    m_source(source),
+    m_motion_estimator(motion_estimator),
+    m_opencl_context(
+        ocl::useOpenCL() ? ocl::OpenCLExecutionContext::getCurrent() : ocl::OpenCLExecutionContext()
+    ),
+    m_queue(capacity)
+{
+    m_thread = thread(&MotionEstimatorThread::run, this);
+}
+
+MotionEstimatorThread::~MotionEstimatorThread() {
+    m_queue.close();
+    m_thread.join();
+
+    PendingFrame pending;
+    while (m_queue.try_pop(pending)) {
+        if (pending.ready != NULL) {
+            clReleaseEvent(pending.ready);
+        }
+    }
+
+    m_queue.print_stats("motion-estimation");
+}
+
+void MotionEstimatorThread::run() {
+    // Work on the same OpenCL context as the consumer, or frames (and interop images)
+    // would be used across contexts, but on another queue
+    if (!m_opencl_context.empty()) {
+        m_opencl_context.cloneWithNewQueue().bind();
+    }
+    Tracer::enable_opencl_profiling();
+    while (!m_queue.is_closed()) {
+        PendingFrame pending;
+        try {
+            pending.measured.frame = m_source->pull_frame();
+            pending.measured.orientation = m_motion_estimator->add_frame(pending.measured.frame);
+            if (!m_opencl_context.empty()) {
+                pending.ready = enqueue_marker();
+            }
+        } catch (...) {
+            m_queue.end(current_exception());
+            return;
+        }
+
+        if (!m_queue.push(pending)) {
+            if (pending.ready != NULL) {
+                clReleaseEvent(pending.ready);
+            }
+            return;
+        }
+    }
+}
+
+MeasuredFrame MotionEstimatorThread::pull_frame() {
+    PendingFrame pending = m_queue.pop();
+    if (pending.ready != NULL) {
+        // Work queued on the frame from here on runs after the thread's work on it
+        enqueue_wait(pending.ready);
+        clReleaseEvent(pending.ready);
+    }
+    return pending.measured;
+}
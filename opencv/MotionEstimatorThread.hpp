@@ -0,0 +1,65 @@
+#ifndef _MOTION_ESTIMATOR_THREAD_HPP_
+#define _MOTION_ESTIMATOR_THREAD_HPP_
+
+#include <memory>
+#include <thread>
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+#include <CL/cl.h>
+
+#include "FrameSource.hpp"
+#include "BlockingSpscQueue.hpp"
+#include "MotionEstimator.hpp"
+
+/**
+ * An input frame (NV12) and its measured camera orientation
+ */
+class MeasuredFrame {
+  public:
+    cv::UMat frame;
+    cv::Matx33d orientation;
+};
+
+/**
+ * Pulls frames from a `FrameSource` and measures their motion on a dedicated thread, so
+ * that motion estimation (mostly CPU work) overlaps with warping (mostly device work)
+ * on the consumer's thread
+ *
+ * Measured frames are passed through a `BlockingSpscQueue`, so the thread blocks when
+ * the consumer falls `capacity` frames behind. Exceptions thrown by the source or the
+ * motion estimation (including `EOF`) are rethrown to the consumer once the frames
+ * before them are used. The motion estimator must not be used by other threads.
+ *
+ * OpenCV's OpenCL context is per thread, so the thread binds the context that was
+ * current when it was created (e.g. the VA-API interop context), and frames stay in it.
+ * The thread queues its work on a queue of its own, and each frame carries a marker
+ * which the consumer's queue waits for before using it, so neither thread waits for
+ * the other's queue to drain.
+ */
+class MotionEstimatorThread {
+    std::shared_ptr<FrameSource> m_source;
+    std::shared_ptr<MotionEstimator> m_motion_estimator;
+    // The creating thread's OpenCL context, empty without OpenCL
+    cv::ocl::OpenCLExecutionContext m_opencl_context;
+
+    class PendingFrame {
+      public:
+        MeasuredFrame measured;
+        // Completes when the thread's work on the frame does, NULL without OpenCL
+        cl_event ready = NULL;
+    };
+    BlockingSpscQueue<PendingFrame> m_queue;
+    std::thread m_thread;
+
+    void run();
+  public:
+    MotionEstimatorThread(
+      std::shared_ptr<FrameSource> source,
+      std::shared_ptr<MotionEstimator> motion_estimator,
+      size_t capacity = 4
+    );
+    MeasuredFrame pull_frame();
+    ~MotionEstimatorThread();
+};
+
+#endif // _MOTION_ESTIMATOR_THREAD_HPP_
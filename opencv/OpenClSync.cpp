@@ -0,0 +1,35 @@
+#include "OpenClSync.hpp"
+
+#include <iostream>
+
+#include <opencv2/core/ocl.hpp>
+
+using namespace std;
+using namespace cv;
+
+cl_event enqueue_marker() {
+    cl_command_queue queue = (cl_command_queue) ocl::Queue::getDefault().ptr();
+    cl_event marker;
+    int err = clEnqueueMarkerWithWaitList(queue, 0, NULL, &marker);
+    if (err != CL_SUCCESS) {
+        cerr << "Failed to enqueue OpenCL marker: " << err << "\n";
+        throw err;
+    }
+    // Another queue may wait for the marker, which never completes unless submitted
+    err = clFlush(queue);
+    if (err != CL_SUCCESS) {
+        clReleaseEvent(marker);
+        cerr << "Failed to flush OpenCL queue: " << err << "\n";
+        throw err;
+    }
+    return marker;
+}
+
+void enqueue_wait(cl_event event) {
+    cl_command_queue queue = (cl_command_queue) ocl::Queue::getDefault().ptr();
+    int err = clEnqueueBarrierWithWaitList(queue, 1, &event, NULL);
+    if (err != CL_SUCCESS) {
+        cerr << "Failed to enqueue OpenCL barrier: " << err << "\n";
+        throw err;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef _OPENCL_SYNC_HPP_
+#define _OPENCL_SYNC_HPP_
+
+#include <CL/cl.h>
+
+/**
+ * Ordering between OpenCL queues of the same context, for work handed from one thread
+ * to another without waiting for either thread's whole queue to finish
+ */
+
+/**
+ * Enqueue a marker after all the work queued so far on the calling thread's OpenCL
+ * queue, and submit it to the device. Returns the marker's event, which the caller
+ * releases.
+ */
+cl_event enqueue_marker();
+
+/**
+ * Make work queued next on the calling thread's OpenCL queue wait for `event`, without
+ * blocking the calling thread
+ */
+void enqueue_wait(cl_event event);
+
+#endif // _OPENCL_SYNC_HPP_
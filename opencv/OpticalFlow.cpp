@@ -0,0 +1,360 @@
+#include "OpticalFlow.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Index `i` of a row or column of `n` pixels mirrored at the edges, without repeating
+ * the edge pixel (`cv::BORDER_REFLECT_101`)
+ */
+static inline int reflect_101(int i, int n) {
+    if (n == 1) {
+        return 0;
+    }
+    while (i < 0 || i >= n) {
+        i = i < 0 ? -i : 2 * n - 2 - i;
+    }
+    return i;
+}
+
+OpticalFlowPyramid::OpticalFlowPyramid(Size size, int max_level, Size window) {
+    // Levels are only useful while they're larger than the window
+    for (int level = 0; level <= max_level; level++) {
+        if (level > 0 && (size.width <= window.width || size.height <= window.height)) {
+            break;
+        }
+        images.push_back(Mat(size, CV_8U));
+        derivatives.push_back(Mat(size, CV_16SC2));
+        size = Size((size.width + 1) / 2, (size.height + 1) / 2);
+    }
+    // Two rows of the largest level, with a 2 pixel border on each side
+    m_filter_rows.resize(2 * (images[0].cols + 4));
+}
+
+void OpticalFlowPyramid::build_area_taps(Size input_size) {
+    m_input_size = input_size;
+    Size output_size = images[0].size();
+
+    // Each output pixel averages the input pixels it covers, weighted by how much of
+    // each it covers
+    auto build_taps = [](int input_length, int output_length, vector<AreaTap> &taps, vector<int> &first_tap) {
+        double scale = 1. * input_length / output_length;
+        taps.clear();
+        first_tap.resize(output_length + 1);
+        for (int i = 0; i < output_length; i++) {
+            first_tap[i] = taps.size();
+            double start = i * scale;
+            double end = min(start + scale, (double) input_length);
+            for (int source = (int) floor(start); source < end; source++) {
+                double covered = min(end, source + 1.) - max(start, (double) source);
+                if (covered > 1e-3) {
+                    taps.push_back(AreaTap { source, (float) (covered / scale) });
+                }
+            }
+        }
+        first_tap[output_length] = taps.size();
+    };
+    build_taps(input_size.width, output_size.width, m_column_taps, m_first_column_tap);
+    build_taps(input_size.height, output_size.height, m_row_taps, m_first_row_tap);
+    m_resampled_row.resize(output_size.width);
+    m_row_sums.resize(output_size.width);
+}
+
+void OpticalFlowPyramid::resize_area(const Mat &input, Mat &output) {
+    if (input.size() != m_input_size) {
+        build_area_taps(input.size());
+    }
+    for (int y = 0; y < output.rows; y++) {
+        fill(m_row_sums.begin(), m_row_sums.end(), 0.f);
+        for (int row_tap = m_first_row_tap[y]; row_tap < m_first_row_tap[y + 1]; row_tap++) {
+            const uchar *input_row = input.ptr<uchar>(m_row_taps[row_tap].source);
+            float row_weight = m_row_taps[row_tap].weight;
+            for (int x = 0; x < output.cols; x++) {
+                float sum = 0;
+                for (int tap = m_first_column_tap[x]; tap < m_first_column_tap[x + 1]; tap++) {
+                    sum += input_row[m_column_taps[tap].source] * m_column_taps[tap].weight;
+                }
+                m_row_sums[x] += sum * row_weight;
+            }
+        }
+        uchar *output_row = output.ptr<uchar>(y);
+        for (int x = 0; x < output.cols; x++) {
+            output_row[x] = saturate_cast<uchar>(m_row_sums[x]);
+        }
+    }
+}
+
+void OpticalFlowPyramid::pyramid_down(const Mat &input, Mat &output) {
+    // The [1 4 6 4 1] / 16 kernel, separably: vertically into the row buffer, then
+    // horizontally at every other column
+    int *row = m_filter_rows.data() + 2;
+    for (int y = 0; y < output.rows; y++) {
+        const uchar *rows[5];
+        for (int i = 0; i < 5; i++) {
+            rows[i] = input.ptr<uchar>(reflect_101(2 * y - 2 + i, input.rows));
+        }
+        for (int x = 0; x < input.cols; x++) {
+            row[x] = rows[0][x] + 4 * (rows[1][x] + rows[3][x]) + 6 * rows[2][x] + rows[4][x];
+        }
+        for (int i = 1; i <= 2; i++) {
+            row[-i] = row[reflect_101(-i, input.cols)];
+            row[input.cols - 1 + i] = row[reflect_101(input.cols - 1 + i, input.cols)];
+        }
+
+        uchar *output_row = output.ptr<uchar>(y);
+        for (int x = 0; x < output.cols; x++) {
+            const int *centre = row + 2 * x;
+            int sum = centre[-2] + 4 * (centre[-1] + centre[1]) + 6 * centre[0] + centre[2];
+            output_row[x] = (uchar) ((sum + 128) >> 8);
+        }
+    }
+}
+
+void OpticalFlowPyramid::scharr_derivatives(const Mat &image, Mat &derivatives) {
+    // The [3 10 3] smoothing and [-1 0 1] difference, vertically into the row buffers,
+    // then horizontally
+    int *smoothed = m_filter_rows.data() + 1;
+    int *differences = smoothed + image.cols + 4;
+    for (int y = 0; y < image.rows; y++) {
+        const uchar *above = image.ptr<uchar>(reflect_101(y - 1, image.rows));
+        const uchar *centre = image.ptr<uchar>(y);
+        const uchar *below = image.ptr<uchar>(reflect_101(y + 1, image.rows));
+        for (int x = 0; x < image.cols; x++) {
+            smoothed[x] = 3 * (above[x] + below[x]) + 10 * centre[x];
+            differences[x] = below[x] - above[x];
+        }
+        smoothed[-1] = smoothed[reflect_101(-1, image.cols)];
+        differences[-1] = differences[reflect_101(-1, image.cols)];
+        smoothed[image.cols] = smoothed[reflect_101(image.cols, image.cols)];
+        differences[image.cols] = differences[reflect_101(image.cols, image.cols)];
+
+        short *output_row = derivatives.ptr<short>(y);
+        for (int x = 0; x < image.cols; x++) {
+            output_row[2 * x] = (short) (smoothed[x + 1] - smoothed[x - 1]);
+            output_row[2 * x + 1] = (short) (3 * (differences[x - 1] + differences[x + 1]) + 10 * differences[x]);
+        }
+    }
+}
+
+void OpticalFlowPyramid::build(const Mat &image) {
+    if (image.size() == images[0].size()) {
+        image.copyTo(images[0]);
+    } else {
+        resize_area(image, images[0]);
+    }
+    for (size_t level = 1; level < images.size(); level++) {
+        pyramid_down(images[level - 1], images[level]);
+    }
+    for (size_t level = 0; level < images.size(); level++) {
+        scharr_derivatives(images[level], derivatives[level]);
+    }
+}
+
+// Criteria matching calcOpticalFlowPyrLK, whose sums of squared gradients are 1024 times
+// smaller than these (its gradients are 32 times larger, and its sums are scaled by 2^-20)
+const float GRADIENT_SUM_SCALE = 1.f / 1024;
+const float MIN_EIGEN_THRESHOLD = 1e-4;
+
+// Scharr derivatives are 32 times the gradient
+const float DERIVATIVE_SCALE = 1.f / 32;
+
+OpticalFlowTracker::OpticalFlowTracker(Size window, int max_iterations, double epsilon):
+    m_window(window),
+    m_max_iterations(max_iterations),
+    m_epsilon(epsilon),
+    m_window_image(window.area()),
+    m_window_dx(window.area()),
+    m_window_dy(window.area())
+{
+}
+
+/**
+ * Whether the 2x2 neighbourhoods of the window at `top_left` are all inside `size`
+ */
+static inline bool is_window_inside(Point top_left, Size window, Size size) {
+    return top_left.x >= 0 && top_left.y >= 0 &&
+        top_left.x + window.width < size.width && top_left.y + window.height < size.height;
+}
+
+/**
+ * Bilinear interpolation of an image at the pixel `(x, y)` plus the fraction given by
+ * the weights, with the image extended by repeating its edge pixels
+ */
+static inline float interpolate_image(const Mat &image, int x, int y, const float weights[4], bool inside) {
+    if (inside) {
+        const uchar *row = image.ptr<uchar>(y);
+        const uchar *next_row = row + image.step;
+        return row[x] * weights[0] + row[x + 1] * weights[1] +
+            next_row[x] * weights[2] + next_row[x + 1] * weights[3];
+    }
+    int x0 = min(max(x, 0), image.cols - 1);
+    int x1 = min(max(x + 1, 0), image.cols - 1);
+    const uchar *row = image.ptr<uchar>(min(max(y, 0), image.rows - 1));
+    const uchar *next_row = image.ptr<uchar>(min(max(y + 1, 0), image.rows - 1));
+    return row[x0] * weights[0] + row[x1] * weights[1] +
+        next_row[x0] * weights[2] + next_row[x1] * weights[3];
+}
+
+/**
+ * Bilinear interpolation of the derivatives at the pixel `(x, y)` plus the fraction given
+ * by the weights, which are zero outside the image
+ */
+static inline void interpolate_derivatives(
+    const Mat &derivatives,
+    int x,
+    int y,
+    const float weights[4],
+    bool inside,
+    float &dx,
+    float &dy
+) {
+    dx = 0;
+    dy = 0;
+    for (int i = 0; i < 4; i++) {
+        int sample_x = x + (i & 1);
+        int sample_y = y + (i >> 1);
+        if (!inside && (sample_x < 0 || sample_y < 0 || sample_x >= derivatives.cols || sample_y >= derivatives.rows)) {
+            continue;
+        }
+        const short *sample = derivatives.ptr<short>(sample_y) + 2 * sample_x;
+        dx += sample[0] * weights[i];
+        dy += sample[1] * weights[i];
+    }
+}
+
+static inline void get_bilinear_weights(Point2f point, Point &pixel, float weights[4]) {
+    pixel = Point(cvFloor(point.x), cvFloor(point.y));
+    float a = point.x - pixel.x;
+    float b = point.y - pixel.y;
+    weights[0] = (1 - a) * (1 - b);
+    weights[1] = a * (1 - b);
+    weights[2] = (1 - a) * b;
+    weights[3] = a * b;
+}
+
+bool OpticalFlowTracker::track_point(
+    const Mat &previous_image,
+    const Mat &previous_derivatives,
+    const Mat &current_image,
+    int level,
+    Point2f previous_point,
+    Point2f &current_point
+) {
+    Point2f half_window((m_window.width - 1) * 0.5f, (m_window.height - 1) * 0.5f);
+    Point pixel;
+    float weights[4];
+    get_bilinear_weights(previous_point - half_window, pixel, weights);
+    if (
+        pixel.x < -m_window.width || pixel.x >= previous_image.cols ||
+        pixel.y < -m_window.height || pixel.y >= previous_image.rows
+    ) {
+        return level > 0;
+    }
+
+    // The previous image's window and its gradient matrix
+    bool inside = is_window_inside(pixel, m_window, previous_image.size());
+    float a11 = 0, a12 = 0, a22 = 0;
+    for (int y = 0, i = 0; y < m_window.height; y++) {
+        for (int x = 0; x < m_window.width; x++, i++) {
+            float dx, dy;
+            m_window_image[i] = interpolate_image(previous_image, pixel.x + x, pixel.y + y, weights, inside);
+            interpolate_derivatives(previous_derivatives, pixel.x + x, pixel.y + y, weights, inside, dx, dy);
+            dx *= DERIVATIVE_SCALE;
+            dy *= DERIVATIVE_SCALE;
+            m_window_dx[i] = dx;
+            m_window_dy[i] = dy;
+            a11 += dx * dx;
+            a12 += dx * dy;
+            a22 += dy * dy;
+        }
+    }
+    float determinant = a11 * a22 - a12 * a12;
+    float min_eigenvalue = (a22 + a11 - sqrt((a11 - a22) * (a11 - a22) + 4 * a12 * a12)) /
+        (2 * m_window.area());
+    if (
+        min_eigenvalue * GRADIENT_SUM_SCALE < MIN_EIGEN_THRESHOLD ||
+        determinant * GRADIENT_SUM_SCALE * GRADIENT_SUM_SCALE < FLT_EPSILON
+    ) {
+        // Too little texture to track, but a coarser level can still pass on its guess
+        return level > 0;
+    }
+
+    Point2f point = current_point - half_window;
+    Point2f last_step;
+    for (int iteration = 0; iteration < m_max_iterations; iteration++) {
+        get_bilinear_weights(point, pixel, weights);
+        if (
+            pixel.x < -m_window.width || pixel.x >= current_image.cols ||
+            pixel.y < -m_window.height || pixel.y >= current_image.rows
+        ) {
+            return level > 0;
+        }
+
+        inside = is_window_inside(pixel, m_window, current_image.size());
+        float b1 = 0, b2 = 0;
+        for (int y = 0, i = 0; y < m_window.height; y++) {
+            for (int x = 0; x < m_window.width; x++, i++) {
+                float difference = interpolate_image(current_image, pixel.x + x, pixel.y + y, weights, inside) -
+                    m_window_image[i];
+                b1 += difference * m_window_dx[i];
+                b2 += difference * m_window_dy[i];
+            }
+        }
+
+        Point2f step((a12 * b2 - a22 * b1) / determinant, (a12 * b1 - a11 * b2) / determinant);
+        point += step;
+        current_point = point + half_window;
+        if (step.dot(step) <= m_epsilon * m_epsilon) {
+            break;
+        }
+        // Stop oscillating between two points, half way between them
+        if (iteration > 0 && abs(step.x + last_step.x) < 0.01f && abs(step.y + last_step.y) < 0.01f) {
+            current_point -= step * 0.5f;
+            break;
+        }
+        last_step = step;
+    }
+    return true;
+}
+
+void OpticalFlowTracker::track(
+    const OpticalFlowPyramid &previous,
+    const OpticalFlowPyramid &current,
+    const vector<Point2f> &previous_points,
+    vector<Point2f> &current_points,
+    vector<uchar> &status
+) {
+    size_t num_points = previous_points.size();
+    current_points.resize(num_points);
+    status.resize(num_points);
+    fill(status.begin(), status.end(), 1);
+
+    // Each level starts from the coarser level's result
+    int max_level = (int) min(previous.images.size(), current.images.size()) - 1;
+    for (int level = max_level; level >= 0; level--) {
+        float scale = 1.f / (1 << level);
+        for (size_t i = 0; i < num_points; i++) {
+            if (!status[i]) {
+                continue;
+            }
+            Point2f previous_point = previous_points[i] * scale;
+            if (level == max_level) {
+                current_points[i] = previous_point;
+            } else {
+                current_points[i] *= 2;
+            }
+            status[i] = track_point(
+                previous.images[level],
+                previous.derivatives[level],
+                current.images[level],
+                level,
+                previous_point,
+                current_points[i]
+            );
+        }
+    }
+}
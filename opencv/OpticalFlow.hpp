@@ -0,0 +1,94 @@
+#ifndef _OPTICAL_FLOW_HPP_
+#define _OPTICAL_FLOW_HPP_
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+/**
+ * An image pyramid for sparse optical flow: each level's image and its Scharr
+ * derivatives
+ *
+ * Like `cv::buildOpticalFlowPyramid`, each level is the previous one blurred with a 5x5
+ * Gaussian and halved (as `cv::pyrDown`), and levels stop before they get smaller than
+ * the tracking window. Unlike it, the levels and the filters' row buffers are allocated
+ * once, so rebuilding the pyramid for each frame doesn't allocate.
+ */
+class OpticalFlowPyramid {
+    // Area resampling taps from the input to level 0, per output column and row, built
+    // when the input size changes
+    class AreaTap {
+      public:
+        int source;
+        float weight;
+    };
+    cv::Size m_input_size;
+    std::vector<AreaTap> m_column_taps;
+    std::vector<int> m_first_column_tap;
+    std::vector<AreaTap> m_row_taps;
+    std::vector<int> m_first_row_tap;
+    std::vector<float> m_resampled_row;
+    std::vector<float> m_row_sums;
+
+    // Filter rows, with room for a border on each side
+    std::vector<int> m_filter_rows;
+
+    void build_area_taps(cv::Size input_size);
+    void resize_area(const cv::Mat &input, cv::Mat &output);
+    void pyramid_down(const cv::Mat &input, cv::Mat &output);
+    void scharr_derivatives(const cv::Mat &image, cv::Mat &derivatives);
+  public:
+    // CV_8U images, full resolution first
+    std::vector<cv::Mat> images;
+    // CV_16SC2 (dx, dy) Scharr derivatives of each image, 32 times the gradient
+    std::vector<cv::Mat> derivatives;
+
+    OpticalFlowPyramid(cv::Size size, int max_level, cv::Size window);
+
+    /**
+     * Build the pyramid of a CV_8U image, which is resized to level 0 by area averaging
+     * (like `cv::INTER_AREA`) if it's larger
+     */
+    void build(const cv::Mat &image);
+};
+
+/**
+ * Follows points from one frame to the next with pyramidal Lucas-Kanade optical flow,
+ * like `cv::calcOpticalFlowPyrLK` with its default criteria and flags, but with the
+ * window buffers allocated once instead of on every call
+ */
+class OpticalFlowTracker {
+    cv::Size m_window;
+    int m_max_iterations;
+    float m_epsilon;
+
+    // The previous image and its derivatives in the window around a point
+    std::vector<float> m_window_image;
+    std::vector<float> m_window_dx;
+    std::vector<float> m_window_dy;
+
+    bool track_point(
+      const cv::Mat &previous_image,
+      const cv::Mat &previous_derivatives,
+      const cv::Mat &current_image,
+      int level,
+      cv::Point2f previous_point,
+      cv::Point2f &current_point
+    );
+  public:
+    OpticalFlowTracker(cv::Size window = cv::Size(21, 21), int max_iterations = 30, double epsilon = 0.01);
+
+    /**
+     * Find where `previous_points` moved to in the current frame. `status` is set to 0
+     * for points which couldn't be followed. `current_points` and `status` are resized
+     * to the number of points, so they don't allocate once they're large enough.
+     */
+    void track(
+      const OpticalFlowPyramid &previous,
+      const OpticalFlowPyramid &current,
+      const std::vector<cv::Point2f> &previous_points,
+      std::vector<cv::Point2f> &current_points,
+      std::vector<uchar> &status
+    );
+};
+
+#endif // _OPTICAL_FLOW_HPP_
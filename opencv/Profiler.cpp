@@ -1,11 +1,86 @@
 #include "Profiler.hpp"
 
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "Tracer.hpp"
+#include "utils.hpp"
 
 using namespace std;
 using namespace std::chrono;
 
-Profiler::Profiler(string name): m_name(name) {}
+int LatencyHistogram::get_bucket(uint64_t nanoseconds) {
+    const uint64_t sub_buckets = 1 << SUB_BUCKET_BITS;
+    if (nanoseconds < sub_buckets) {
+        return nanoseconds;
+    }
+    // The highest set bit picks the power of two, and the bits below it the sub-bucket
+    int highest_bit = 63 - __builtin_clzll(nanoseconds);
+    int shift = highest_bit - SUB_BUCKET_BITS;
+    return ((shift + 1) << SUB_BUCKET_BITS) + ((nanoseconds >> shift) & (sub_buckets - 1));
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+    m_bucket_counts[get_bucket(nanoseconds)]++;
+    m_count++;
+    m_sum += nanoseconds;
+    if (nanoseconds > m_max) {
+        m_max = nanoseconds;
+    }
+}
+
+uint64_t LatencyHistogram::get_percentile(double fraction) const {
+    if (m_count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t) (fraction * (m_count - 1)) + 1;
+    uint64_t seen = 0;
+    const uint64_t sub_buckets = 1 << SUB_BUCKET_BITS;
+    for (int bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+        seen += m_bucket_counts[bucket];
+        if (seen < rank) {
+            continue;
+        }
+        if (bucket < (int) sub_buckets) {
+            return bucket;
+        }
+        // The middle of the bucket, but never more than the largest duration
+        int shift = (bucket >> SUB_BUCKET_BITS) - 1;
+        uint64_t lower = (sub_buckets | (bucket & (sub_buckets - 1))) << shift;
+        return min(lower + (((uint64_t) 1 << shift) >> 1), m_max);
+    }
+    return m_max;
+}
+
+uint64_t LatencyHistogram::get_count() const {
+    return m_count;
+}
+
+uint64_t LatencyHistogram::get_max() const {
+    return m_max;
+}
+
+double LatencyHistogram::get_mean() const {
+    return m_count == 0 ? 0 : 1. * m_sum / m_count;
+}
+
+static steady_clock::duration report_interval = seconds(1);
+
+// Every profiler's statistics, for writing at exit
+static mutex all_stats_mutex;
+static vector<shared_ptr<ProfilerStats>> all_stats;
+static string stats_json_path;
+static string stats_csv_path;
+
+Profiler::Profiler(string name): m_stats(make_shared<ProfilerStats>()) {
+    m_stats->name = name;
+    m_next_report_time = m_start_time + report_interval;
+    lock_guard<mutex> lock(all_stats_mutex);
+    all_stats.push_back(m_stats);
+}
 
 void Profiler::before_enter() {
     m_entrance_time = steady_clock::now();
@@ -13,23 +88,124 @@ void Profiler::before_enter() {
 
 void Profiler::after_exit() {
     steady_clock::time_point exit_time = steady_clock::now();
-    steady_clock::duration call_time = duration_cast<milliseconds>(
-        exit_time - m_entrance_time
-    );
-    m_num_frames++;
-    m_inner_time += call_time;
+    m_stats->call_times.record(duration_cast<nanoseconds>(exit_time - m_entrance_time).count());
+    m_stats->wall_time = exit_time - m_start_time;
+    if (Tracer::is_enabled()) {
+        Tracer::add_host_span(m_stats->name, m_entrance_time, exit_time);
+    }
+    if (exit_time >= m_next_report_time && report_interval != steady_clock::duration::zero()) {
+        m_next_report_time = exit_time + report_interval;
+        report();
+    }
+}
 
-    steady_clock::duration average_duration = m_inner_time / m_num_frames;
-    steady_clock::duration average_external_duration = (exit_time - m_start_time) / m_num_frames;
-    double average_duration_ms = duration_cast<microseconds>(average_duration).count() / 1000.0;
+void Profiler::report() {
+    const LatencyHistogram &call_times = m_stats->call_times;
+    double wall_ms = duration_cast<nanoseconds>(m_stats->wall_time).count() / 1e6;
+    double mean_ms = call_times.get_mean() / 1e6;
+    double frame_ms = wall_ms / call_times.get_count();
     fprintf(
         stderr,
-        "%s: % 3.1f ms/frame (%3dfps). %3d%% of %3.1fms total/% 3dfps)\n",
-        m_name.c_str(),
-        average_duration_ms,
-        (int) (average_duration_ms == 0 ? -1 : 1000 / average_duration_ms),
-        (int) (100 * average_duration / average_external_duration),
-        duration_cast<microseconds>(average_external_duration).count() / 1000.0,
-        (int) (1000 / duration_cast<milliseconds>(average_external_duration).count())
+        "%s: p50 %.2f p95 %.2f p99 %.2f max %.2f ms/frame, %3d%% of %.2fms total/%.0ffps (%ld frames)\n",
+        m_stats->name.c_str(),
+        call_times.get_percentile(0.5) / 1e6,
+        call_times.get_percentile(0.95) / 1e6,
+        call_times.get_percentile(0.99) / 1e6,
+        call_times.get_max() / 1e6,
+        (int) (frame_ms == 0 ? 0 : 100 * mean_ms / frame_ms),
+        frame_ms,
+        frame_ms == 0 ? 0 : 1000 / frame_ms,
+        (long) call_times.get_count()
     );
 }
+
+void Profiler::set_report_interval(double seconds) {
+    report_interval = duration_cast<steady_clock::duration>(duration<double>(seconds));
+}
+
+void Profiler::print_stats() {
+    lock_guard<mutex> lock(all_stats_mutex);
+    printf(
+        "%-20s %8s %10s %10s %10s %10s %10s\n",
+        "stage", "frames", "mean_ms", "p50_ms", "p95_ms", "p99_ms", "max_ms"
+    );
+    for (const shared_ptr<ProfilerStats> &stats : all_stats) {
+        const LatencyHistogram &call_times = stats->call_times;
+        printf(
+            "%-20s %8lu %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+            stats->name.c_str(),
+            (unsigned long) call_times.get_count(),
+            call_times.get_mean() / 1e6,
+            call_times.get_percentile(0.5) / 1e6,
+            call_times.get_percentile(0.95) / 1e6,
+            call_times.get_percentile(0.99) / 1e6,
+            call_times.get_max() / 1e6
+        );
+    }
+}
+
+static void write_stats() {
+    lock_guard<mutex> lock(all_stats_mutex);
+    if (!stats_json_path.empty()) {
+        FILE *file = fopen(stats_json_path.c_str(), "w");
+        if (file == NULL) {
+            cerr << "Failed to open " << stats_json_path << " for profiling statistics\n";
+        } else {
+            fprintf(file, "{\n  \"stages\": [");
+            for (size_t i = 0; i < all_stats.size(); i++) {
+                const ProfilerStats &stats = *all_stats[i];
+                const LatencyHistogram &call_times = stats.call_times;
+                fprintf(
+                    file,
+                    "%s\n    {\"name\": %s, \"count\": %lu, \"mean_ns\": %.0f, \"p50_ns\": %lu, "
+                    "\"p95_ns\": %lu, \"p99_ns\": %lu, \"max_ns\": %lu, \"wall_ns\": %ld}",
+                    i == 0 ? "" : ",",
+                    json_string(stats.name).c_str(),
+                    (unsigned long) call_times.get_count(),
+                    call_times.get_mean(),
+                    (unsigned long) call_times.get_percentile(0.5),
+                    (unsigned long) call_times.get_percentile(0.95),
+                    (unsigned long) call_times.get_percentile(0.99),
+                    (unsigned long) call_times.get_max(),
+                    (long) duration_cast<nanoseconds>(stats.wall_time).count()
+                );
+            }
+            fprintf(file, "\n  ]\n}\n");
+            fclose(file);
+        }
+    }
+    if (!stats_csv_path.empty()) {
+        FILE *file = fopen(stats_csv_path.c_str(), "w");
+        if (file == NULL) {
+            cerr << "Failed to open " << stats_csv_path << " for profiling statistics\n";
+        } else {
+            fprintf(file, "name,count,mean_ns,p50_ns,p95_ns,p99_ns,max_ns,wall_ns\n");
+            for (const shared_ptr<ProfilerStats> &stats : all_stats) {
+                const LatencyHistogram &call_times = stats->call_times;
+                fprintf(
+                    file,
+                    "%s,%lu,%.0f,%lu,%lu,%lu,%lu,%ld\n",
+                    stats->name.c_str(),
+                    (unsigned long) call_times.get_count(),
+                    call_times.get_mean(),
+                    (unsigned long) call_times.get_percentile(0.5),
+                    (unsigned long) call_times.get_percentile(0.95),
+                    (unsigned long) call_times.get_percentile(0.99),
+                    (unsigned long) call_times.get_max(),
+                    (long) duration_cast<nanoseconds>(stats->wall_time).count()
+                );
+            }
+            fclose(file);
+        }
+    }
+}
+
+void Profiler::write_stats_at_exit(string json_path, string csv_path) {
+    static bool registered = false;
+    stats_json_path = json_path;
+    stats_csv_path = csv_path;
+    if (!registered) {
+        registered = true;
+        atexit(write_stats);
+    }
+}
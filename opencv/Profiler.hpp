@@ -3,19 +3,85 @@
 
 #include <string>
 #include <chrono>
+#include <cstdint>
 #include <ratio>
 #include <memory>
 
+/**
+ * Counts durations (in nanoseconds) in logarithmic buckets: each power of two is split
+ * into 2^SUB_BUCKET_BITS equal buckets, so percentiles are within 1/16 of the true value
+ * at any scale, and recording is a few instructions
+ */
+class LatencyHistogram {
+  public:
+    static const int SUB_BUCKET_BITS = 3;
+    static const int NUM_BUCKETS = 64 << SUB_BUCKET_BITS;
+  private:
+    uint64_t m_bucket_counts[NUM_BUCKETS] = {};
+    uint64_t m_count = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_max = 0;
+
+    static int get_bucket(uint64_t nanoseconds);
+  public:
+    void record(uint64_t nanoseconds);
+
+    /**
+     * The duration below which `fraction` of the durations are, to within a bucket
+     */
+    uint64_t get_percentile(double fraction) const;
+
+    uint64_t get_count() const;
+    uint64_t get_max() const;
+    double get_mean() const;
+};
+
+/**
+ * Statistics of one profiled stage, kept after its profiler is destroyed so they can
+ * be written out at exit
+ */
+class ProfilerStats {
+  public:
+    std::string name;
+    LatencyHistogram call_times;
+    // From the profiler's creation to the last call's exit
+    std::chrono::steady_clock::duration wall_time = std::chrono::steady_clock::duration::zero();
+};
+
+/**
+ * Measures the time spent in calls to a stage, e.g. pulling a frame from a source
+ *
+ * Each call is recorded in a histogram, and a summary (percentiles, throughput, and
+ * the share of wall time spent in the stage) is printed at most once per report
+ * interval. A profiler must only be used from one thread.
+ */
 class Profiler {
-    std::string m_name;
-    int m_num_frames = 0;
+    std::shared_ptr<ProfilerStats> m_stats;
     std::chrono::steady_clock::time_point m_entrance_time;
     std::chrono::steady_clock::time_point m_start_time = std::chrono::steady_clock::now();
-    std::chrono::steady_clock::duration m_inner_time = std::chrono::steady_clock::duration::zero();
+    std::chrono::steady_clock::time_point m_next_report_time;
+
+    void report();
   public:
     Profiler(std::string name);
     void before_enter();
     void after_exit();
+
+    /**
+     * Print summaries at most every `seconds` (1 by default), or never if 0
+     */
+    static void set_report_interval(double seconds);
+
+    /**
+     * Print a table of the statistics of every profiler to stdout
+     */
+    static void print_stats();
+
+    /**
+     * Write the statistics of every profiler to a JSON and/or CSV file (if the path
+     * isn't empty) when the program exits
+     */
+    static void write_stats_at_exit(std::string json_path, std::string csv_path);
 };
 
-#endif // _PROFILE_HPP_
\ No newline at end of file
+#endif // _PROFILE_HPP_
@@ -0,0 +1,143 @@
+#include "RotationEstimator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <Eigen/LU>
+#include <Eigen/SVD>
+
+using namespace std;
+using namespace Eigen;
+
+RotationEstimator::RotationEstimator(
+    unsigned int seed,
+    int max_iterations,
+    double threshold,
+    double confidence
+):
+    m_rng(seed),
+    m_max_iterations(max_iterations),
+    m_threshold(threshold),
+    m_confidence(confidence) {}
+
+void RotationEstimator::set_threshold(double threshold) {
+    m_threshold = threshold;
+}
+
+void RotationEstimator::resize(int num_points) {
+    // Only ever grow the buffers, so steady state calls don't allocate
+    if (m_previous.cols() < num_points) {
+        int capacity = max(num_points, (int) m_previous.cols() * 2);
+        m_previous.resize(3, capacity);
+        m_current.resize(3, capacity);
+    }
+    m_num_points = num_points;
+}
+
+void RotationEstimator::set_point(int index, Vector3f previous, Vector3f current) {
+    m_previous.col(index) = previous.normalized();
+    m_current.col(index) = current.normalized();
+}
+
+void RotationEstimator::set_points(int num_points, const float *previous_xyz, const float *current_xyz) {
+    resize(num_points);
+    for (int i = 0; i < num_points; i++) {
+        set_point(i, Map<const Vector3f>(previous_xyz + 3 * i), Map<const Vector3f>(current_xyz + 3 * i));
+    }
+}
+
+/**
+ * Find the rotation `R` maximising `trace(R * covariance)`
+ */
+static Matrix3d rotation_from_covariance(const Matrix3d &covariance) {
+    JacobiSVD<Matrix3d> svd(covariance, ComputeFullU | ComputeFullV);
+    // Correct for reflections
+    double sign = (svd.matrixV() * svd.matrixU().transpose()).determinant() < 0 ? -1 : 1;
+    Vector3d correction(1, 1, sign);
+    return svd.matrixV() * correction.asDiagonal() * svd.matrixU().transpose();
+}
+
+Matrix3d RotationEstimator::kabsch(
+    const Ref<const Matrix3Xf> &previous,
+    const Ref<const Matrix3Xf> &current
+) {
+    return rotation_from_covariance((previous * current.transpose()).cast<double>());
+}
+
+int RotationEstimator::count_inliers(const Matrix3f &rotation) {
+    // Squared chord length between unit vectors, which is ~angle^2 for small angles
+    float threshold_squared = 4 * pow(sin(m_threshold / 2), 2);
+    auto previous = m_previous.leftCols(m_num_points).array();
+    auto current = m_current.leftCols(m_num_points).array();
+    auto dx = rotation(0, 0) * previous.row(0) + rotation(0, 1) * previous.row(1) +
+        rotation(0, 2) * previous.row(2) - current.row(0);
+    auto dy = rotation(1, 0) * previous.row(0) + rotation(1, 1) * previous.row(1) +
+        rotation(1, 2) * previous.row(2) - current.row(1);
+    auto dz = rotation(2, 0) * previous.row(0) + rotation(2, 1) * previous.row(1) +
+        rotation(2, 2) * previous.row(2) - current.row(2);
+    return (dx.square() + dy.square() + dz.square() < threshold_squared).count();
+}
+
+Matrix3d RotationEstimator::fit_inliers(const Matrix3f &rotation) {
+    float threshold_squared = 4 * pow(sin(m_threshold / 2), 2);
+    Matrix3f covariance = Matrix3f::Zero();
+    for (int i = 0; i < m_num_points; i++) {
+        Vector3f previous = m_previous.col(i);
+        Vector3f current = m_current.col(i);
+        if ((rotation * previous - current).squaredNorm() < threshold_squared) {
+            covariance += previous * current.transpose();
+        }
+    }
+    return rotation_from_covariance(covariance.cast<double>());
+}
+
+int RotationEstimator::estimate(Matrix3d &rotation) {
+    rotation = Matrix3d::Identity();
+    if (m_num_points < 2) {
+        return 0;
+    }
+
+    uniform_int_distribution<int> first_distribution(0, m_num_points - 1);
+    uniform_int_distribution<int> second_distribution(0, m_num_points - 2);
+    Matrix3f best_rotation = Matrix3f::Identity();
+    int best_inliers = -1;
+    int iterations = m_max_iterations;
+    Matrix<float, 3, 2> sample_previous, sample_current;
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        // Pick two distinct points
+        int first = first_distribution(m_rng);
+        int second = second_distribution(m_rng);
+        if (second >= first) {
+            second++;
+        }
+        sample_previous << m_previous.col(first), m_previous.col(second);
+        sample_current << m_current.col(first), m_current.col(second);
+        Matrix3f hypothesis = kabsch(sample_previous, sample_current).cast<float>();
+
+        int inliers = count_inliers(hypothesis);
+        if (inliers > best_inliers) {
+            best_inliers = inliers;
+            best_rotation = hypothesis;
+
+            // Stop once we're `m_confidence` sure to have drawn an all inlier sample
+            double inlier_ratio = 1. * inliers / m_num_points;
+            double all_inliers_probability = inlier_ratio * inlier_ratio;
+            if (all_inliers_probability >= 1) {
+                break;
+            }
+            if (all_inliers_probability > 0) {
+                double needed = log(1 - m_confidence) / log(1 - all_inliers_probability);
+                iterations = min(iterations, (int) ceil(needed));
+            }
+        }
+    }
+
+    if (best_inliers < 2) {
+        return 0;
+    }
+
+    // Refine with all inliers of the best hypothesis
+    rotation = fit_inliers(best_rotation);
+    return count_inliers(rotation.cast<float>());
+}
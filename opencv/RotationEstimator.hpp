@@ -0,0 +1,66 @@
+#ifndef _ROTATION_ESTIMATOR_HPP_
+#define _ROTATION_ESTIMATOR_HPP_
+
+#include <random>
+
+#include <Eigen/Core>
+
+/**
+ * Estimates a pure camera rotation between two frames with RANSAC
+ *
+ * Points are given as bearing vectors (unit vectors in camera coordinates), and the
+ * estimated rotation `R` maps bearings in the previous frame to bearings in the current
+ * frame (`current = R * previous`). Each hypothesis is fitted to a minimal sample of 2
+ * points with the Kabsch algorithm, inliers are counted with vectorised (Eigen) array
+ * operations, and the number of iterations adapts to the best inlier ratio so far.
+ */
+class RotationEstimator {
+    std::mt19937 m_rng;
+    int m_max_iterations;
+    double m_threshold;
+    double m_confidence;
+
+    // Bearings, reused between calls. Stored as rows of x, y and z coordinates, so the
+    // inlier count works on contiguous arrays.
+    Eigen::Matrix<float, 3, Eigen::Dynamic, Eigen::RowMajor> m_previous;
+    Eigen::Matrix<float, 3, Eigen::Dynamic, Eigen::RowMajor> m_current;
+    int m_num_points = 0;
+
+    int count_inliers(const Eigen::Matrix3f &rotation);
+    Eigen::Matrix3d fit_inliers(const Eigen::Matrix3f &rotation);
+  public:
+    /**
+     * `threshold` is the largest angle (in radians) between a rotated previous bearing and
+     * its current bearing for the pair to count as an inlier
+     */
+    RotationEstimator(
+      unsigned int seed = 0,
+      int max_iterations = 100,
+      double threshold = 0.01,
+      double confidence = 0.99
+    );
+
+    void set_threshold(double threshold);
+
+    /**
+     * Set the point pairs for the next call to `estimate`, as (unnormalised) bearings
+     */
+    void set_points(int num_points, const float *previous_xyz, const float *current_xyz);
+    void set_point(int index, Eigen::Vector3f previous, Eigen::Vector3f current);
+    void resize(int num_points);
+
+    /**
+     * Estimate the rotation, returning the number of inliers (0 on failure)
+     */
+    int estimate(Eigen::Matrix3d &rotation);
+
+    /**
+     * Find the rotation best aligning pairs of bearings, in the least squares sense
+     */
+    static Eigen::Matrix3d kabsch(
+      const Eigen::Ref<const Eigen::Matrix3Xf> &previous,
+      const Eigen::Ref<const Eigen::Matrix3Xf> &current
+    );
+};
+
+#endif // _ROTATION_ESTIMATOR_HPP_
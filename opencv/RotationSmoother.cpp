@@ -0,0 +1,112 @@
+#include "RotationSmoother.hpp"
+
+#include <algorithm>
+
+#include <Eigen/SVD>
+
+using namespace std;
+using namespace Eigen;
+
+const int BATCH_BLOCK_FRAMES = 256;
+
+/**
+ * The closed form of the quadratic Savitzky-Golay smoothing weights: the weight for
+ * offset d from the centre of the window is a - b * d^2
+ */
+static void get_weights(int radius, double &a, double &b) {
+    double m = radius;
+    double denominator = (2 * m - 1) * (2 * m + 1) * (2 * m + 3);
+    a = 3 * (3 * m * m + 3 * m - 1) / denominator;
+    b = 15 / denominator;
+}
+
+RotationSmoother::RotationSmoother(int radius, const Matrix3d &initial):
+    m_radius(radius),
+    m_window(2 * radius + 1, initial)
+{
+    get_weights(radius, m_weight_a, m_weight_b);
+    refresh_moments();
+}
+
+void RotationSmoother::refresh_moments() {
+    m_sum.setZero();
+    m_sum_d.setZero();
+    m_sum_d2.setZero();
+    for (size_t i = 0; i < m_window.size(); i++) {
+        const Matrix3d &rotation = m_window[(m_oldest + i) % m_window.size()];
+        double d = (double) i - m_radius;
+        m_sum += rotation;
+        m_sum_d += d * rotation;
+        m_sum_d2 += d * d * rotation;
+    }
+    m_added_since_refresh = 0;
+}
+
+void RotationSmoother::add(const Matrix3d &rotation) {
+    // Remove the oldest rotation, at d = -radius
+    Matrix3d &oldest = m_window[m_oldest];
+    double r = m_radius;
+    m_sum -= oldest;
+    m_sum_d += r * oldest;
+    m_sum_d2 -= r * r * oldest;
+
+    // Move the centre forward, so every offset d becomes d - 1
+    m_sum_d2 += m_sum - 2 * m_sum_d;
+    m_sum_d -= m_sum;
+
+    // Add the new rotation, at d = radius
+    m_sum += rotation;
+    m_sum_d += r * rotation;
+    m_sum_d2 += r * r * rotation;
+    oldest = rotation;
+    m_oldest = (m_oldest + 1) % m_window.size();
+
+    if (++m_added_since_refresh == m_window.size()) {
+        refresh_moments();
+    }
+}
+
+Matrix3d RotationSmoother::filter() const {
+    return project_to_rotation(m_weight_a * m_sum - m_weight_b * m_sum_d2);
+}
+
+vector<Matrix3d> RotationSmoother::smooth(
+    const vector<Matrix3d> &rotations,
+    int radius,
+    const Matrix3d &initial
+) {
+    // One column per rotation, after the window's initial contents
+    int window_size = 2 * radius + 1;
+    int num_rotations = rotations.size();
+    Matrix<double, 9, Dynamic> padded(9, num_rotations + window_size - 1);
+    for (int i = 0; i < window_size - 1; i++) {
+        padded.col(i) = Map<const Matrix<double, 9, 1>>(initial.data());
+    }
+    for (int i = 0; i < num_rotations; i++) {
+        padded.col(window_size - 1 + i) = Map<const Matrix<double, 9, 1>>(rotations[i].data());
+    }
+
+    double a, b;
+    get_weights(radius, a, b);
+    // Filtered in blocks of frames which stay in the cache for the whole window
+    Matrix<double, 9, Dynamic> filtered = Matrix<double, 9, Dynamic>::Zero(9, num_rotations);
+    for (int start = 0; start < num_rotations; start += BATCH_BLOCK_FRAMES) {
+        int block_size = min(BATCH_BLOCK_FRAMES, num_rotations - start);
+        for (int i = 0; i < window_size; i++) {
+            double d = i - radius;
+            filtered.middleCols(start, block_size) +=
+                (a - b * d * d) * padded.middleCols(start + i, block_size);
+        }
+    }
+
+    vector<Matrix3d> smoothed(num_rotations);
+    for (int i = 0; i < num_rotations; i++) {
+        smoothed[i] = project_to_rotation(Map<const Matrix3d>(filtered.col(i).data()));
+    }
+    return smoothed;
+}
+
+Matrix3d RotationSmoother::project_to_rotation(const Matrix3d &matrix) {
+    JacobiSVD<Matrix3d> svd(matrix, ComputeFullU | ComputeFullV);
+    return svd.matrixU() * svd.matrixV().transpose();
+}
@@ -0,0 +1,69 @@
+#ifndef _ROTATION_SMOOTHER_HPP_
+#define _ROTATION_SMOOTHER_HPP_
+
+#include <vector>
+
+#include <Eigen/Core>
+
+/**
+ * Smooths a sequence of rotations with a Savitzky-Golay filter (a least squares
+ * quadratic fit, evaluated at the centre of a window of `2 * radius + 1` rotations),
+ * giving the same output as `gram_sg::RotationFilter` with
+ * `SavitzkyGolayFilterConfig(radius, 0, 2, 0)`
+ *
+ * Like `gram_sg::RotationFilter`, the fit is applied to each rotation matrix coefficient
+ * and the result projected back to the nearest rotation. Instead of re-evaluating the
+ * whole window for each frame, the window's moments (the sums of the rotations weighted
+ * by 1, d and d^2, with d the offset from the centre) are updated as rotations enter and
+ * leave it, so each frame costs the same for any radius. The moments are recomputed
+ * from the window once it has been replaced, so rounding errors don't accumulate.
+ */
+class RotationSmoother {
+    int m_radius;
+
+    // The filter weight for offset d from the centre is m_weight_a - m_weight_b * d^2
+    double m_weight_a;
+    double m_weight_b;
+
+    // The window, oldest first from m_oldest
+    std::vector<Eigen::Matrix3d> m_window;
+    size_t m_oldest = 0;
+    size_t m_added_since_refresh = 0;
+
+    // Moments of the window
+    Eigen::Matrix3d m_sum;
+    Eigen::Matrix3d m_sum_d;
+    Eigen::Matrix3d m_sum_d2;
+
+    void refresh_moments();
+  public:
+    /**
+     * The window starts filled with `initial`, like `gram_sg::RotationFilter`'s with zeros
+     */
+    RotationSmoother(int radius, const Eigen::Matrix3d &initial = Eigen::Matrix3d::Zero());
+
+    void add(const Eigen::Matrix3d &rotation);
+
+    /**
+     * The smoothed rotation at the centre of the window
+     */
+    Eigen::Matrix3d filter() const;
+
+    /**
+     * Smooth a whole sequence at once: `smoothed[i]` is what `filter()` would return after
+     * adding `rotations[0]` to `rotations[i]` to a new smoother. The filter is applied to
+     * all the frames together with vectorised (Eigen) array operations.
+     */
+    static std::vector<Eigen::Matrix3d> smooth(
+      const std::vector<Eigen::Matrix3d> &rotations,
+      int radius,
+      const Eigen::Matrix3d &initial = Eigen::Matrix3d::Zero()
+    );
+
+    /**
+     * The nearest rotation to a matrix, as `gram_sg::RotationFilter` finds it
+     */
+    static Eigen::Matrix3d project_to_rotation(const Eigen::Matrix3d &matrix);
+};
+
+#endif // _ROTATION_SMOOTHER_HPP_
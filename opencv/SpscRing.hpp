@@ -0,0 +1,79 @@
+#ifndef _SPSC_RING_HPP_
+#define _SPSC_RING_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * A fixed capacity, lock-free ring buffer for exactly one producer thread and one
+ * consumer thread
+ *
+ * The head and tail are free running counters, so the ring is full when they are
+ * `capacity` apart and empty when they are equal.
+ */
+template <typename T>
+class SpscRing {
+    std::vector<T> m_slots;
+    // Keep the counters on separate cache lines so the two threads don't false share
+    char m_pad_0[64];
+    std::atomic<size_t> m_head;
+    char m_pad_1[64];
+    std::atomic<size_t> m_tail;
+    char m_pad_2[64];
+
+  public:
+    explicit SpscRing(size_t capacity): m_slots(capacity), m_head(0), m_tail(0) {}
+
+    /**
+     * Producer only: add an item, or return false if the ring is full
+     */
+    bool try_push(const T &value) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == m_slots.size()) {
+            return false;
+        }
+        m_slots[tail % m_slots.size()] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Consumer only: return the oldest item without removing it, or NULL if empty
+     */
+    T* front() {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (m_tail.load(std::memory_order_acquire) == head) {
+            return NULL;
+        }
+        return &m_slots[head % m_slots.size()];
+    }
+
+    /**
+     * Consumer only: remove the oldest item, or return false if empty. The item is moved
+     * out, so the ring doesn't keep e.g. a reference counted buffer alive.
+     */
+    bool try_pop(T &value) {
+        T *item = front();
+        if (item == NULL) {
+            return false;
+        }
+        value = std::move(*item);
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Number of items in the ring (exact only when called from one of its two threads)
+     */
+    size_t size() const {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return m_slots.size();
+    }
+};
+
+#endif // _SPSC_RING_HPP_
@@ -0,0 +1,144 @@
+#include "SyntheticScene.hpp"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+using namespace std;
+using namespace cv;
+
+Matx33d SyntheticMotion::get_orientation(double time) const {
+    double phase = 2 * CV_PI * shake_frequency * time;
+    // Incommensurate shakes about each axis, so the motion doesn't simply repeat
+    Vec3d rotation_vector = pan_rate * time + Vec3d(
+        shake_amplitude[0] * sin(phase),
+        shake_amplitude[1] * sin(1.3 * phase + 1),
+        shake_amplitude[2] * sin(0.7 * phase + 2)
+    );
+    Matx33d orientation;
+    Rodrigues(rotation_vector, orientation);
+    return orientation;
+}
+
+/**
+ * A face of the cube map: random shapes of random shades, anti-aliased and blurred
+ * slightly so that optical flow has smooth gradients to follow
+ */
+static Mat create_face(mt19937 &rng, int face_size) {
+    Mat face(face_size, face_size, CV_8U, Scalar(128));
+    uniform_int_distribution<int> position_distribution(0, face_size);
+    uniform_int_distribution<int> size_distribution(face_size / 64, face_size / 8);
+    uniform_int_distribution<int> shade_distribution(16, 240);
+    for (int i = 0; i < 300; i++) {
+        Point corner(position_distribution(rng), position_distribution(rng));
+        int size = size_distribution(rng);
+        rectangle(
+            face,
+            corner,
+            corner + Point(size, size * 2 / 3),
+            Scalar(shade_distribution(rng)),
+            FILLED,
+            LINE_AA
+        );
+    }
+    for (int i = 0; i < 150; i++) {
+        Point centre(position_distribution(rng), position_distribution(rng));
+        circle(face, centre, size_distribution(rng) / 2, Scalar(shade_distribution(rng)), FILLED, LINE_AA);
+    }
+    GaussianBlur(face, face, Size(0, 0), 1);
+    return face;
+}
+
+SyntheticScene::SyntheticScene(Camera camera, unsigned int seed, int face_size):
+    m_camera(camera)
+{
+    mt19937 rng(seed);
+    uniform_int_distribution<int> chroma_distribution(96, 160);
+    for (int i = 0; i < NUM_FACES; i++) {
+        m_faces[i] = create_face(rng, face_size);
+        // A tint per face, so that the output is easier to follow by eye
+        m_face_chroma[i] = Vec2b(chroma_distribution(rng), chroma_distribution(rng));
+    }
+
+    vector<Point2f> pixels;
+    pixels.reserve(camera.size.area());
+    for (int y = 0; y < camera.size.height; y++) {
+        for (int x = 0; x < camera.size.width; x++) {
+            pixels.push_back(Point2f(x, y));
+        }
+    }
+    vector<Point2f> undistorted;
+    if (camera.model == FISHEYE) {
+        fisheye::undistortPoints(pixels, undistorted, camera.matrix, camera.distortion_coefficients);
+    } else {
+        undistortPoints(pixels, undistorted, camera.matrix, camera.distortion_coefficients);
+    }
+    m_rays.create(camera.size, CV_32FC3);
+    for (int y = 0; y < camera.size.height; y++) {
+        Vec3f *row = m_rays.ptr<Vec3f>(y);
+        for (int x = 0; x < camera.size.width; x++) {
+            const Point2f &point = undistorted[y * camera.size.width + x];
+            row[x] = normalize(Vec3f(point.x, point.y, 1));
+        }
+    }
+}
+
+/**
+ * The cube map face that a direction hits, and where on it (in [-1, 1])
+ */
+static inline int get_face(const Vec3f &direction, float &u, float &v) {
+    float abs_x = abs(direction[0]);
+    float abs_y = abs(direction[1]);
+    float abs_z = abs(direction[2]);
+    if (abs_x >= abs_y && abs_x >= abs_z) {
+        u = direction[1] / abs_x;
+        v = direction[2] / abs_x;
+        return direction[0] > 0 ? 0 : 1;
+    }
+    if (abs_y >= abs_z) {
+        u = direction[0] / abs_y;
+        v = direction[2] / abs_y;
+        return direction[1] > 0 ? 2 : 3;
+    }
+    u = direction[0] / abs_z;
+    v = direction[1] / abs_z;
+    return direction[2] > 0 ? 4 : 5;
+}
+
+static inline uchar sample_bilinear(const Mat &face, float u, float v) {
+    float x = (u + 1) * 0.5f * (face.cols - 1);
+    float y = (v + 1) * 0.5f * (face.rows - 1);
+    int x0 = min((int) x, face.cols - 2);
+    int y0 = min((int) y, face.rows - 2);
+    float fx = x - x0;
+    float fy = y - y0;
+    const uchar *row0 = face.ptr<uchar>(y0);
+    const uchar *row1 = face.ptr<uchar>(y0 + 1);
+    float top = row0[x0] + fx * (row0[x0 + 1] - row0[x0]);
+    float bottom = row1[x0] + fx * (row1[x0 + 1] - row1[x0]);
+    return (uchar) (top + fy * (bottom - top) + 0.5f);
+}
+
+void SyntheticScene::render(const Matx33d &orientation, Mat luma, Mat chroma) const {
+    Matx33f rotation = orientation;
+    parallel_for_(Range(0, m_camera.size.height / 2), [&](const Range &range) {
+        for (int chroma_y = range.start; chroma_y < range.end; chroma_y++) {
+            Vec2b *chroma_row = chroma.ptr<Vec2b>(chroma_y);
+            for (int y = chroma_y * 2; y < chroma_y * 2 + 2; y++) {
+                const Vec3f *rays = m_rays.ptr<Vec3f>(y);
+                uchar *luma_row = luma.ptr<uchar>(y);
+                for (int x = 0; x < m_camera.size.width; x++) {
+                    float u, v;
+                    int face = get_face(rotation * rays[x], u, v);
+                    luma_row[x] = sample_bilinear(m_faces[face], u, v);
+                    if (y % 2 == 0 && x % 2 == 0) {
+                        chroma_row[x / 2] = m_face_chroma[face];
+                    }
+                }
+            }
+        }
+    });
+}
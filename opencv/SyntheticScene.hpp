@@ -0,0 +1,48 @@
+#ifndef _SYNTHETIC_SCENE_HPP_
+#define _SYNTHETIC_SCENE_HPP_
+
+#include <opencv2/core.hpp>
+
+#include "Camera.hpp"
+
+/**
+ * A known camera motion: a steady pan plus sinusoidal shake, as a rotation vector
+ * (in radians) at each time
+ */
+class SyntheticMotion {
+  public:
+    // Rotation per second about the camera's x, y and z axes
+    cv::Vec3d pan_rate = cv::Vec3d(0, 0.1, 0);
+    // Peak shake angle about each axis
+    cv::Vec3d shake_amplitude = cv::Vec3d(0.02, 0.02, 0.01);
+    double shake_frequency = 2;
+
+    /**
+     * The camera orientation (camera to world rotation) at `time` seconds
+     */
+    cv::Matx33d get_orientation(double time) const;
+};
+
+/**
+ * A textured environment (a cube map of random shapes) seen from its centre through a
+ * camera model, for generating frames with a known camera orientation
+ */
+class SyntheticScene {
+    static const int NUM_FACES = 6;
+
+    Camera m_camera;
+    // The unit ray through each pixel, in camera coordinates
+    cv::Mat m_rays;
+    cv::Mat m_faces[NUM_FACES];
+    cv::Vec2b m_face_chroma[NUM_FACES];
+  public:
+    SyntheticScene(Camera camera, unsigned int seed = 0, int face_size = 1024);
+
+    /**
+     * Render the scene seen with the camera at `orientation` (camera to world) into the
+     * luma plane and the interleaved chroma plane of an NV12 frame
+     */
+    void render(const cv::Matx33d &orientation, cv::Mat luma, cv::Mat chroma) const;
+};
+
+#endif // _SYNTHETIC_SCENE_HPP_
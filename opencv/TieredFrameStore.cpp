@@ -0,0 +1,323 @@
+#include "TieredFrameStore.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <opencv2/core/ocl.hpp>
+
+#include "OpenClSync.hpp"
+
+using namespace std;
+using namespace cv;
+
+TieredFrameStore::TieredFrameStore(TieredFrameStoreConfig config, size_t capacity):
+    m_config(config),
+    m_frames(max(capacity, (size_t) 1))
+{
+    if (!m_config.scratch_directory.empty()) {
+        if (ocl::useOpenCL()) {
+            m_opencl_context = ocl::OpenCLExecutionContext::getCurrent();
+        }
+        m_thread = thread(&TieredFrameStore::run, this);
+    }
+}
+
+TieredFrameStore::~TieredFrameStore() {
+    if (m_thread.joinable()) {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_task_available.notify_all();
+        m_thread.join();
+    }
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+
+    fprintf(
+        stderr,
+        "Stabilisation lookahead: peak %zu frames, %.1f MiB (device %.1f, host %.1f, file %.1f MiB), "
+        "spilled %ld to host/%ld to file, prefetched %ld, waited for %ld prefetches\n",
+        m_stats.peak_frames,
+        m_stats.peak_bytes / 1024. / 1024.,
+        m_stats.peak_device_bytes / 1024. / 1024.,
+        m_stats.peak_host_bytes / 1024. / 1024.,
+        m_stats.peak_file_bytes / 1024. / 1024.,
+        m_stats.spilled_to_host,
+        m_stats.spilled_to_file,
+        m_stats.prefetched,
+        m_stats.prefetch_waits
+    );
+}
+
+TieredFrameStore::StoredFrame &TieredFrameStore::frame_at(size_t index) {
+    return m_frames[(m_first_frame + index) % m_frames.size()];
+}
+
+void TieredFrameStore::run() {
+    // OpenCV's OpenCL context is per thread, and frames (e.g. from VA-API interop) must
+    // only be used in the context they were created in. The copies go on a queue of
+    // their own, so they neither wait for nor hold up the caller's queue.
+    if (!m_opencl_context.empty()) {
+        m_opencl_context.cloneWithNewQueue().bind();
+    }
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_task_available.wait(lock, [this]() {
+                return m_stopping || !m_tasks.empty();
+            });
+            if (m_stopping) {
+                return;
+            }
+            task = move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void TieredFrameStore::submit(function<void()> task) {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_tasks.push_back(move(task));
+    }
+    m_task_available.notify_one();
+}
+
+long TieredFrameStore::allocate_slot(size_t bytes) {
+    if (m_fd == -1) {
+        string path = m_config.scratch_directory + "/lookahead-XXXXXX";
+        vector<char> path_buffer(path.begin(), path.end());
+        path_buffer.push_back('\0');
+        m_fd = mkstemp(path_buffer.data());
+        if (m_fd == -1) {
+            cerr << "Could not create scratch file in " << m_config.scratch_directory << ": " <<
+                strerror(errno) << "\n";
+            throw -1;
+        }
+        // Removed from the filesystem once closed
+        unlink(path_buffer.data());
+
+        // Slots must start on page boundaries to be mapped
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        m_slot_bytes = (bytes + page_size - 1) / page_size * page_size;
+    }
+    if (bytes > m_slot_bytes) {
+        cerr << "Frame of " << bytes << " bytes does not fit in a " << m_slot_bytes <<
+            " byte scratch file slot\n";
+        throw -1;
+    }
+
+    if (!m_free_slots.empty()) {
+        long slot = m_free_slots.back();
+        m_free_slots.pop_back();
+        return slot;
+    }
+    long slot = m_num_slots++;
+    if (ftruncate(m_fd, m_num_slots * m_slot_bytes) != 0) {
+        cerr << "Could not grow scratch file: " << strerror(errno) << "\n";
+        throw -1;
+    }
+    return slot;
+}
+
+bool TieredFrameStore::spill(StoredFrame &stored) {
+    if (m_host_bytes + stored.bytes <= m_config.host_budget_bytes) {
+        // Device to pinned host memory copy, queued on the OpenCL queue
+        UMat host(stored.rows, stored.cols, stored.type, USAGE_ALLOCATE_HOST_MEMORY);
+        stored.frame.copyTo(host);
+        stored.frame = host;
+        stored.tier = FRAME_TIER_HOST;
+        m_device_bytes -= stored.bytes;
+        m_host_bytes += stored.bytes;
+        m_stats.spilled_to_host++;
+        return true;
+    }
+    if (m_config.scratch_directory.empty()) {
+        return false;
+    }
+
+    stored.slot = allocate_slot(stored.bytes);
+    // The worker reads the frame on its own queue, after the work that produced it
+    // (queued on this thread's queue). The marker is released with the task.
+    shared_ptr<_cl_event> produced;
+    if (!m_opencl_context.empty()) {
+        produced = shared_ptr<_cl_event>(enqueue_marker(), clReleaseEvent);
+    }
+    auto task = make_shared<packaged_task<void()>>(
+        [this, frame = stored.frame, offset = stored.slot * m_slot_bytes, produced]() {
+            if (produced) {
+                enqueue_wait(produced.get());
+            }
+            void *data = mmap(NULL, m_slot_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, offset);
+            if (data == MAP_FAILED) {
+                cerr << "Could not map scratch file: " << strerror(errno) << "\n";
+                throw -1;
+            }
+            frame.copyTo(Mat(frame.rows, frame.cols, frame.type(), data));
+            munmap(data, m_slot_bytes);
+        }
+    );
+    stored.spilling = task->get_future().share();
+    submit([task]() { (*task)(); });
+
+    // The worker holds the last reference to the device copy until it's written
+    stored.frame = UMat();
+    if (stored.tier == FRAME_TIER_DEVICE) {
+        m_device_bytes -= stored.bytes;
+    } else {
+        m_host_bytes -= stored.bytes;
+    }
+    stored.tier = FRAME_TIER_FILE;
+    m_file_bytes += stored.bytes;
+    m_stats.spilled_to_file++;
+    return true;
+}
+
+void TieredFrameStore::prefetch(StoredFrame &stored) {
+    if (stored.tier == FRAME_TIER_DEVICE) {
+        return;
+    }
+    if (stored.tier == FRAME_TIER_HOST) {
+        UMat device;
+        stored.frame.copyTo(device);
+        stored.frame = device;
+        m_host_bytes -= stored.bytes;
+    } else {
+        auto task = make_shared<packaged_task<UMat()>>(
+            [
+                this,
+                spilling = stored.spilling,
+                rows = stored.rows,
+                cols = stored.cols,
+                type = stored.type,
+                offset = stored.slot * m_slot_bytes
+            ]() {
+                // Rethrows if writing the frame failed
+                spilling.get();
+                void *data = mmap(NULL, m_slot_bytes, PROT_READ, MAP_SHARED, m_fd, offset);
+                if (data == MAP_FAILED) {
+                    cerr << "Could not map scratch file: " << strerror(errno) << "\n";
+                    throw -1;
+                }
+                UMat device;
+                Mat(rows, cols, type, data).copyTo(device);
+                if (!m_opencl_context.empty()) {
+                    // Only the copy from the mapping must finish before it's unmapped
+                    cl_event copied = enqueue_marker();
+                    int err = clWaitForEvents(1, &copied);
+                    clReleaseEvent(copied);
+                    if (err != CL_SUCCESS) {
+                        munmap(data, m_slot_bytes);
+                        cerr << "Failed to wait for OpenCL copy: " << err << "\n";
+                        throw err;
+                    }
+                }
+                munmap(data, m_slot_bytes);
+                return device;
+            }
+        );
+        stored.loading = task->get_future().share();
+        submit([task]() { (*task)(); });
+        m_file_bytes -= stored.bytes;
+    }
+    stored.tier = FRAME_TIER_DEVICE;
+    m_device_bytes += stored.bytes;
+    m_stats.prefetched++;
+}
+
+void TieredFrameStore::balance() {
+    // Bring the frames pulled next back onto the device
+    size_t num_prefetched = min(m_config.prefetch_frames, m_num_frames);
+    for (size_t i = 0; i < num_prefetched; i++) {
+        prefetch(frame_at(i));
+    }
+
+    // Spill the oldest of the other frames until the device budget is met, so the
+    // newest frames stay on the device the longest
+    for (size_t i = num_prefetched; i < m_num_frames && m_device_bytes > m_config.device_budget_bytes; i++) {
+        if (frame_at(i).tier == FRAME_TIER_DEVICE && !spill(frame_at(i))) {
+            break;
+        }
+    }
+
+    update_peaks();
+}
+
+void TieredFrameStore::update_peaks() {
+    m_stats.peak_frames = max(m_stats.peak_frames, m_num_frames);
+    m_stats.peak_bytes = max(m_stats.peak_bytes, m_device_bytes + m_host_bytes + m_file_bytes);
+    m_stats.peak_device_bytes = max(m_stats.peak_device_bytes, m_device_bytes);
+    m_stats.peak_host_bytes = max(m_stats.peak_host_bytes, m_host_bytes);
+    m_stats.peak_file_bytes = max(m_stats.peak_file_bytes, m_file_bytes);
+}
+
+void TieredFrameStore::push(UMat frame) {
+    if (m_num_frames == m_frames.size()) {
+        // Full, so unroll the ring into one twice the size
+        vector<StoredFrame> frames(m_frames.size() * 2);
+        for (size_t i = 0; i < m_num_frames; i++) {
+            frames[i] = move(frame_at(i));
+        }
+        m_frames.swap(frames);
+        m_first_frame = 0;
+    }
+    StoredFrame &stored = frame_at(m_num_frames);
+    stored.tier = FRAME_TIER_DEVICE;
+    stored.frame = frame;
+    stored.rows = frame.rows;
+    stored.cols = frame.cols;
+    stored.type = frame.type();
+    stored.bytes = frame.total() * frame.elemSize();
+    m_num_frames++;
+    m_device_bytes += stored.bytes;
+    update_peaks();
+    balance();
+}
+
+UMat TieredFrameStore::front() {
+    StoredFrame &stored = frame_at(0);
+    prefetch(stored);
+    if (stored.loading.valid()) {
+        if (stored.loading.wait_for(chrono::seconds(0)) != future_status::ready) {
+            m_stats.prefetch_waits++;
+        }
+        stored.frame = stored.loading.get();
+        stored.loading = shared_future<UMat>();
+        stored.spilling = shared_future<void>();
+        m_free_slots.push_back(stored.slot);
+        stored.slot = -1;
+    }
+    return stored.frame;
+}
+
+void TieredFrameStore::pop() {
+    front();
+    StoredFrame &stored = frame_at(0);
+    m_device_bytes -= stored.bytes;
+    // Release the frame, and leave the slot ready to be reused
+    stored = StoredFrame();
+    m_first_frame = (m_first_frame + 1) % m_frames.size();
+    m_num_frames--;
+    balance();
+}
+
+size_t TieredFrameStore::size() {
+    return m_num_frames;
+}
+
+TieredFrameStoreStats TieredFrameStore::get_stats() {
+    return m_stats;
+}
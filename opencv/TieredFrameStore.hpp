@@ -0,0 +1,134 @@
+#ifndef _TIERED_FRAME_STORE_HPP_
+#define _TIERED_FRAME_STORE_HPP_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+
+class TieredFrameStoreConfig {
+  public:
+    // Bytes of frames kept in device memory. Frames about to be pulled are always on the
+    // device, even beyond the budget
+    size_t device_budget_bytes = SIZE_MAX;
+
+    // Bytes of frames kept in pinned host memory once the device budget is used
+    size_t host_budget_bytes = 0;
+
+    // Directory of the memory mapped scratch file holding the frames which fit in
+    // neither budget, or empty to keep those frames on the device
+    std::string scratch_directory;
+
+    // Number of frames at the front of the queue brought back onto the device ahead of
+    // being pulled
+    size_t prefetch_frames = 4;
+};
+
+class TieredFrameStoreStats {
+  public:
+    size_t peak_frames = 0;
+    size_t peak_bytes = 0;
+    size_t peak_device_bytes = 0;
+    size_t peak_host_bytes = 0;
+    size_t peak_file_bytes = 0;
+    long spilled_to_host = 0;
+    long spilled_to_file = 0;
+    long prefetched = 0;
+    // Times a frame was needed before its prefetch from the scratch file completed
+    long prefetch_waits = 0;
+};
+
+enum FrameTier {
+    FRAME_TIER_DEVICE,
+    FRAME_TIER_HOST,
+    FRAME_TIER_FILE,
+};
+
+/**
+ * A queue of frames which keeps the newest and the next few frames in device memory,
+ * and spills the others to pinned host memory or a memory mapped scratch file
+ *
+ * Copies to and from pinned host memory are queued on the OpenCL queue, copies to and
+ * from the scratch file run on a worker thread, so neither blocks the caller until a
+ * frame is actually needed. The worker uses the OpenCL context that was current when
+ * the store was created, on a queue of its own, so frames must be pushed from a thread
+ * with that context. Its copies are ordered after the caller's work with events, not
+ * by finishing either queue.
+ */
+class TieredFrameStore {
+    class StoredFrame {
+      public:
+        FrameTier tier;
+        // Empty while the frame is only in the scratch file
+        cv::UMat frame;
+        int rows;
+        int cols;
+        int type;
+        size_t bytes;
+        long slot = -1;
+        std::shared_future<void> spilling;
+        std::shared_future<cv::UMat> loading;
+    };
+
+    TieredFrameStoreConfig m_config;
+    // Ring of `m_num_frames` frames starting at `m_first_frame`, which is only
+    // reallocated if more frames are pushed than the capacity it was created with
+    std::vector<StoredFrame> m_frames;
+    size_t m_first_frame = 0;
+    size_t m_num_frames = 0;
+    size_t m_device_bytes = 0;
+    size_t m_host_bytes = 0;
+    size_t m_file_bytes = 0;
+    TieredFrameStoreStats m_stats;
+
+    // Scratch file, created on first use and split into equal sized slots
+    int m_fd = -1;
+    size_t m_slot_bytes = 0;
+    long m_num_slots = 0;
+    std::vector<long> m_free_slots;
+
+    // Scratch file worker, bound to the creating thread's OpenCL context (empty without
+    // OpenCL or a scratch file)
+    cv::ocl::OpenCLExecutionContext m_opencl_context;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_task_available;
+    bool m_stopping = false;
+    std::thread m_thread;
+
+    StoredFrame &frame_at(size_t index);
+    void run();
+    void submit(std::function<void()> task);
+    long allocate_slot(size_t bytes);
+    bool spill(StoredFrame &stored);
+    void prefetch(StoredFrame &stored);
+    void balance();
+    void update_peaks();
+  public:
+    /**
+     * `capacity` is the number of frames held without reallocating the queue
+     */
+    TieredFrameStore(TieredFrameStoreConfig config = TieredFrameStoreConfig(), size_t capacity = 32);
+    ~TieredFrameStore();
+
+    void push(cv::UMat frame);
+
+    /**
+     * The oldest frame, in device memory. Waits if it is still being prefetched.
+     */
+    cv::UMat front();
+    void pop();
+    size_t size();
+
+    TieredFrameStoreStats get_stats();
+};
+
+#endif // _TIERED_FRAME_STORE_HPP_
@@ -0,0 +1,280 @@
+#include "Tracer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core/ocl.hpp>
+
+#include "utils.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using namespace cv;
+
+// Device spans are resolved once this many are waiting, so that only a few frames of
+// OpenCL events are kept alive
+const size_t MAX_PENDING_DEVICE_SPANS = 64;
+
+const int HOST_PROCESS_ID = 1;
+const int DEVICE_PROCESS_ID = 2;
+
+class TraceEvent {
+  public:
+    string name;
+    int process_id;
+    int thread_id;
+    int64_t start_ns;
+    int64_t end_ns;
+};
+
+class PendingDeviceSpan {
+  public:
+    const char *name;
+    int thread_id;
+    cl_event start_marker;
+    cl_event end_marker;
+    int64_t device_to_host_ns;
+};
+
+static atomic<bool> trace_enabled(false);
+static string trace_path;
+static steady_clock::time_point trace_start;
+static mutex trace_mutex;
+static vector<TraceEvent> trace_events;
+static deque<PendingDeviceSpan> pending_device_spans;
+static atomic<int> num_threads(0);
+
+static thread_local int thread_index = -1;
+// The calling thread's OpenCL queue, if it records profiling information
+static thread_local cl_command_queue profiling_queue = NULL;
+// Offset from the device's profiling clock to nanoseconds since `trace_start`
+static thread_local int64_t device_to_host_ns = 0;
+
+static int get_thread_index() {
+    if (thread_index == -1) {
+        thread_index = num_threads++;
+    }
+    return thread_index;
+}
+
+static int64_t get_host_ns(steady_clock::time_point time) {
+    return duration_cast<nanoseconds>(time - trace_start).count();
+}
+
+static bool get_completion_time(cl_event event, cl_ulong &time) {
+    return clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time), &time, NULL) ==
+        CL_SUCCESS;
+}
+
+/**
+ * Wait for a device span's markers and record it. Failures only lose the span, so that
+ * tracing never stops the pipeline (and this can run in destructors).
+ */
+static void resolve_device_span(const PendingDeviceSpan &span) {
+    cl_ulong start = 0;
+    cl_ulong end = 0;
+    bool resolved = clWaitForEvents(1, &span.end_marker) == CL_SUCCESS &&
+        get_completion_time(span.start_marker, start) &&
+        get_completion_time(span.end_marker, end);
+    clReleaseEvent(span.start_marker);
+    clReleaseEvent(span.end_marker);
+    if (!resolved) {
+        cerr << "Failed to get OpenCL profiling information for " << span.name << "\n";
+        return;
+    }
+
+    TraceEvent event;
+    event.name = span.name;
+    event.process_id = DEVICE_PROCESS_ID;
+    event.thread_id = span.thread_id;
+    event.start_ns = start + span.device_to_host_ns;
+    event.end_ns = end + span.device_to_host_ns;
+    lock_guard<mutex> lock(trace_mutex);
+    trace_events.push_back(event);
+}
+
+static void write_trace() {
+    while (true) {
+        PendingDeviceSpan span;
+        {
+            lock_guard<mutex> lock(trace_mutex);
+            if (pending_device_spans.empty()) {
+                break;
+            }
+            span = pending_device_spans.front();
+            pending_device_spans.pop_front();
+        }
+        resolve_device_span(span);
+    }
+
+    lock_guard<mutex> lock(trace_mutex);
+    FILE *file = fopen(trace_path.c_str(), "w");
+    if (file == NULL) {
+        cerr << "Failed to open " << trace_path << " for the trace\n";
+        return;
+    }
+    stable_sort(
+        trace_events.begin(),
+        trace_events.end(),
+        [](const TraceEvent &a, const TraceEvent &b) { return a.start_ns < b.start_ns; }
+    );
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(
+        file,
+        "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"host\"}},\n"
+        "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"OpenCL device\"}}",
+        HOST_PROCESS_ID,
+        DEVICE_PROCESS_ID
+    );
+    for (int i = 0; i < num_threads; i++) {
+        fprintf(
+            file,
+            ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"thread %d\"}},\n"
+            "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"queue of thread %d\"}}",
+            HOST_PROCESS_ID, i, i,
+            DEVICE_PROCESS_ID, i, i
+        );
+    }
+    for (const TraceEvent &event : trace_events) {
+        // Chrome traces are in microseconds
+        fprintf(
+            file,
+            ",\n{\"name\": %s, \"ph\": \"X\", \"pid\": %d, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+            json_string(event.name).c_str(),
+            event.process_id,
+            event.thread_id,
+            event.start_ns / 1e3,
+            max<int64_t>(event.end_ns - event.start_ns, 0) / 1e3
+        );
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    cerr << "Wrote " << trace_events.size() << " trace events to " << trace_path << "\n";
+}
+
+void Tracer::enable(string path) {
+    if (trace_enabled) {
+        return;
+    }
+    trace_path = path;
+    trace_start = steady_clock::now();
+    trace_enabled = true;
+    atexit(write_trace);
+}
+
+bool Tracer::is_enabled() {
+    return trace_enabled;
+}
+
+void Tracer::enable_opencl_profiling() {
+    if (!trace_enabled || profiling_queue != NULL || !ocl::useOpenCL()) {
+        return;
+    }
+    ocl::OpenCLExecutionContext context = ocl::OpenCLExecutionContext::getCurrent();
+    if (context.empty()) {
+        return;
+    }
+    context.cloneWithNewQueue(context.getQueue().getProfilingQueue()).bind();
+
+    cl_command_queue queue = (cl_command_queue) ocl::Queue::getDefault().ptr();
+    cl_command_queue_properties properties = 0;
+    int err = clGetCommandQueueInfo(
+        queue,
+        CL_QUEUE_PROPERTIES,
+        sizeof(properties),
+        &properties,
+        NULL
+    );
+    if (err != CL_SUCCESS || !(properties & CL_QUEUE_PROFILING_ENABLE)) {
+        cerr << "Failed to enable OpenCL profiling, device activity won't be traced\n";
+        return;
+    }
+
+    // Line up the device clock with the host clock, using a marker that completes
+    // between two host times
+    cl_event marker;
+    steady_clock::time_point before = steady_clock::now();
+    err = clEnqueueMarkerWithWaitList(queue, 0, NULL, &marker);
+    if (err != CL_SUCCESS) {
+        cerr << "Failed to enqueue OpenCL profiling marker, device activity won't be traced\n";
+        return;
+    }
+    cl_ulong device_time = 0;
+    bool calibrated = clWaitForEvents(1, &marker) == CL_SUCCESS &&
+        get_completion_time(marker, device_time);
+    steady_clock::time_point after = steady_clock::now();
+    clReleaseEvent(marker);
+    if (!calibrated) {
+        cerr << "Failed to get OpenCL profiling information, device activity won't be traced\n";
+        return;
+    }
+    device_to_host_ns = (get_host_ns(before) + get_host_ns(after)) / 2 - (int64_t) device_time;
+    profiling_queue = queue;
+}
+
+void Tracer::add_host_span(const string &name, steady_clock::time_point start, steady_clock::time_point end) {
+    TraceEvent event;
+    event.name = name;
+    event.process_id = HOST_PROCESS_ID;
+    event.thread_id = get_thread_index();
+    event.start_ns = get_host_ns(start);
+    event.end_ns = get_host_ns(end);
+    lock_guard<mutex> lock(trace_mutex);
+    trace_events.push_back(event);
+}
+
+void Tracer::add_device_span(const char *name, cl_event start_marker, cl_event end_marker) {
+    PendingDeviceSpan oldest;
+    {
+        lock_guard<mutex> lock(trace_mutex);
+        pending_device_spans.push_back(
+            { name, get_thread_index(), start_marker, end_marker, device_to_host_ns }
+        );
+        if (pending_device_spans.size() <= MAX_PENDING_DEVICE_SPANS) {
+            return;
+        }
+        oldest = pending_device_spans.front();
+        pending_device_spans.pop_front();
+    }
+    // Usually long finished, so this rarely waits
+    resolve_device_span(oldest);
+}
+
+TraceSpan::TraceSpan(const char *name): m_name(name) {
+    if (Tracer::is_enabled()) {
+        m_start = steady_clock::now();
+    }
+}
+
+TraceSpan::~TraceSpan() {
+    if (Tracer::is_enabled()) {
+        Tracer::add_host_span(m_name, m_start, steady_clock::now());
+    }
+}
+
+TraceDeviceSpan::TraceDeviceSpan(const char *name): m_name(name) {
+    if (profiling_queue == NULL) {
+        return;
+    }
+    if (clEnqueueMarkerWithWaitList(profiling_queue, 0, NULL, &m_start_marker) != CL_SUCCESS) {
+        m_start_marker = NULL;
+    }
+}
+
+TraceDeviceSpan::~TraceDeviceSpan() {
+    if (m_start_marker == NULL) {
+        return;
+    }
+    cl_event end_marker;
+    if (clEnqueueMarkerWithWaitList(profiling_queue, 0, NULL, &end_marker) != CL_SUCCESS) {
+        clReleaseEvent(m_start_marker);
+        return;
+    }
+    Tracer::add_device_span(m_name, m_start_marker, end_marker);
+}
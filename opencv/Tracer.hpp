@@ -0,0 +1,70 @@
+#ifndef _TRACER_HPP_
+#define _TRACER_HPP_
+
+#include <string>
+#include <chrono>
+
+#include <CL/cl.h>
+
+/**
+ * Records a timeline of host and OpenCL device activity, written as a Chrome trace
+ * (viewable in chrome://tracing or Perfetto) when the program exits
+ *
+ * Host spans come from `Profiler`s and `TraceSpan`s. Device spans are measured between
+ * profiling markers on the calling thread's OpenCL queue, so asynchronous work shows up
+ * when the device runs it rather than when the host next blocks on it.
+ */
+class Tracer {
+  public:
+    /**
+     * Start recording, to write the trace to `path` at exit
+     */
+    static void enable(std::string path);
+    static bool is_enabled();
+
+    /**
+     * Replace the calling thread's OpenCL queue with one that records profiling
+     * information, if tracing is enabled. OpenCL queues are per thread, so each thread
+     * doing OpenCL work must call this before its first device span.
+     */
+    static void enable_opencl_profiling();
+
+    static void add_host_span(
+        const std::string &name,
+        std::chrono::steady_clock::time_point start,
+        std::chrono::steady_clock::time_point end
+    );
+
+    /**
+     * Add a span from the completion of `start_marker` to the completion of `end_marker`,
+     * taking ownership of the events
+     */
+    static void add_device_span(const char *name, cl_event start_marker, cl_event end_marker);
+};
+
+/**
+ * Records the host time from construction to destruction as a span, if tracing is
+ * enabled
+ */
+class TraceSpan {
+    const char *m_name;
+    std::chrono::steady_clock::time_point m_start;
+  public:
+    TraceSpan(const char *name);
+    ~TraceSpan();
+};
+
+/**
+ * Records the device time of the OpenCL commands enqueued on the calling thread's queue
+ * between construction and destruction, if `Tracer::enable_opencl_profiling()` was
+ * called on this thread
+ */
+class TraceDeviceSpan {
+    const char *m_name;
+    cl_event m_start_marker = NULL;
+  public:
+    TraceDeviceSpan(const char *name);
+    ~TraceDeviceSpan();
+};
+
+#endif // _TRACER_HPP_
@@ -0,0 +1,191 @@
+#include "Trajectory.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Eigen/Geometry>
+
+#include "MotionEstimator.hpp"
+#include "RotationSmoother.hpp"
+
+using namespace std;
+using namespace cv;
+
+TrajectoryWriter::TrajectoryWriter(string file_path, Size frame_size) {
+    m_file = fopen(file_path.c_str(), "wb");
+    if (m_file == NULL) {
+        cerr << "Failed to open trajectory file \"" << file_path << "\": " << strerror(errno) << endl;
+        throw errno;
+    }
+    memcpy(m_header.magic, TRAJECTORY_MAGIC, sizeof(m_header.magic));
+    m_header.version = TRAJECTORY_VERSION;
+    m_header.frame_record_size = sizeof(TrajectoryFrame);
+    m_header.num_frames = 0;
+    m_header.width = frame_size.width;
+    m_header.height = frame_size.height;
+    // Written again with the frame count by close()
+    if (fwrite(&m_header, sizeof(m_header), 1, m_file) != 1) {
+        int err = errno;
+        cerr << "Failed to write trajectory header: " << strerror(err) << endl;
+        fclose(m_file);
+        throw err;
+    }
+}
+
+void TrajectoryWriter::add_frame(double time, const Matx33d &orientation) {
+    Eigen::Quaterniond quaternion(eigen_mat_from_matx(orientation));
+    quaternion.normalize();
+    TrajectoryFrame frame;
+    frame.time = time;
+    frame.orientation[0] = quaternion.w();
+    frame.orientation[1] = quaternion.x();
+    frame.orientation[2] = quaternion.y();
+    frame.orientation[3] = quaternion.z();
+    if (fwrite(&frame, sizeof(frame), 1, m_file) != 1) {
+        cerr << "Failed to write trajectory: " << strerror(errno) << endl;
+        throw errno;
+    }
+    m_header.num_frames++;
+}
+
+void TrajectoryWriter::close() {
+    if (m_file == NULL) {
+        return;
+    }
+    FILE *file = m_file;
+    m_file = NULL;
+    if (fseek(file, 0, SEEK_SET) != 0 || fwrite(&m_header, sizeof(m_header), 1, file) != 1) {
+        int err = errno;
+        cerr << "Failed to write trajectory header: " << strerror(err) << endl;
+        fclose(file);
+        throw err;
+    }
+    // Buffered frames are only written out here, so this can fail too
+    if (fclose(file) != 0) {
+        int err = errno;
+        cerr << "Failed to close trajectory file: " << strerror(err) << endl;
+        throw err;
+    }
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    if (m_file != NULL) {
+        fclose(m_file);
+    }
+}
+
+Trajectory::Trajectory(string file_path) {
+    m_fd = open(file_path.c_str(), O_RDONLY);
+    if (m_fd == -1) {
+        cerr << "Failed to open trajectory file \"" << file_path << "\": " << strerror(errno) << endl;
+        throw errno;
+    }
+    struct stat file_stat;
+    if (fstat(m_fd, &file_stat) != 0) {
+        int err = errno;
+        cerr << "Failed to read the size of trajectory file \"" << file_path << "\": " << strerror(err) << endl;
+        close(m_fd);
+        throw err;
+    }
+    m_size = file_stat.st_size;
+    if (m_size < sizeof(TrajectoryHeader)) {
+        cerr << "Trajectory file \"" << file_path << "\" is truncated\n";
+        close(m_fd);
+        throw -1;
+    }
+    m_data = mmap(NULL, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (m_data == MAP_FAILED) {
+        cerr << "Failed to map trajectory file \"" << file_path << "\": " << strerror(errno) << endl;
+        close(m_fd);
+        throw errno;
+    }
+
+    m_header = (const TrajectoryHeader *) m_data;
+    m_frames = (const char *) m_data + sizeof(TrajectoryHeader);
+    if (
+        memcmp(m_header->magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0 ||
+        m_header->version != TRAJECTORY_VERSION ||
+        m_header->frame_record_size < sizeof(TrajectoryFrame) ||
+        sizeof(TrajectoryHeader) + m_header->num_frames * m_header->frame_record_size > m_size
+    ) {
+        cerr << "\"" << file_path << "\" is not a valid trajectory file\n";
+        munmap(m_data, m_size);
+        close(m_fd);
+        throw -1;
+    }
+}
+
+Trajectory::~Trajectory() {
+    munmap(m_data, m_size);
+    close(m_fd);
+}
+
+size_t Trajectory::size() {
+    return m_header->num_frames;
+}
+
+Size Trajectory::get_frame_size() {
+    return Size(m_header->width, m_header->height);
+}
+
+double Trajectory::get_time(size_t index) {
+    const TrajectoryFrame *frame = (const TrajectoryFrame *) (m_frames + index * m_header->frame_record_size);
+    return frame->time;
+}
+
+Matx33d Trajectory::get_orientation(size_t index) {
+    const TrajectoryFrame *frame = (const TrajectoryFrame *) (m_frames + index * m_header->frame_record_size);
+    Eigen::Quaterniond quaternion(
+        frame->orientation[0],
+        frame->orientation[1],
+        frame->orientation[2],
+        frame->orientation[3]
+    );
+    return matx_from_eigen_mat(quaternion.normalized().toRotationMatrix());
+}
+
+vector<Matx33d> smooth_orientations(const vector<Matx33d> &orientations, int smooth_radius) {
+    // Replays FrameSourceWarp::pull_frame: the filter is fed until it's `smooth_radius`
+    // frames ahead of the output, and once input runs out, fed the last orientation
+    // again for every output frame. So output i is the filter's output after it was fed
+    // `min(smooth_radius, n) + i + 1` orientations.
+    if (orientations.empty()) {
+        return vector<Matx33d>();
+    }
+    size_t num_ahead = min((size_t) smooth_radius, orientations.size());
+    vector<Eigen::Matrix3d> fed;
+    for (const Matx33d &orientation : orientations) {
+        fed.push_back(eigen_mat_from_matx(orientation));
+    }
+    for (size_t i = 0; i < num_ahead; i++) {
+        fed.push_back(fed[orientations.size() - 1]);
+    }
+    vector<Eigen::Matrix3d> filtered = RotationSmoother::smooth(fed, smooth_radius);
+    vector<Matx33d> smoothed;
+    for (size_t i = 0; i < orientations.size(); i++) {
+        smoothed.push_back(matx_from_eigen_mat(filtered[num_ahead + i]));
+    }
+    return smoothed;
+}
+
+vector<Matx33d> get_warp_rotations(Trajectory &trajectory, int smooth_radius) {
+    vector<Matx33d> orientations;
+    for (size_t i = 1; i < trajectory.size(); i++) {
+        orientations.push_back(trajectory.get_orientation(i));
+    }
+    vector<Matx33d> smoothed = smooth_orientations(orientations, smooth_radius);
+    vector<Matx33d> warp_rotations;
+    warp_rotations.push_back(Matx33d::eye());
+    for (size_t i = 0; i < orientations.size(); i++) {
+        // The inverse of the correction `smoothed * orientation^-1`, as in FrameSourceWarp
+        warp_rotations.push_back(orientations[i] * smoothed[i].t());
+    }
+    return warp_rotations;
+}
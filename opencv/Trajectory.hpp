@@ -0,0 +1,107 @@
+#ifndef _TRAJECTORY_HPP_
+#define _TRAJECTORY_HPP_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/**
+ * Binary camera trajectory files
+ *
+ * A file is a `TrajectoryHeader` followed by one `TrajectoryFrame` per input frame, in
+ * native (little endian) byte order, so that it can be memory mapped and read in place.
+ */
+
+const char TRAJECTORY_MAGIC[8] = { 'D', 'W', 'B', 'L', 'T', 'R', 'A', 'J' };
+const uint32_t TRAJECTORY_VERSION = 1;
+
+class TrajectoryHeader {
+  public:
+    char magic[8];
+    uint32_t version;
+    // Size of each TrajectoryFrame, so readers can skip fields added later
+    uint32_t frame_record_size;
+    uint64_t num_frames;
+    // Size of the analysed input frames
+    int32_t width;
+    int32_t height;
+};
+
+class TrajectoryFrame {
+  public:
+    // Presentation time in seconds, or NaN if unknown
+    double time;
+    // Camera orientation relative to the first frame, as a unit quaternion (w, x, y, z)
+    double orientation[4];
+};
+
+static_assert(sizeof(TrajectoryHeader) == 32, "TrajectoryHeader must not be padded");
+static_assert(sizeof(TrajectoryFrame) == 40, "TrajectoryFrame must not be padded");
+
+/**
+ * Appends frames to a trajectory file. The frame count in the header is written by
+ * `close`, which must be called for the file to be complete.
+ */
+class TrajectoryWriter {
+    FILE *m_file;
+    TrajectoryHeader m_header;
+  public:
+    TrajectoryWriter(std::string file_path, cv::Size frame_size);
+    void add_frame(double time, const cv::Matx33d &orientation);
+
+    /**
+     * Write the frame count and close the file, throwing if either fails
+     */
+    void close();
+
+    /**
+     * Closes the file if `close` wasn't called, without reporting errors, e.g. while
+     * unwinding from an error which left the trajectory incomplete anyway
+     */
+    ~TrajectoryWriter();
+};
+
+/**
+ * A memory mapped trajectory file
+ */
+class Trajectory {
+    int m_fd = -1;
+    void *m_data = NULL;
+    size_t m_size = 0;
+    const TrajectoryHeader *m_header;
+    const char *m_frames;
+  public:
+    Trajectory(std::string file_path);
+    ~Trajectory();
+
+    size_t size();
+    cv::Size get_frame_size();
+    double get_time(size_t index);
+
+    /**
+     * Orientation of frame `index` relative to the first frame, as a rotation matrix
+     */
+    cv::Matx33d get_orientation(size_t index);
+};
+
+/**
+ * Smooth a sequence of camera orientations with the same Savitzky-Golay filter and
+ * padding at the end of the video as `FrameSourceWarp`, so that warping frame `i` with
+ * `smoothed[i] * orientations[i].t()` gives the same output
+ */
+std::vector<cv::Matx33d> smooth_orientations(
+  const std::vector<cv::Matx33d> &orientations,
+  int smooth_radius
+);
+
+/**
+ * The rotation of the output camera which stabilises each frame of a trajectory.
+ * Like `FrameSourceWarp`, the first frame is only used as the reference orientation,
+ * so its rotation is the identity.
+ */
+std::vector<cv::Matx33d> get_warp_rotations(Trajectory &trajectory, int smooth_radius);
+
+#endif // _TRAJECTORY_HPP_
@@ -0,0 +1,294 @@
+#include "VideoEncoder.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <opencv2/imgproc.hpp>
+
+#include "utils.hpp"
+
+using namespace cv;
+using namespace std;
+
+VideoEncoder::VideoEncoder(
+    string file_path,
+    Size size,
+    AVRational time_base,
+    string encoder_name,
+    string options
+) {
+    int err;
+
+    AVCodec *encoder = avcodec_find_encoder_by_name(encoder_name.c_str());
+    if (!encoder) {
+        cerr << "Failed to find encoder " << encoder_name << "\n";
+        throw AVERROR_ENCODER_NOT_FOUND;
+    }
+
+    err = avformat_alloc_output_context2(&this->format_ctx, NULL, NULL, file_path.c_str());
+    if (err < 0) {
+        cerr << "Failed to create output context:" << errString(err) << "\n";
+        throw err;
+    }
+
+    this->encoder_ctx = avcodec_alloc_context3(encoder);
+    if (!this->encoder_ctx) {
+        err = AVERROR(ENOMEM);
+        cerr << "Failed to allocate encoder context:" << errString(err) << "\n";
+        throw err;
+    }
+    // 4:2:0 chroma subsampling needs even dimensions
+    this->encoder_ctx->width = size.width & ~1;
+    this->encoder_ctx->height = size.height & ~1;
+    this->encoder_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    this->encoder_ctx->time_base = time_base;
+    if (this->format_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
+        this->encoder_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    AVDictionary *encoder_options = NULL;
+    err = av_dict_parse_string(&encoder_options, options.c_str(), "=", ":", 0);
+    if (err < 0) {
+        cerr << "Failed to parse encoder options \"" << options << "\":" << errString(err) << "\n";
+        av_dict_free(&encoder_options);
+        throw err;
+    }
+    err = avcodec_open2(this->encoder_ctx, encoder, &encoder_options);
+    av_dict_free(&encoder_options);
+    if (err < 0) {
+        cerr << "Failed to open codec for encoding:" << errString(err) << "\n";
+        throw err;
+    }
+
+    this->stream = avformat_new_stream(this->format_ctx, NULL);
+    if (!this->stream) {
+        err = AVERROR(ENOMEM);
+        cerr << "Failed to create output stream:" << errString(err) << "\n";
+        throw err;
+    }
+    this->stream->time_base = time_base;
+    err = avcodec_parameters_from_context(this->stream->codecpar, this->encoder_ctx);
+    if (err < 0) {
+        cerr << "avcodec_parameters_from_context error:" << errString(err) << "\n";
+        throw err;
+    }
+
+    err = avio_open(&this->format_ctx->pb, file_path.c_str(), AVIO_FLAG_WRITE);
+    if (err < 0) {
+        cerr << "Failed to open output file:" << errString(err) << "\n";
+        throw err;
+    }
+    err = avformat_write_header(this->format_ctx, NULL);
+    if (err < 0) {
+        cerr << "Failed to write output header:" << errString(err) << "\n";
+        throw err;
+    }
+
+    this->frame = av_frame_alloc();
+    this->frame->format = this->encoder_ctx->pix_fmt;
+    this->frame->width = this->encoder_ctx->width;
+    this->frame->height = this->encoder_ctx->height;
+    this->packet = av_packet_alloc();
+}
+
+VideoEncoder::~VideoEncoder() {
+    if (this->format_ctx && this->format_ctx->pb) {
+        avio_closep(&this->format_ctx->pb);
+    }
+    avformat_free_context(this->format_ctx);
+    avcodec_free_context(&this->encoder_ctx);
+    av_frame_free(&this->frame);
+    av_packet_free(&this->packet);
+}
+
+void VideoEncoder::write_packets() {
+    int err;
+    while (true) {
+        err = avcodec_receive_packet(this->encoder_ctx, this->packet);
+        if (err == AVERROR(EAGAIN) || err == AVERROR_EOF) {
+            return;
+        }
+        if (err < 0) {
+            cerr << "Failed to encode frame:" << errString(err) << "\n";
+            throw err;
+        }
+        av_packet_rescale_ts(this->packet, this->encoder_ctx->time_base, this->stream->time_base);
+        this->packet->stream_index = this->stream->index;
+        err = av_interleaved_write_frame(this->format_ctx, this->packet);
+        if (err < 0) {
+            cerr << "Failed to write packet:" << errString(err) << "\n";
+            throw err;
+        }
+    }
+}
+
+void VideoEncoder::write_frame(UMat bgr_frame, int64_t pts) {
+    int width = this->encoder_ctx->width;
+    int height = this->encoder_ctx->height;
+    cvtColor(bgr_frame(Rect(0, 0, width, height)), this->yuv_frame, COLOR_BGR2YUV_I420);
+
+    // The encoder may still reference the last frame's buffers
+    int err = av_frame_make_writable(this->frame);
+    if (err == 0 && this->frame->data[0] == NULL) {
+        err = av_frame_get_buffer(this->frame, 0);
+    }
+    if (err < 0) {
+        cerr << "Failed to allocate frame:" << errString(err) << "\n";
+        throw err;
+    }
+
+    // I420 is the Y plane followed by the U and V planes, without padding
+    const uchar *plane = this->yuv_frame.ptr();
+    int plane_widths[3] = { width, width / 2, width / 2 };
+    int plane_heights[3] = { height, height / 2, height / 2 };
+    for (int i = 0; i < 3; i++) {
+        for (int y = 0; y < plane_heights[i]; y++) {
+            memcpy(this->frame->data[i] + y * this->frame->linesize[i], plane, plane_widths[i]);
+            plane += plane_widths[i];
+        }
+    }
+    this->frame->pts = pts;
+
+    err = avcodec_send_frame(this->encoder_ctx, this->frame);
+    if (err < 0) {
+        cerr << "Failed to encode frame:" << errString(err) << "\n";
+        throw err;
+    }
+    this->write_packets();
+}
+
+void VideoEncoder::close() {
+    if (this->closed) {
+        return;
+    }
+    this->closed = true;
+    int err = avcodec_send_frame(this->encoder_ctx, NULL);
+    if (err < 0) {
+        cerr << "Failed to flush encoder:" << errString(err) << "\n";
+        throw err;
+    }
+    this->write_packets();
+    err = av_write_trailer(this->format_ctx);
+    if (err < 0) {
+        cerr << "Failed to write output trailer:" << errString(err) << "\n";
+        throw err;
+    }
+}
+
+/**
+ * Copy the first stream's packets from `input_ctx` to `output_ctx`, creating the
+ * output stream and writing the header if this is the first input
+ */
+static void append_segment(
+    AVFormatContext *input_ctx,
+    AVFormatContext *output_ctx,
+    const string &output_path,
+    int64_t &last_dts
+) {
+    int err;
+    AVStream *input_stream = input_ctx->streams[0];
+    if (output_ctx->nb_streams == 0) {
+        AVStream *output_stream = avformat_new_stream(output_ctx, NULL);
+        if (!output_stream) {
+            err = AVERROR(ENOMEM);
+            cerr << "Failed to create output stream:" << errString(err) << "\n";
+            throw err;
+        }
+        err = avcodec_parameters_copy(output_stream->codecpar, input_stream->codecpar);
+        if (err < 0) {
+            cerr << "Failed to copy stream parameters:" << errString(err) << "\n";
+            throw err;
+        }
+        // Let the muxer choose a tag valid for the output container
+        output_stream->codecpar->codec_tag = 0;
+        output_stream->time_base = input_stream->time_base;
+        err = avio_open(&output_ctx->pb, output_path.c_str(), AVIO_FLAG_WRITE);
+        if (err < 0) {
+            cerr << "Failed to open output file:" << errString(err) << "\n";
+            throw err;
+        }
+        err = avformat_write_header(output_ctx, NULL);
+        if (err < 0) {
+            cerr << "Failed to write output header:" << errString(err) << "\n";
+            throw err;
+        }
+    }
+    AVStream *output_stream = output_ctx->streams[0];
+
+    AVPacket packet;
+    while ((err = av_read_frame(input_ctx, &packet)) >= 0) {
+        if (packet.stream_index != 0) {
+            av_packet_unref(&packet);
+            continue;
+        }
+        av_packet_rescale_ts(&packet, input_stream->time_base, output_stream->time_base);
+        // Segments keep the input's timestamps, but encoder delay can make a segment's
+        // first decode timestamps overlap the previous segment's last ones. Only the
+        // decode timestamps are moved, so presentation times are unchanged, and they
+        // can't be moved after the presentation time.
+        if (packet.dts != AV_NOPTS_VALUE) {
+            if (last_dts != AV_NOPTS_VALUE) {
+                packet.dts = max(packet.dts, last_dts + 1);
+            }
+            if (packet.pts != AV_NOPTS_VALUE) {
+                packet.dts = min(packet.dts, packet.pts);
+            }
+            last_dts = packet.dts;
+        }
+        packet.stream_index = output_stream->index;
+        err = av_interleaved_write_frame(output_ctx, &packet);
+        if (err < 0) {
+            cerr << "Failed to write packet:" << errString(err) << "\n";
+            throw err;
+        }
+    }
+    if (err != AVERROR_EOF) {
+        cerr << "Failed to read packet:" << errString(err) << "\n";
+        throw err;
+    }
+}
+
+void concatenate_videos(vector<string> input_paths, string output_path) {
+    int err;
+    AVFormatContext *output_ctx = NULL;
+    err = avformat_alloc_output_context2(&output_ctx, NULL, NULL, output_path.c_str());
+    if (err < 0) {
+        cerr << "Failed to create output context:" << errString(err) << "\n";
+        throw err;
+    }
+
+    AVFormatContext *input_ctx = NULL;
+    try {
+        int64_t last_dts = AV_NOPTS_VALUE;
+        for (string input_path : input_paths) {
+            err = avformat_open_input(&input_ctx, input_path.c_str(), NULL, NULL);
+            if (err) {
+                cerr << "Failed to open input file:" << errString(err) << "\n";
+                throw err;
+            }
+            err = avformat_find_stream_info(input_ctx, NULL);
+            if (err < 0) {
+                cerr << "Failed to find input stream information:" << errString(err) << "\n";
+                throw err;
+            }
+            append_segment(input_ctx, output_ctx, output_path, last_dts);
+            avformat_close_input(&input_ctx);
+        }
+
+        if (output_ctx->pb != NULL) {
+            err = av_write_trailer(output_ctx);
+            if (err < 0) {
+                cerr << "Failed to write output trailer:" << errString(err) << "\n";
+                throw err;
+            }
+        }
+    } catch (...) {
+        avformat_close_input(&input_ctx);
+        avio_closep(&output_ctx->pb);
+        avformat_free_context(output_ctx);
+        throw;
+    }
+    avio_closep(&output_ctx->pb);
+    avformat_free_context(output_ctx);
+}
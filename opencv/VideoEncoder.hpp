@@ -0,0 +1,60 @@
+#ifndef _VIDEO_ENCODER_HPP_
+#define _VIDEO_ENCODER_HPP_
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+extern "C" {
+    #include <libavformat/avformat.h>
+    #include <libavcodec/avcodec.h>
+}
+
+/**
+ * Encodes BGR frames to a video file with a software (system memory) encoder
+ *
+ * Frames are converted to YUV 4:2:0, and cropped to even dimensions if necessary.
+ */
+class VideoEncoder {
+    AVFormatContext *format_ctx = NULL;
+    AVCodecContext *encoder_ctx = NULL;
+    AVStream *stream = NULL;
+    AVFrame *frame = NULL;
+    AVPacket *packet = NULL;
+    cv::Mat yuv_frame;
+    bool closed = false;
+
+    void write_packets();
+  public:
+    /**
+     * `options` are `key=value` pairs separated by `:`, passed to the encoder
+     * (e.g. "crf=18:preset=fast" for libx264)
+     */
+    VideoEncoder(
+      std::string file_path,
+      cv::Size size,
+      AVRational time_base,
+      std::string encoder_name = "libx264",
+      std::string options = ""
+    );
+
+    /**
+     * Encode a frame with a presentation timestamp in the `time_base` units
+     */
+    void write_frame(cv::UMat bgr_frame, int64_t pts);
+
+    /**
+     * Flush the encoder and finish the file
+     */
+    void close();
+    ~VideoEncoder();
+};
+
+/**
+ * Concatenate videos with the same (single) stream parameters into one file, copying
+ * the packets without reencoding
+ */
+void concatenate_videos(std::vector<std::string> input_paths, std::string output_path);
+
+#endif // _VIDEO_ENCODER_HPP_
@@ -0,0 +1,288 @@
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/calib3d.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <string>
+
+#include "AvFrameSourceAsync.hpp"
+#include "AvFrameSourceSynthetic.hpp"
+#include "Camera.hpp"
+#include "FrameSourceFfmpegSw.hpp"
+#include "FrameSourceWarp.hpp"
+
+using namespace cv;
+using namespace std;
+using namespace std::chrono;
+
+/**
+ * Runs FrameSourceWarp on synthetic fisheye videos with a known camera motion, in each
+ * stabilisation and motion estimation mode, and compares the measured orientation of
+ * every frame with the true one, alongside the frames/s
+ *
+ * Exits with status 1 if any run's errors (or speed, with --min-fps) are outside the
+ * thresholds, so that an optimisation can show it didn't make stabilisation worse.
+ */
+
+struct Sequence {
+    const char *name;
+    SyntheticMotion motion;
+};
+
+struct Mode {
+    const char *name;
+    StabiliseMode stabilise_mode;
+    int motion_queue_frames;
+    double analysis_scale;
+};
+
+struct Thresholds {
+    // In degrees
+    double max_mean_step_error = 0.05;
+    double max_step_error = 0.5;
+    double max_drift = 1;
+    double min_fps = 0;
+};
+
+struct Result {
+    long num_frames = 0;
+    double fps = 0;
+    double mean_step_error = 0;
+    double max_step_error = 0;
+    double max_drift = 0;
+};
+
+SyntheticMotion create_motion(Vec3d pan_rate, Vec3d shake_amplitude, double shake_frequency) {
+    SyntheticMotion motion;
+    motion.pan_rate = pan_rate;
+    motion.shake_amplitude = shake_amplitude;
+    motion.shake_frequency = shake_frequency;
+    return motion;
+}
+
+/**
+ * Angle in degrees of the rotation between two rotations
+ */
+double angular_error(Matx33d estimated, Matx33d actual) {
+    Vec3d difference;
+    Rodrigues(Mat(estimated * actual.t()), difference);
+    return norm(difference) * 180 / CV_PI;
+}
+
+Result run(
+    const Sequence &sequence,
+    const Mode &mode,
+    Size size,
+    long num_frames,
+    WarpMode warp_mode,
+    FILE *per_frame_file
+) {
+    Camera camera = get_preset_camera(GOPRO_H4B_WIDE43_MEASURED, size);
+    auto synthetic_source = make_shared<AvFrameSourceSynthetic>(camera, sequence.motion, num_frames);
+    FrameSourceWarp warped_source(
+        make_shared<FrameSourceFfmpegSw>(make_shared<AvFrameSourceAsync>(synthetic_source, 8, "synthetic-read-ahead")),
+        GOPRO_H4B_WIDE43_MEASURED,
+        0.5,
+        false,
+        1.0,
+        30,
+        INTER_LINEAR,
+        warp_mode,
+        0,
+        mode.analysis_scale,
+        TieredFrameStoreConfig(),
+        mode.stabilise_mode,
+        mode.motion_queue_frames
+    );
+
+    // The pipeline measures orientations relative to the first frame: with `O` the
+    // camera to world rotations, frame i's is `O_i^T * O_0`
+    Matx33d first_orientation = synthetic_source->get_orientation(0);
+    Matx33d last_measured = Matx33d::eye();
+    Matx33d last_actual = Matx33d::eye();
+
+    Result result;
+    steady_clock::time_point start;
+    while (true) {
+        try {
+            warped_source.pull_frame();
+            if (ocl::useOpenCL()) {
+                ocl::finish();
+            }
+        } catch (int err) {
+            if (err == EOF) {
+                break;
+            }
+            throw err;
+        }
+        // Time from the first output frame, so that filling the lookahead isn't counted
+        if (result.num_frames == 0) {
+            start = steady_clock::now();
+        }
+        long index = result.num_frames + 1;
+        Matx33d measured = warped_source.get_frame_orientation();
+        Matx33d actual = synthetic_source->get_orientation(index).t() * first_orientation;
+
+        double step_error = angular_error(measured * last_measured.t(), actual * last_actual.t());
+        double drift = angular_error(measured, actual);
+        result.mean_step_error += step_error;
+        result.max_step_error = max(result.max_step_error, step_error);
+        result.max_drift = max(result.max_drift, drift);
+        if (per_frame_file != NULL) {
+            fprintf(
+                per_frame_file,
+                "%s,%s,%ld,%.5f,%.5f\n",
+                sequence.name,
+                mode.name,
+                index,
+                step_error,
+                drift
+            );
+        }
+        last_measured = measured;
+        last_actual = actual;
+        result.num_frames++;
+    }
+    double seconds = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+    if (result.num_frames > 1) {
+        result.fps = (result.num_frames - 1) / seconds;
+    }
+    if (result.num_frames > 0) {
+        result.mean_step_error /= result.num_frames;
+    }
+    return result;
+}
+
+bool check(const Result &result, const Thresholds &thresholds, long num_frames) {
+    // Every frame but the reference should come out
+    return result.num_frames == num_frames - 1 &&
+        result.mean_step_error <= thresholds.max_mean_step_error &&
+        result.max_step_error <= thresholds.max_step_error &&
+        result.max_drift <= thresholds.max_drift &&
+        result.fps >= thresholds.min_fps;
+}
+
+void print_usage(char *program) {
+    cout << "\n\tUsage: " << program << " [options]\n\n" <<
+        "\t--size=WxH                 Frame size (default 1280x960)\n" <<
+        "\t--frames=N                 Frames per sequence (default 150)\n" <<
+        "\t--warp=MODE                maps, maps-fixed, fused, mesh or cpu (default maps, or cpu without OpenCL)\n" <<
+        "\t--no-opencl                Don't use OpenCL, even if it's available\n" <<
+        "\t--per-frame=FILE           Write the errors of every frame to a CSV FILE\n" <<
+        "\t--max-mean-step-error=DEG  Fail if the mean frame to frame error is larger (default 0.05)\n" <<
+        "\t--max-step-error=DEG       Fail if any frame to frame error is larger (default 0.5)\n" <<
+        "\t--max-drift=DEG            Fail if the accumulated error is ever larger (default 1)\n" <<
+        "\t--min-fps=F                Fail if slower than F frames/s (default 0: never)\n\n";
+}
+
+int main(int argc, char *argv[]) {
+    Size size(1280, 960);
+    long num_frames = 150;
+    string warp = "";
+    WarpMode warp_mode = WARP_MODE_MAPS;
+    bool use_opencl = true;
+    string per_frame_path;
+    Thresholds thresholds;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        size_t equals = arg.find('=');
+        string name = arg.substr(0, equals);
+        string value = equals == string::npos ? "" : arg.substr(equals + 1);
+        if (name == "--size") {
+            if (sscanf(value.c_str(), "%dx%d", &size.width, &size.height) != 2) {
+                cerr << "Invalid frame size: " << value << "\n";
+                return 1;
+            }
+        } else if (name == "--frames") {
+            num_frames = stol(value);
+        } else if (name == "--warp" && parse_warp_mode(value, warp_mode)) {
+            warp = value;
+        } else if (name == "--no-opencl") {
+            use_opencl = false;
+        } else if (name == "--per-frame") {
+            per_frame_path = value;
+        } else if (name == "--max-mean-step-error") {
+            thresholds.max_mean_step_error = stod(value);
+        } else if (name == "--max-step-error") {
+            thresholds.max_step_error = stod(value);
+        } else if (name == "--max-drift") {
+            thresholds.max_drift = stod(value);
+        } else if (name == "--min-fps") {
+            thresholds.min_fps = stod(value);
+        } else {
+            cerr << "Unknown option: " << arg << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!select_opencl_and_warp_mode(use_opencl, warp, warp_mode)) {
+        return 1;
+    }
+    use_opencl = ocl::useOpenCL();
+
+    Sequence sequences[] = {
+        { "pan", create_motion(Vec3d(0, 0.2, 0), Vec3d(0.005, 0.005, 0.002), 1) },
+        { "shake", create_motion(Vec3d(0, 0.05, 0), Vec3d(0.03, 0.03, 0.015), 3) },
+        { "roll", create_motion(Vec3d(0, 0, 0.3), Vec3d(0.01, 0.01, 0.01), 2) },
+    };
+    Mode modes[] = {
+        { "smooth", STABILISE_MODE_SMOOTH, 4, 1 },
+        { "smooth-sync", STABILISE_MODE_SMOOTH, 0, 1 },
+        { "smooth-half", STABILISE_MODE_SMOOTH, 4, 0.5 },
+        { "kalman", STABILISE_MODE_KALMAN, 4, 1 },
+    };
+
+    FILE *per_frame_file = NULL;
+    if (!per_frame_path.empty()) {
+        per_frame_file = fopen(per_frame_path.c_str(), "w");
+        if (per_frame_file == NULL) {
+            cerr << "Failed to open " << per_frame_path << "\n";
+            return 1;
+        }
+        fprintf(per_frame_file, "sequence,mode,frame,step_error_deg,drift_deg\n");
+    }
+
+    printf(
+        "opencl: %s size: %dx%d frames: %ld warp: %s\n\n",
+        use_opencl ? ocl::Device::getDefault().name().c_str() : "none",
+        size.width,
+        size.height,
+        num_frames,
+        warp.c_str()
+    );
+    printf(
+        "%-8s %-12s %8s %10s %14s %13s %14s %6s\n",
+        "sequence", "mode", "frames", "fps", "mean_step_deg", "max_step_deg", "max_drift_deg", "result"
+    );
+    bool passed = true;
+    for (const Sequence &sequence : sequences) {
+        for (const Mode &mode : modes) {
+            Result result = run(sequence, mode, size, num_frames, warp_mode, per_frame_file);
+            bool ok = check(result, thresholds, num_frames);
+            passed = passed && ok;
+            printf(
+                "%-8s %-12s %8ld %10.2f %14.4f %13.4f %14.4f %6s\n",
+                sequence.name,
+                mode.name,
+                result.num_frames,
+                result.fps,
+                result.mean_step_error,
+                result.max_step_error,
+                result.max_drift,
+                ok ? "ok" : "FAIL"
+            );
+            fflush(stdout);
+        }
+    }
+    if (per_frame_file != NULL) {
+        fclose(per_frame_file);
+    }
+
+    printf("\n%s\n", passed ? "passed" : "FAILED");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+#include "analysis.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "AvFrameSourceFileSw.hpp"
+#include "FrameSourceFfmpegSw.hpp"
+#include "MotionEstimator.hpp"
+#include "Trajectory.hpp"
+#include "utils.hpp"
+
+using namespace std;
+using namespace cv;
+
+long analyse_trajectory(
+    shared_ptr<FrameSource> source,
+    string trajectory_path,
+    CameraPreset input_camera,
+    double output_scale,
+    double analysis_scale
+) {
+    UMat first_frame = source->peek_frame();
+    Camera camera = get_preset_camera(
+        input_camera,
+        Size(first_frame.cols, first_frame.rows * 2 / 3)
+    );
+    MotionEstimator motion_estimator(
+        camera,
+        analysis_scale,
+        get_inlier_threshold(camera, output_scale)
+    );
+    TrajectoryWriter writer(trajectory_path, camera.size);
+
+    while (true) {
+        UMat frame;
+        try {
+            frame = source->pull_frame();
+        } catch (int err) {
+            if (err == EOF) {
+                break;
+            }
+            throw err;
+        }
+        Matx33d orientation = motion_estimator.add_frame(frame);
+        writer.add_frame(source->get_frame_time(), orientation);
+    }
+    writer.close();
+    return motion_estimator.get_num_frames();
+}
+
+// Chunks per worker, so that workers which get easy chunks can pick up more
+const int CHUNKS_PER_WORKER = 4;
+
+class AnalysedChunk {
+  public:
+    Size frame_size;
+    vector<double> times;
+    // Orientations relative to the chunk's first frame
+    vector<Matx33d> orientations;
+};
+
+/**
+ * Analyse the frames from the keyframe at `start` up to and including the frame at `end`
+ * (both in `time_base` units)
+ */
+static AnalysedChunk analyse_chunk(
+    string video_path,
+    AVRational time_base,
+    int64_t start,
+    int64_t end,
+    CameraPreset input_camera,
+    double output_scale,
+    double analysis_scale
+) {
+    // Parallelism comes from the chunks, so decode each on a single thread
+    auto av_source = make_shared<AvFrameSourceFileSw>(video_path, 1);
+    av_source->seek(start);
+    FrameSourceFfmpegSw source(av_source);
+    double start_time = start * av_q2d(time_base);
+    double end_time = end == INT64_MAX ? INFINITY : end * av_q2d(time_base);
+
+    AnalysedChunk chunk;
+    shared_ptr<MotionEstimator> motion_estimator;
+    while (true) {
+        UMat frame;
+        try {
+            frame = source.pull_frame();
+        } catch (int err) {
+            if (err == EOF) {
+                break;
+            }
+            throw err;
+        }
+        double time = source.get_frame_time();
+        if (std::isnan(time)) {
+            cerr << "Frames without timestamps can't be analysed in chunks\n";
+            throw -1;
+        }
+        if (time < start_time) {
+            continue;
+        }
+        if (time > end_time) {
+            break;
+        }
+
+        if (!motion_estimator) {
+            Camera camera = get_preset_camera(input_camera, Size(frame.cols, frame.rows * 2 / 3));
+            motion_estimator = make_shared<MotionEstimator>(
+                camera,
+                analysis_scale,
+                get_inlier_threshold(camera, output_scale)
+            );
+            chunk.frame_size = camera.size;
+        }
+        chunk.times.push_back(time);
+        chunk.orientations.push_back(motion_estimator->add_frame(frame));
+    }
+    return chunk;
+}
+
+long analyse_trajectory_parallel(
+    string video_path,
+    string trajectory_path,
+    CameraPreset input_camera,
+    double output_scale,
+    double analysis_scale,
+    int num_workers
+) {
+    if (num_workers <= 0) {
+        num_workers = max(1u, thread::hardware_concurrency());
+    }
+
+    // Chunks start at evenly spaced keyframes, and end at the next chunk's first frame
+    AVRational time_base;
+    vector<int64_t> chunk_starts = find_keyframe_timestamps(
+        video_path,
+        &time_base,
+        num_workers * CHUNKS_PER_WORKER
+    );
+    if (chunk_starts.empty()) {
+        cerr << "No keyframes found in " << video_path << "\n";
+        throw -1;
+    }
+    size_t num_chunks = chunk_starts.size();
+    cerr << "Analysing " << num_chunks << " chunks on " << num_workers << " threads\n";
+
+    vector<AnalysedChunk> chunks(num_chunks);
+    vector<exception_ptr> errors(num_chunks);
+    atomic<size_t> next_chunk(0);
+    vector<thread> workers;
+    for (int i = 0; i < num_workers; i++) {
+        workers.push_back(thread([&]() {
+            size_t chunk_index;
+            while ((chunk_index = next_chunk++) < num_chunks) {
+                try {
+                    chunks[chunk_index] = analyse_chunk(
+                        video_path,
+                        time_base,
+                        chunk_starts[chunk_index],
+                        chunk_index + 1 < num_chunks ? chunk_starts[chunk_index + 1] : INT64_MAX,
+                        input_camera,
+                        output_scale,
+                        analysis_scale
+                    );
+                } catch (...) {
+                    errors[chunk_index] = current_exception();
+                }
+            }
+        }));
+    }
+    for (thread &worker : workers) {
+        worker.join();
+    }
+    for (exception_ptr error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+
+    // Each chunk's first frame is the previous chunk's last frame, so its orientation
+    // relative to the start of the video is already known
+    TrajectoryWriter writer(trajectory_path, chunks[0].frame_size);
+    Matx33d chunk_start_orientation = Matx33d::eye();
+    double last_time = NAN;
+    long num_frames = 0;
+    for (size_t i = 0; i < num_chunks; i++) {
+        AnalysedChunk &chunk = chunks[i];
+        if (chunk.times.empty()) {
+            continue;
+        }
+        size_t first_frame = 0;
+        if (num_frames > 0) {
+            if (chunk.times[0] != last_time) {
+                cerr << "Chunk at " << chunk.times[0] << "s doesn't overlap the previous chunk, " <<
+                    "the trajectory may jump\n";
+            }
+            first_frame = 1;
+        }
+        for (size_t j = first_frame; j < chunk.times.size(); j++) {
+            writer.add_frame(chunk.times[j], chunk.orientations[j] * chunk_start_orientation);
+            num_frames++;
+        }
+        chunk_start_orientation = chunk.orientations.back() * chunk_start_orientation;
+        last_time = chunk.times.back();
+    }
+    writer.close();
+    return num_frames;
+}
@@ -0,0 +1,40 @@
+#ifndef _ANALYSIS_HPP_
+#define _ANALYSIS_HPP_
+
+#include <memory>
+#include <string>
+
+#include "Camera.hpp"
+#include "FrameSource.hpp"
+
+/**
+ * Measure the camera orientation of every frame from `source` and write them to a
+ * trajectory file, without warping anything. `output_scale` is the scale the video
+ * will be rendered at, which sets the motion estimation's inlier threshold.
+ *
+ * Returns the number of frames analysed.
+ */
+long analyse_trajectory(
+    std::shared_ptr<FrameSource> source,
+    std::string trajectory_path,
+    CameraPreset input_camera,
+    double output_scale = 1,
+    double analysis_scale = 1
+);
+
+/**
+ * Like `analyse_trajectory`, but split the video at keyframes into chunks which are
+ * analysed in parallel, each with its own software decoder, on `num_workers` threads
+ * (0 for one per core). Consecutive chunks share a frame, which links their
+ * orientations into one trajectory.
+ */
+long analyse_trajectory_parallel(
+    std::string video_path,
+    std::string trajectory_path,
+    CameraPreset input_camera,
+    double output_scale = 1,
+    double analysis_scale = 1,
+    int num_workers = 0
+);
+
+#endif // _ANALYSIS_HPP_
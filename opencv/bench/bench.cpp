@@ -0,0 +1,194 @@
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <string>
+
+#include "AvFrameSourceAsync.hpp"
+#include "AvFrameSourceProfile.hpp"
+#include "AvFrameSourceSynthetic.hpp"
+#include "Camera.hpp"
+#include "FrameSourceFfmpegSw.hpp"
+#include "FrameSourceProfile.hpp"
+#include "FrameSourceWarp.hpp"
+#include "Profiler.hpp"
+#include "Tracer.hpp"
+
+using namespace cv;
+using namespace std;
+using namespace std::chrono;
+
+/**
+ * Runs the FrameSourceWarp pipeline headless on a synthetic video, so that it can be
+ * measured without a video file, a hardware decoder or a display. Uses OpenCV's default
+ * OpenCL device (e.g. a CPU ICD such as PoCL) if there is one.
+ */
+
+void print_usage(char *program) {
+    cout << "\n\tUsage: " << program << " [options]\n\n" <<
+        "\t--size=WxH            Frame size (default 1920x1440)\n" <<
+        "\t--frames=N            Number of frames (default 300)\n" <<
+        "\t--read-ahead=N        Render up to N frames ahead on another thread (default 8, 0 disables)\n" <<
+        "\t--warp=MODE           maps, maps-fixed, fused, mesh or cpu (default maps, or cpu without OpenCL)\n" <<
+        "\t--analysis-scale=S    Estimate motion at S (0 < S <= 1) times the input resolution (default 1)\n" <<
+        "\t--motion-queue=N      Estimate motion on another thread, up to N frames ahead (default 4, 0 disables)\n" <<
+        "\t--stabilise=MODE      smooth (default) or kalman\n" <<
+        "\t--no-opencl           Don't use OpenCL, even if it's available\n" <<
+        "\t--profile-json=FILE   Write the per-stage timing statistics to a JSON FILE at exit\n" <<
+        "\t--profile-csv=FILE    Write the per-stage timing statistics to a CSV FILE at exit\n" <<
+        "\t--trace=FILE          Write a Chrome trace of host and OpenCL device work to FILE at exit\n\n";
+}
+
+int main(int argc, char *argv[]) {
+    Size size(1920, 1440);
+    long num_frames = 300;
+    int read_ahead_frames = 8;
+    bool use_opencl = true;
+    string warp = "";
+    WarpMode warp_mode = WARP_MODE_MAPS;
+    double analysis_scale = 1;
+    int motion_queue_frames = 4;
+    StabiliseMode stabilise_mode = STABILISE_MODE_SMOOTH;
+    string profile_json_path;
+    string profile_csv_path;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        size_t equals = arg.find('=');
+        string name = arg.substr(0, equals);
+        string value = equals == string::npos ? "" : arg.substr(equals + 1);
+        if (name == "--size") {
+            if (sscanf(value.c_str(), "%dx%d", &size.width, &size.height) != 2) {
+                cerr << "Invalid frame size: " << value << "\n";
+                return 1;
+            }
+        } else if (name == "--frames") {
+            num_frames = stol(value);
+        } else if (name == "--read-ahead") {
+            read_ahead_frames = stoi(value);
+        } else if (name == "--warp" && parse_warp_mode(value, warp_mode)) {
+            warp = value;
+        } else if (name == "--analysis-scale") {
+            analysis_scale = stod(value);
+            // Negated, so that NaN is rejected too
+            if (!(analysis_scale > 0 && analysis_scale <= 1)) {
+                cerr << "Invalid analysis scale, must be in (0, 1]: " << value << "\n";
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (name == "--motion-queue") {
+            motion_queue_frames = stoi(value);
+        } else if (name == "--stabilise" && value == "smooth") {
+            stabilise_mode = STABILISE_MODE_SMOOTH;
+        } else if (name == "--stabilise" && value == "kalman") {
+            stabilise_mode = STABILISE_MODE_KALMAN;
+        } else if (name == "--no-opencl") {
+            use_opencl = false;
+        } else if (name == "--profile-json") {
+            profile_json_path = value;
+        } else if (name == "--profile-csv") {
+            profile_csv_path = value;
+        } else if (name == "--trace") {
+            Tracer::enable(value);
+        } else {
+            cerr << "Unknown option: " << arg << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!select_opencl_and_warp_mode(use_opencl, warp, warp_mode)) {
+        return 1;
+    }
+    use_opencl = ocl::useOpenCL();
+
+    // Don't interleave periodic reports with the results
+    Profiler::set_report_interval(0);
+    if (!profile_json_path.empty() || !profile_csv_path.empty()) {
+        Profiler::write_stats_at_exit(profile_json_path, profile_csv_path);
+    }
+    Tracer::enable_opencl_profiling();
+
+    if (use_opencl) {
+        ocl::Device device = ocl::Device::getDefault();
+        printf("opencl: %s (%s)\n", device.name().c_str(), device.vendorName().c_str());
+    } else {
+        printf("opencl: none\n");
+    }
+    printf(
+        "size: %dx%d frames: %ld warp: %s analysis_scale: %.2f motion_queue: %d stabilise: %s\n",
+        size.width,
+        size.height,
+        num_frames,
+        warp.c_str(),
+        analysis_scale,
+        motion_queue_frames,
+        stabilise_mode == STABILISE_MODE_KALMAN ? "kalman" : "smooth"
+    );
+
+    Camera camera = get_preset_camera(GOPRO_H4B_WIDE43_MEASURED, size);
+    shared_ptr<AvFrameSource> av_source = make_shared<AvFrameSourceProfile>(
+        make_shared<AvFrameSourceSynthetic>(camera, SyntheticMotion(), num_frames),
+        "synthetic-render"
+    );
+    if (read_ahead_frames > 0) {
+        av_source = make_shared<AvFrameSourceAsync>(av_source, read_ahead_frames, "synthetic-read-ahead");
+    }
+    auto source = make_shared<FrameSourceProfile>(
+        make_shared<FrameSourceFfmpegSw>(av_source),
+        "opencv-uploaded"
+    );
+    FrameSourceProfile warped_source(
+        make_shared<FrameSourceWarp>(
+            source,
+            GOPRO_H4B_WIDE43_MEASURED,
+            0.5,
+            false,
+            1.0,
+            30,
+            INTER_LINEAR,
+            warp_mode,
+            0,
+            analysis_scale,
+            TieredFrameStoreConfig(),
+            stabilise_mode,
+            motion_queue_frames
+        ),
+        "opencv-warped"
+    );
+
+    // Time from the first warped frame, so that setup (e.g. compiling the OpenCL
+    // programs, filling the lookahead) isn't counted
+    long num_warped = 0;
+    steady_clock::time_point start;
+    while (true) {
+        try {
+            UMat frame = warped_source.pull_frame();
+            if (use_opencl) {
+                // Like a consumer would, wait for the frame to be finished
+                ocl::finish();
+            }
+        } catch (int err) {
+            if (err == EOF) {
+                break;
+            }
+            throw err;
+        }
+        if (num_warped == 0) {
+            start = steady_clock::now();
+        }
+        num_warped++;
+    }
+    double seconds = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+
+    printf("\n");
+    Profiler::print_stats();
+    printf(
+        "\nwarped %ld frames, %.2f frames/s\n",
+        num_warped,
+        num_warped > 1 ? (num_warped - 1) / seconds : 0
+    );
+    return 0;
+}
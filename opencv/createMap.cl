@@ -1,3 +1,48 @@
+/**
+ * Find the location in the (fisheye) source image which maps to a pixel in the
+ * (rectilinear) output image
+ */
+inline float2 find_source_coordinates(
+    float map_x, float map_y,
+    float src_center_x, float src_center_y, float src_focal_x, float src_focal_y,
+    float map_center_x, float map_center_y, float map_focal_x, float map_focal_y,
+    float rot00, float rot01, float rot02,
+    float rot10, float rot11, float rot12,
+    float rot20, float rot21, float rot22
+) {
+    // Find the location vector of the mapped pixel
+    float3 vector_identity = {
+        (map_x - map_center_x) / map_focal_x,
+        (map_y - map_center_y) / map_focal_y,
+        1
+    };
+
+    // Apply the desired rotation
+    float3 rotation_row_0 = {rot00, rot01, rot02};
+    float3 rotation_row_1 = {rot10, rot11, rot12};
+    float3 rotation_row_2 = {rot20, rot21, rot22};
+
+    float3 vector_rotated = {
+        dot(rotation_row_0, vector_identity),
+        dot(rotation_row_1, vector_identity),
+        dot(rotation_row_2, vector_identity)
+    };
+
+    float2 coordinates_rotated = {
+        vector_rotated[0] / vector_rotated[2],
+        vector_rotated[1] / vector_rotated[2]
+    };
+
+    // Find the correction to apply to the radius to bring it into the fisheye model
+    float radius_identity = length(coordinates_rotated);
+    float fisheye_correction = atan(radius_identity) / radius_identity;
+
+    return (float2) (
+        src_center_x + coordinates_rotated[0] * fisheye_correction * src_focal_x,
+        src_center_y + coordinates_rotated[1] * fisheye_correction * src_focal_y
+    );
+}
+
 __kernel void createMap(
     __global float *out_map_x, int map_x_step, int map_x_offset, int map_rows, int map_cols,
     __global float *out_map_y, int map_y_step, int map_y_offset,
@@ -11,32 +56,14 @@ __kernel void createMap(
     short map_y = get_global_id(1);
 
     if (map_x < map_cols && map_y < map_rows) {
-        // Find the location vector of the mapped pixel
-        float3 vector_identity = {
-            (map_x - map_center_x) / map_focal_x,
-            (map_y - map_center_y) / map_focal_y,
-            1
-        };
-
-        // Apply the desired rotation
-        float3 rotation_row_0 = {rot00, rot01, rot02};
-        float3 rotation_row_1 = {rot10, rot11, rot12};
-        float3 rotation_row_2 = {rot20, rot21, rot22};
-
-        float3 vector_rotated = {
-            dot(rotation_row_0, vector_identity),
-            dot(rotation_row_1, vector_identity),
-            dot(rotation_row_2, vector_identity)
-        };
-
-        float2 coordinates_rotated = {
-            vector_rotated[0] / vector_rotated[2],
-            vector_rotated[1] / vector_rotated[2]
-        };
-
-        // Find the correction to apply to the radius to bring it into the fisheye model
-        float radius_identity = length(coordinates_rotated);
-        float fisheye_correction = atan(radius_identity) / radius_identity;
+        float2 source = find_source_coordinates(
+            map_x, map_y,
+            src_center_x, src_center_y, src_focal_x, src_focal_y,
+            map_center_x, map_center_y, map_focal_x, map_focal_y,
+            rot00, rot01, rot02,
+            rot10, rot11, rot12,
+            rot20, rot21, rot22
+        );
 
         // Find the location of this pixel in the maps
         __global float *map_x_pixel = ((__global void * ) out_map_x) +
@@ -45,7 +72,230 @@ __kernel void createMap(
             mad24(map_y, map_y_step, mad24(map_x, sizeof(float), map_y_offset));
 
         // Write calculated values to the maps
-        *map_x_pixel = src_center_x + coordinates_rotated[0] * fisheye_correction * src_focal_x;
-        *map_y_pixel = src_center_y + coordinates_rotated[1] * fisheye_correction * src_focal_y;
+        *map_x_pixel = source[0];
+        *map_y_pixel = source[1];
     }
 }
+
+// Fixed point map format used by OpenCV's remap (see convertMaps)
+#define INTER_BITS 5
+#define INTER_TAB_SIZE (1 << INTER_BITS)
+
+/**
+ * Like createMap, but write OpenCV's packed fixed point maps: integer source
+ * coordinates (CV_16SC2) and an index into remap's interpolation table (CV_16UC1)
+ */
+__kernel void createMapFixed(
+    __global uchar *out_map_xy, int map_xy_step, int map_xy_offset, int map_rows, int map_cols,
+    __global uchar *out_map_table, int map_table_step, int map_table_offset,
+    float src_center_x, float src_center_y, float src_focal_x, float src_focal_y,
+    float map_center_x, float map_center_y, float map_focal_x, float map_focal_y,
+    float rot00, float rot01, float rot02,
+    float rot10, float rot11, float rot12,
+    float rot20, float rot21, float rot22
+) {
+    int map_x = get_global_id(0);
+    int map_y = get_global_id(1);
+
+    if (map_x < map_cols && map_y < map_rows) {
+        float2 source = find_source_coordinates(
+            map_x, map_y,
+            src_center_x, src_center_y, src_focal_x, src_focal_y,
+            map_center_x, map_center_y, map_focal_x, map_focal_y,
+            rot00, rot01, rot02,
+            rot10, rot11, rot12,
+            rot20, rot21, rot22
+        );
+
+        __global short2 *map_xy_pixel = (__global short2 *) (out_map_xy +
+            mad24(map_y, map_xy_step, mad24(map_x, (int) sizeof(short2), map_xy_offset)));
+        __global ushort *map_table_pixel = (__global ushort *) (out_map_table +
+            mad24(map_y, map_table_step, mad24(map_x, (int) sizeof(ushort), map_table_offset)));
+
+#ifdef NEAREST
+        *map_xy_pixel = convert_short2_sat(convert_int2_sat_rte(source));
+        *map_table_pixel = 0;
+#else
+        int2 fixed = convert_int2_sat_rte(source * INTER_TAB_SIZE);
+        *map_xy_pixel = convert_short2_sat(fixed >> INTER_BITS);
+        *map_table_pixel = (ushort) (
+            (fixed.y & (INTER_TAB_SIZE - 1)) * INTER_TAB_SIZE + (fixed.x & (INTER_TAB_SIZE - 1))
+        );
+#endif
+    }
+}
+
+/**
+ * Sample a plane with `channels` interleaved 8 bit channels at a (clamped) location
+ */
+inline float2 sample_plane(
+    __global const uchar *plane, int step, int rows, int cols, int channels, float2 location
+) {
+#ifdef NEAREST
+    int x = clamp(convert_int_rte(location[0]), 0, cols - 1);
+    int y = clamp(convert_int_rte(location[1]), 0, rows - 1);
+    __global const uchar *pixel = plane + mad24(y, step, x * channels);
+    return (float2) (pixel[0], channels > 1 ? pixel[1] : 0);
+#else
+    float2 top_left = floor(location);
+    float2 weight = location - top_left;
+    int x0 = clamp((int) top_left[0], 0, cols - 1);
+    int y0 = clamp((int) top_left[1], 0, rows - 1);
+    int x1 = min(x0 + 1, cols - 1);
+    int y1 = min(y0 + 1, rows - 1);
+
+    __global const uchar *row0 = plane + y0 * step;
+    __global const uchar *row1 = plane + y1 * step;
+    float2 p00 = (float2) (row0[x0 * channels], row0[x0 * channels + channels - 1]);
+    float2 p01 = (float2) (row0[x1 * channels], row0[x1 * channels + channels - 1]);
+    float2 p10 = (float2) (row1[x0 * channels], row1[x0 * channels + channels - 1]);
+    float2 p11 = (float2) (row1[x1 * channels], row1[x1 * channels + channels - 1]);
+    return mix(mix(p00, p01, weight[0]), mix(p10, p11, weight[0]), weight[1]);
+#endif
+}
+
+/**
+ * Sample an NV12 image (luma rows followed by interleaved chroma rows) at a location
+ * and write the result to a BGR pixel
+ */
+inline void write_bgr_from_nv12(
+    __global const uchar *src, int src_step, int src_offset, int src_rows, int src_cols,
+    float2 source,
+    __global uchar *dst_pixel
+) {
+    int luma_rows = src_rows * 2 / 3;
+
+    // Like remap with BORDER_CONSTANT, pixels outside the source are black
+    if (
+        source[0] < 0 || source[0] > src_cols - 1 ||
+        source[1] < 0 || source[1] > luma_rows - 1
+    ) {
+        dst_pixel[0] = 0;
+        dst_pixel[1] = 0;
+        dst_pixel[2] = 0;
+        return;
+    }
+
+    __global const uchar *luma = src + src_offset;
+    __global const uchar *chroma = luma + luma_rows * src_step;
+
+    float y = sample_plane(luma, src_step, luma_rows, src_cols, 1, source)[0];
+    // Chroma samples are centred between each 2x2 block of luma samples
+    float2 uv = sample_plane(
+        chroma, src_step, luma_rows / 2, src_cols / 2, 2, source * 0.5f - 0.25f
+    );
+
+    // BT.601 limited range, matching cvtColor(COLOR_YUV2BGR_NV12)
+    float luma_scaled = 1.164f * max(y - 16.f, 0.f);
+    float u = uv[0] - 128.f;
+    float v = uv[1] - 128.f;
+    dst_pixel[0] = convert_uchar_sat_rte(luma_scaled + 2.018f * u);
+    dst_pixel[1] = convert_uchar_sat_rte(luma_scaled - 0.813f * v - 0.391f * u);
+    dst_pixel[2] = convert_uchar_sat_rte(luma_scaled + 1.596f * v);
+}
+
+/**
+ * Warp an NV12 image directly to BGR, without intermediate maps or a separate colour
+ * conversion pass
+ */
+__kernel void warpNv12(
+    __global const uchar *src, int src_step, int src_offset, int src_rows, int src_cols,
+    __global uchar *dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+    float src_center_x, float src_center_y, float src_focal_x, float src_focal_y,
+    float map_center_x, float map_center_y, float map_focal_x, float map_focal_y,
+    float rot00, float rot01, float rot02,
+    float rot10, float rot11, float rot12,
+    float rot20, float rot21, float rot22
+) {
+    int dst_x = get_global_id(0);
+    int dst_y = get_global_id(1);
+
+    if (dst_x >= dst_cols || dst_y >= dst_rows) {
+        return;
+    }
+
+    float2 source = find_source_coordinates(
+        dst_x, dst_y,
+        src_center_x, src_center_y, src_focal_x, src_focal_y,
+        map_center_x, map_center_y, map_focal_x, map_focal_y,
+        rot00, rot01, rot02,
+        rot10, rot11, rot12,
+        rot20, rot21, rot22
+    );
+
+    write_bgr_from_nv12(
+        src, src_step, src_offset, src_rows, src_cols,
+        source,
+        dst + mad24(dst_y, dst_step, mad24(dst_x, 3, dst_offset))
+    );
+}
+
+/**
+ * Evaluate the exact source location only at every `spacing`th output pixel, writing
+ * (x, y) pairs to a coarse mesh
+ */
+__kernel void createMesh(
+    __global uchar *mesh, int mesh_step, int mesh_offset, int mesh_rows, int mesh_cols,
+    int spacing,
+    float src_center_x, float src_center_y, float src_focal_x, float src_focal_y,
+    float map_center_x, float map_center_y, float map_focal_x, float map_focal_y,
+    float rot00, float rot01, float rot02,
+    float rot10, float rot11, float rot12,
+    float rot20, float rot21, float rot22
+) {
+    int mesh_x = get_global_id(0);
+    int mesh_y = get_global_id(1);
+
+    if (mesh_x < mesh_cols && mesh_y < mesh_rows) {
+        float2 source = find_source_coordinates(
+            mesh_x * spacing, mesh_y * spacing,
+            src_center_x, src_center_y, src_focal_x, src_focal_y,
+            map_center_x, map_center_y, map_focal_x, map_focal_y,
+            rot00, rot01, rot02,
+            rot10, rot11, rot12,
+            rot20, rot21, rot22
+        );
+        *((__global float2 *) (mesh + mad24(mesh_y, mesh_step, mad24(mesh_x, 8, mesh_offset)))) =
+            source;
+    }
+}
+
+/**
+ * Warp an NV12 image to BGR, bilinearly interpolating source locations from a mesh
+ * created by `createMesh`
+ */
+__kernel void warpNv12Mesh(
+    __global const uchar *src, int src_step, int src_offset, int src_rows, int src_cols,
+    __global uchar *dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+    __global const uchar *mesh, int mesh_step, int mesh_offset, int mesh_rows, int mesh_cols,
+    int spacing
+) {
+    int dst_x = get_global_id(0);
+    int dst_y = get_global_id(1);
+
+    if (dst_x >= dst_cols || dst_y >= dst_rows) {
+        return;
+    }
+
+    float2 mesh_location = (float2) (dst_x, dst_y) / spacing;
+    float2 top_left = floor(mesh_location);
+    float2 weight = mesh_location - top_left;
+    int x0 = min((int) top_left[0], mesh_cols - 1);
+    int y0 = min((int) top_left[1], mesh_rows - 1);
+    int x1 = min(x0 + 1, mesh_cols - 1);
+    int y1 = min(y0 + 1, mesh_rows - 1);
+
+    __global const uchar *row0 = mesh + mad24(y0, mesh_step, mesh_offset);
+    __global const uchar *row1 = mesh + mad24(y1, mesh_step, mesh_offset);
+    float2 n00 = *((__global const float2 *) (row0 + x0 * 8));
+    float2 n01 = *((__global const float2 *) (row0 + x1 * 8));
+    float2 n10 = *((__global const float2 *) (row1 + x0 * 8));
+    float2 n11 = *((__global const float2 *) (row1 + x1 * 8));
+    float2 source = mix(mix(n00, n01, weight[0]), mix(n10, n11, weight[0]), weight[1]);
+
+    write_bgr_from_nv12(
+        src, src_step, src_offset, src_rows, src_cols,
+        source,
+        dst + mad24(dst_y, dst_step, mad24(dst_x, 3, dst_offset))
+    );
+}
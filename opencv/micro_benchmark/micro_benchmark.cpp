@@ -0,0 +1,345 @@
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "Camera.hpp"
+#include "FeatureGrid.hpp"
+#include "FrameWarper.hpp"
+#include "OpticalFlow.hpp"
+#include "RotationEstimator.hpp"
+#include "SyntheticScene.hpp"
+
+using namespace cv;
+using namespace std;
+using namespace std::chrono;
+
+/**
+ * Times the warp and motion estimation hot paths one at a time, at GoPro input
+ * resolutions, on frames of a synthetic fisheye scene
+ *
+ * Every kernel and resolution always gets a row in the same order (with "-" for
+ * kernels needing OpenCL when it isn't available), so the output of two commits can
+ * be diffed directly. Times are the median and minimum of single runs, each waited for
+ * to finish.
+ */
+
+const Size OPTICAL_FLOW_WINDOW(21, 21);
+const int OPTICAL_FLOW_MAX_LEVEL = 3;
+const int CORNER_DETECTION_LEVEL = 1;
+const double THRESHOLD_PIXELS = 8.0;
+
+struct Resolution {
+    const char *name;
+    Size size;
+    CameraPreset preset;
+};
+
+struct Timing {
+    double median_ms = 0;
+    double min_ms = 0;
+};
+
+int iterations = 20;
+string filter;
+
+Timing measure(function<void()> run) {
+    // Warm up (and compile the OpenCL kernels)
+    run();
+    ocl::finish();
+
+    vector<double> times;
+    for (int i = 0; i < iterations; i++) {
+        steady_clock::time_point start = steady_clock::now();
+        run();
+        ocl::finish();
+        times.push_back(duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e6);
+    }
+    sort(times.begin(), times.end());
+    Timing timing;
+    timing.median_ms = times[times.size() / 2];
+    timing.min_ms = times[0];
+    return timing;
+}
+
+/**
+ * Time `run` and print a row, or a row of "-" if it can't run here
+ */
+void benchmark(const char *kernel, const Resolution &resolution, long items, bool available, function<void()> run) {
+    if (!filter.empty() && string(kernel).find(filter) == string::npos) {
+        return;
+    }
+    if (!available) {
+        printf("%-20s %-6s %10ld %12s %12s %12s\n", kernel, resolution.name, items, "-", "-", "-");
+        return;
+    }
+    Timing timing = measure(run);
+    printf(
+        "%-20s %-6s %10ld %12.3f %12.3f %12.2f\n",
+        kernel,
+        resolution.name,
+        items,
+        timing.median_ms,
+        timing.min_ms,
+        items / timing.median_ms / 1e3
+    );
+}
+
+/**
+ * The estimation FrameSourceWarp used before RotationEstimator, as in
+ * rotation_benchmark: points at random depths, fitted with solvePnPRansac
+ */
+void guess_rotation_pnp(
+    const Camera &camera,
+    const Camera &output_camera,
+    const vector<Point2f> &points_prev,
+    const vector<Point2f> &points_current
+) {
+    vector<Point2f> corners_output;
+    fisheye::undistortPoints(
+        points_current,
+        corners_output,
+        camera.matrix,
+        camera.distortion_coefficients,
+        Matx33d::eye(),
+        output_camera.matrix
+    );
+    vector<Point2f> prev_corners_identity;
+    fisheye::undistortPoints(points_prev, prev_corners_identity, camera.matrix, camera.distortion_coefficients);
+
+    vector<Point3d> prev_corner_coordinates;
+    for (size_t i = 0; i < prev_corners_identity.size(); ++i) {
+        // Deterministic "random" depths, so that every run does the same work
+        double scale = 0.5 + 0.5 * ((i * 7919) % 1000) / 1000.;
+        prev_corner_coordinates.push_back(Point3d(
+            prev_corners_identity[i].x * scale,
+            prev_corners_identity[i].y * scale,
+            scale
+        ));
+    }
+
+    Mat rotation_vector, translation;
+    vector<int> inliers;
+    solvePnPRansac(
+        prev_corner_coordinates,
+        corners_output,
+        output_camera.matrix,
+        output_camera.distortion_coefficients,
+        rotation_vector,
+        translation,
+        false,
+        100,
+        THRESHOLD_PIXELS,
+        0.99,
+        inliers
+    );
+}
+
+void run_resolution(const Resolution &resolution, ocl::Kernel &float_kernel, ocl::Kernel &fixed_kernel) {
+    bool opencl = ocl::useOpenCL();
+    Camera input_camera = get_preset_camera(resolution.preset, resolution.size);
+    Camera output_camera = get_output_camera(input_camera, 1, false, 1);
+    long input_pixels = input_camera.size.area();
+    long output_pixels = output_camera.size.area();
+
+    // Two consecutive frames of a shaking camera
+    SyntheticScene scene(input_camera);
+    Mat frames[2];
+    Matx33d orientations[2];
+    Rodrigues(Vec3d(0.1, 0.2, 0), orientations[0]);
+    Rodrigues(Vec3d(0.105, 0.21, 0.003), orientations[1]);
+    for (int i = 0; i < 2; i++) {
+        frames[i].create(resolution.size.height * 3 / 2, resolution.size.width, CV_8U);
+        scene.render(
+            orientations[i],
+            frames[i](Rect(Point(0, 0), resolution.size)),
+            Mat(resolution.size / 2, CV_8UC2, frames[i].ptr(resolution.size.height), frames[i].step)
+        );
+    }
+    UMat nv12 = frames[0].getUMat(ACCESS_READ);
+    Mat luma[2] = {
+        frames[0](Rect(Point(0, 0), resolution.size)),
+        frames[1](Rect(Point(0, 0), resolution.size)),
+    };
+
+    Matx33d rotation;
+    Rodrigues(Vec3d(0.03, -0.05, 0.02), rotation);
+
+    UMat float_map_x(output_camera.size, CV_32F), float_map_y(output_camera.size, CV_32F);
+    UMat fixed_map_xy(output_camera.size, CV_16SC2), fixed_map_table(output_camera.size, CV_16UC1);
+    benchmark("create-map-float", resolution, output_pixels, opencl, [&]() {
+        create_maps(float_kernel, input_camera, output_camera, rotation, float_map_x, float_map_y);
+    });
+    benchmark("create-map-fixed", resolution, output_pixels, opencl, [&]() {
+        create_maps(fixed_kernel, input_camera, output_camera, rotation, fixed_map_xy, fixed_map_table);
+    });
+
+    UMat bgr;
+    benchmark("nv12-to-bgr", resolution, input_pixels, true, [&]() {
+        cvtColor(nv12, bgr, COLOR_YUV2BGR_NV12);
+    });
+    if (bgr.empty()) {
+        cvtColor(nv12, bgr, COLOR_YUV2BGR_NV12);
+    }
+
+    UMat float_output, fixed_output;
+    if (opencl) {
+        create_maps(float_kernel, input_camera, output_camera, rotation, float_map_x, float_map_y);
+        create_maps(fixed_kernel, input_camera, output_camera, rotation, fixed_map_xy, fixed_map_table);
+    }
+    benchmark("remap-float", resolution, output_pixels, opencl, [&]() {
+        remap(bgr, float_output, float_map_x, float_map_y, INTER_LINEAR);
+    });
+    benchmark("remap-fixed", resolution, output_pixels, opencl, [&]() {
+        remap(bgr, fixed_output, fixed_map_xy, fixed_map_table, INTER_LINEAR);
+    });
+    // Computed again for remap-fixed-error, which mustn't depend on which of the remap
+    // benchmarks ran
+    UMat float_reference, fixed_reference;
+    if (opencl) {
+        remap(bgr, float_reference, float_map_x, float_map_y, INTER_LINEAR);
+        remap(bgr, fixed_reference, fixed_map_xy, fixed_map_table, INTER_LINEAR);
+    }
+
+    // Motion estimation, on the full resolution luma
+    vector<Point2f> corners;
+    benchmark("good-features", resolution, input_pixels, true, [&]() {
+        goodFeaturesToTrack(luma[0], corners, 200, 0.01, 30);
+    });
+
+    OpticalFlowPyramid pyramids[2] = {
+        OpticalFlowPyramid(resolution.size, OPTICAL_FLOW_MAX_LEVEL, OPTICAL_FLOW_WINDOW),
+        OpticalFlowPyramid(resolution.size, OPTICAL_FLOW_MAX_LEVEL, OPTICAL_FLOW_WINDOW),
+    };
+    benchmark("flow-pyramid", resolution, input_pixels, true, [&]() {
+        pyramids[0].build(luma[0]);
+    });
+    pyramids[0].build(luma[0]);
+    pyramids[1].build(luma[1]);
+
+    // Detection in every cell, as on the first frame
+    FeatureGrid feature_grid(resolution.size);
+    const Mat &detection_image = pyramids[0].images[CORNER_DETECTION_LEVEL];
+    vector<Point2f> grid_corners;
+    benchmark("feature-grid", resolution, detection_image.total(), true, [&]() {
+        grid_corners.clear();
+        feature_grid.replenish(detection_image, 1 << CORNER_DETECTION_LEVEL, grid_corners);
+    });
+    grid_corners.clear();
+    feature_grid.replenish(detection_image, 1 << CORNER_DETECTION_LEVEL, grid_corners);
+
+    OpticalFlowTracker tracker(OPTICAL_FLOW_WINDOW);
+    vector<Point2f> tracked_corners;
+    vector<uchar> status;
+    benchmark("optical-flow", resolution, grid_corners.size(), true, [&]() {
+        tracker.track(pyramids[0], pyramids[1], grid_corners, tracked_corners, status);
+    });
+    tracker.track(pyramids[0], pyramids[1], grid_corners, tracked_corners, status);
+    vector<Point2f> points_prev, points_current;
+    for (size_t i = 0; i < status.size(); i++) {
+        if (status[i]) {
+            points_prev.push_back(grid_corners[i]);
+            points_current.push_back(tracked_corners[i]);
+        }
+    }
+
+    // Computed once for rotation-ransac, which mustn't depend on whether
+    // undistort-points ran
+    vector<Point2f> prev_identity, current_identity;
+    undistort_points(input_camera, points_prev, prev_identity);
+    undistort_points(input_camera, points_current, current_identity);
+    vector<Point2f> undistorted_prev, undistorted_current;
+    benchmark("undistort-points", resolution, points_prev.size() * 2, true, [&]() {
+        undistort_points(input_camera, points_prev, undistorted_prev);
+        undistort_points(input_camera, points_current, undistorted_current);
+    });
+
+    benchmark("solve-pnp-ransac", resolution, points_prev.size(), true, [&]() {
+        guess_rotation_pnp(input_camera, output_camera, points_prev, points_current);
+    });
+
+    RotationEstimator estimator(0, 100, THRESHOLD_PIXELS / output_camera.matrix(0, 0));
+    benchmark("rotation-ransac", resolution, points_prev.size(), true, [&]() {
+        estimator.resize(prev_identity.size());
+        for (size_t i = 0; i < prev_identity.size(); ++i) {
+            estimator.set_point(
+                i,
+                Eigen::Vector3f(prev_identity[i].x, prev_identity[i].y, 1),
+                Eigen::Vector3f(current_identity[i].x, current_identity[i].y, 1)
+            );
+        }
+        Eigen::Matrix3d estimated;
+        estimator.estimate(estimated);
+    });
+
+    // Fixed point maps trade accuracy for speed, so show what they cost
+    if (opencl && (filter.empty() || string("remap-fixed").find(filter) != string::npos)) {
+        UMat difference;
+        absdiff(float_reference, fixed_reference, difference);
+        double max_error;
+        minMaxLoc(difference.reshape(1), NULL, &max_error);
+        Scalar channel_mean_error = mean(difference);
+        printf(
+            "%-20s %-6s %10s max %.0f mean %.4f\n",
+            "remap-fixed-error",
+            resolution.name,
+            "",
+            max_error,
+            (channel_mean_error[0] + channel_mean_error[1] + channel_mean_error[2]) / 3
+        );
+    }
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        size_t equals = arg.find('=');
+        string name = arg.substr(0, equals);
+        string value = equals == string::npos ? "" : arg.substr(equals + 1);
+        if (name == "--iterations") {
+            iterations = max(1, stoi(value));
+        } else if (name == "--filter") {
+            filter = value;
+        } else if (name == "--no-opencl") {
+            ocl::setUseOpenCL(false);
+        } else {
+            cerr << "Unknown option: " << arg << "\n\n\tUsage: " << argv[0] <<
+                " [--iterations=N] [--filter=KERNEL] [--no-opencl]\n\n";
+            return 1;
+        }
+    }
+    if (ocl::useOpenCL()) {
+        printf("opencl: %s\n", ocl::Device::getDefault().name().c_str());
+    } else {
+        printf("opencl: none\n");
+    }
+    printf("threads: %d iterations: %d\n\n", getNumThreads(), iterations);
+
+    Resolution resolutions[] = {
+        { "1080p", Size(1920, 1080), GOPRO_H4B_WIDE169_MEASURED },
+        { "1440p", Size(1920, 1440), GOPRO_H4B_WIDE43_MEASURED },
+        { "2.7K", Size(2704, 1520), GOPRO_H4B_WIDE169_MEASURED },
+        { "4K", Size(3840, 2160), GOPRO_H4B_WIDE169_MEASURED },
+    };
+
+    ocl::Kernel float_kernel, fixed_kernel;
+    if (ocl::useOpenCL()) {
+        ocl::Program program = read_opencl_program_from_file("createMap.cl", "");
+        float_kernel = ocl::Kernel("createMap", program);
+        fixed_kernel = ocl::Kernel("createMapFixed", program);
+    }
+
+    printf("%-20s %-6s %10s %12s %12s %12s\n", "kernel", "input", "items", "median_ms", "min_ms", "Mitems/s");
+    for (const Resolution &resolution : resolutions) {
+        run_resolution(resolution, float_kernel, fixed_kernel);
+    }
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <vector>
+
+#include "AllocationCounter.hpp"
+#include "Camera.hpp"
+#include "FrameSource.hpp"
+#include "FrameSourceWarp.hpp"
+#include "FrameWarper.hpp"
+#include "SyntheticScene.hpp"
+
+using namespace cv;
+using namespace std;
+using namespace std::chrono;
+
+/**
+ * Runs FrameSourceWarp on a synthetic video, with motion estimation on its own thread,
+ * and counts the heap allocations (including OpenCV's, see AllocationCounter.hpp) per
+ * frame once the buffers have grown to their steady state size
+ *
+ * Exits with status 1 unless, in steady state:
+ *  - the motion estimation thread makes no allocations, and
+ *  - the consuming thread (smoothing and warping) makes no more allocations than
+ *    FrameWarper on its own, which allocates each output frame
+ *
+ * OpenCV's worker threads are disabled, so that each allocation is counted on the thread
+ * whose work made it. So is OpenCL: OpenCV's kernel objects and the OpenCL runtime
+ * allocate on every enqueue, which isn't allocation the pipeline can avoid.
+ */
+
+const Size FRAME_SIZE(1920, 1440);
+const int WARMUP_FRAMES = 60;
+const int MEASURED_FRAMES = 200;
+const int SMOOTH_RADIUS = 30;
+const int MOTION_QUEUE_FRAMES = 4;
+
+// The video loops over one second of shake about the x axis, which is periodic so the
+// loop is seamless
+const int LOOP_FRAMES = 30;
+const double FRAME_RATE = 30;
+
+/**
+ * Loops forever over prerendered NV12 frames, so the source itself never allocates
+ */
+class FrameSourceLoop: public FrameSource {
+    vector<UMat> m_frames;
+    size_t m_index = 0;
+  public:
+    FrameSourceLoop(vector<UMat> frames): m_frames(frames) {}
+
+    UMat pull_frame() {
+        UMat frame = m_frames[m_index];
+        m_index = (m_index + 1) % m_frames.size();
+        return frame;
+    }
+
+    UMat peek_frame() {
+        return m_frames[m_index];
+    }
+};
+
+struct Mode {
+    const char *name;
+    StabiliseMode stabilise_mode;
+    double analysis_scale;
+};
+
+struct Result {
+    double milliseconds = 0;
+    long motion_allocations = 0;
+    long consumer_allocations = 0;
+};
+
+vector<UMat> render_frames(const Camera &camera) {
+    SyntheticScene scene(camera);
+    SyntheticMotion motion;
+    motion.pan_rate = Vec3d(0, 0, 0);
+    motion.shake_amplitude = Vec3d(0.02, 0, 0);
+    motion.shake_frequency = FRAME_RATE / LOOP_FRAMES;
+
+    vector<UMat> frames;
+    for (int i = 0; i < LOOP_FRAMES; i++) {
+        Mat nv12(FRAME_SIZE.height * 3 / 2, FRAME_SIZE.width, CV_8U);
+        scene.render(
+            motion.get_orientation(i / FRAME_RATE),
+            nv12.rowRange(0, FRAME_SIZE.height),
+            Mat(FRAME_SIZE / 2, CV_8UC2, nv12.ptr(FRAME_SIZE.height), nv12.step)
+        );
+        frames.push_back(nv12.getUMat(ACCESS_READ).clone());
+    }
+    return frames;
+}
+
+/**
+ * Allocations per output frame made by FrameWarper alone
+ */
+double get_warp_allocations(const Camera &camera, WarpMode warp_mode, UMat frame) {
+    FrameWarper warper(camera, get_output_camera(camera, 1, false, 1), INTER_LINEAR, warp_mode);
+    long start_allocations = 0;
+    for (int i = 0; i < WARMUP_FRAMES + MEASURED_FRAMES; i++) {
+        if (i == WARMUP_FRAMES) {
+            start_allocations = get_thread_allocation_count();
+        }
+        warper.warp(frame, Matx33d::eye());
+    }
+    return 1. * (get_thread_allocation_count() - start_allocations) / MEASURED_FRAMES;
+}
+
+Result run(vector<UMat> frames, WarpMode warp_mode, const Mode &mode) {
+    FrameSourceWarp warped_source(
+        make_shared<FrameSourceLoop>(frames),
+        GOPRO_H4B_WIDE43_MEASURED,
+        1,
+        false,
+        1,
+        SMOOTH_RADIUS,
+        INTER_LINEAR,
+        warp_mode,
+        0,
+        mode.analysis_scale,
+        TieredFrameStoreConfig(),
+        mode.stabilise_mode,
+        MOTION_QUEUE_FRAMES
+    );
+
+    // Everything not allocated by this thread is allocated by the motion estimation
+    // thread, or the OpenCL runtime on its behalf
+    Result result;
+    long start_allocations = 0;
+    long start_thread_allocations = 0;
+    steady_clock::time_point start;
+    for (int i = 0; i < WARMUP_FRAMES + MEASURED_FRAMES; i++) {
+        if (i == WARMUP_FRAMES) {
+            start_allocations = get_allocation_count();
+            start_thread_allocations = get_thread_allocation_count();
+            start = steady_clock::now();
+        }
+        warped_source.pull_frame();
+    }
+    result.milliseconds = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e6 / MEASURED_FRAMES;
+    result.consumer_allocations = get_thread_allocation_count() - start_thread_allocations;
+    result.motion_allocations = get_allocation_count() - start_allocations - result.consumer_allocations;
+    return result;
+}
+
+int main() {
+    // Run OpenCV's parallel loops on the calling thread, and everything on the CPU
+    setNumThreads(0);
+    ocl::setUseOpenCL(false);
+    WarpMode warp_mode = WARP_MODE_CPU;
+    Camera camera = get_preset_camera(GOPRO_H4B_WIDE43_MEASURED, FRAME_SIZE);
+    vector<UMat> frames = render_frames(camera);
+
+    double warp_allocations = get_warp_allocations(camera, warp_mode, frames[0]);
+    printf("FrameWarper alone (cpu): %.2f allocs/frame\n\n", warp_allocations);
+
+    Mode modes[] = {
+        { "smooth", STABILISE_MODE_SMOOTH, 1 },
+        { "smooth", STABILISE_MODE_SMOOTH, 0.5 },
+        { "kalman", STABILISE_MODE_KALMAN, 1 },
+        { "kalman", STABILISE_MODE_KALMAN, 0.5 },
+    };
+    bool passed = true;
+    printf(
+        "%-8s %-14s %10s %20s %22s %6s\n",
+        "mode",
+        "analysis_scale",
+        "ms/frame",
+        "motion allocs/frame",
+        "consumer allocs/frame",
+        "result"
+    );
+    for (const Mode &mode : modes) {
+        Result result = run(frames, warp_mode, mode);
+        bool mode_passed = result.motion_allocations == 0 &&
+            result.consumer_allocations <= warp_allocations * MEASURED_FRAMES;
+        passed = passed && mode_passed;
+        printf(
+            "%-8s %-14.2f %10.2f %20.2f %22.2f %6s\n",
+            mode.name,
+            mode.analysis_scale,
+            result.milliseconds,
+            1. * result.motion_allocations / MEASURED_FRAMES,
+            1. * result.consumer_allocations / MEASURED_FRAMES,
+            mode_passed ? "ok" : "FAIL"
+        );
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,226 @@
+#include "render.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "AvFrameSourceFileSw.hpp"
+#include "FrameSourceFfmpegSw.hpp"
+#include "Tracer.hpp"
+#include "Trajectory.hpp"
+#include "VideoEncoder.hpp"
+#include "utils.hpp"
+
+using namespace std;
+using namespace cv;
+
+// Segments per worker, so that workers which get easy segments can pick up more
+const int SEGMENTS_PER_WORKER = 4;
+
+/**
+ * Settings shared by all segments
+ */
+class RenderJob {
+  public:
+    string video_path;
+    AVRational time_base;
+    Camera camera;
+    Camera output_camera;
+    InterpolationFlags interpolation;
+    WarpMode warp_mode;
+    int mesh_spacing;
+    string encoder_name;
+    string encoder_options;
+    vector<double> times;
+    vector<Matx33d> warp_rotations;
+};
+
+/**
+ * Render the frames from the keyframe at `start` up to but excluding the frame at `end`
+ * (both in `time_base` units). Returns the number of frames rendered.
+ */
+static long render_segment(const RenderJob &job, int64_t start, int64_t end, string segment_path) {
+    // Parallelism comes from the segments, so decode each on a single thread
+    auto av_source = make_shared<AvFrameSourceFileSw>(job.video_path, 1);
+    av_source->seek(start);
+    FrameSourceFfmpegSw source(av_source);
+    FrameWarper warper(
+        job.camera,
+        job.output_camera,
+        job.interpolation,
+        job.warp_mode,
+        job.mesh_spacing
+    );
+    VideoEncoder encoder(
+        segment_path,
+        job.output_camera.size,
+        job.time_base,
+        job.encoder_name,
+        job.encoder_options
+    );
+    double start_time = start * av_q2d(job.time_base);
+    double end_time = end == INT64_MAX ? INFINITY : end * av_q2d(job.time_base);
+
+    long num_frames = 0;
+    while (true) {
+        UMat frame;
+        try {
+            TraceSpan span("render-decode");
+            frame = source.pull_frame();
+        } catch (int err) {
+            if (err == EOF) {
+                break;
+            }
+            throw err;
+        }
+        double time = source.get_frame_time();
+        if (std::isnan(time)) {
+            cerr << "Frames without timestamps can't be rendered in segments\n";
+            throw -1;
+        }
+        if (time < start_time) {
+            continue;
+        }
+        if (time >= end_time) {
+            break;
+        }
+
+        // Frames have the same timestamps as when the trajectory was analysed
+        auto found = lower_bound(job.times.begin(), job.times.end(), time);
+        if (found == job.times.end() || *found != time) {
+            cerr << "Frame at " << time << "s isn't in the trajectory\n";
+            throw -1;
+        }
+        size_t frame_index = found - job.times.begin();
+        if (frame_index == 0) {
+            continue;
+        }
+        UMat warped_frame;
+        {
+            TraceSpan span("render-warp");
+            warped_frame = warper.warp(frame, job.warp_rotations[frame_index]);
+        }
+        TraceSpan span("render-encode");
+        encoder.write_frame(warped_frame, llround(time / av_q2d(job.time_base)));
+        num_frames++;
+    }
+    encoder.close();
+    return num_frames;
+}
+
+long render_trajectory_parallel(
+    string video_path,
+    string trajectory_path,
+    string output_path,
+    CameraPreset input_camera,
+    double scale,
+    bool crop_borders,
+    double zoom,
+    int smooth_radius,
+    InterpolationFlags interpolation,
+    WarpMode warp_mode,
+    int mesh_spacing,
+    string encoder_name,
+    string encoder_options,
+    int num_workers
+) {
+    if (num_workers <= 0) {
+        num_workers = max(1u, thread::hardware_concurrency());
+    }
+
+    Trajectory trajectory(trajectory_path);
+    RenderJob job;
+    job.video_path = video_path;
+    job.camera = get_preset_camera(input_camera, trajectory.get_frame_size());
+    job.output_camera = get_output_camera(job.camera, scale, crop_borders, zoom);
+    job.interpolation = interpolation;
+    job.warp_mode = warp_mode;
+    job.mesh_spacing = mesh_spacing;
+    job.encoder_name = encoder_name;
+    job.encoder_options = encoder_options;
+    for (size_t i = 0; i < trajectory.size(); i++) {
+        job.times.push_back(trajectory.get_time(i));
+    }
+    job.warp_rotations = get_warp_rotations(trajectory, smooth_radius);
+
+    // Segments start at evenly spaced keyframes, so each can be decoded on its own
+    vector<int64_t> segment_starts = find_keyframe_timestamps(
+        video_path,
+        &job.time_base,
+        num_workers * SEGMENTS_PER_WORKER
+    );
+    if (segment_starts.empty()) {
+        cerr << "No keyframes found in " << video_path << "\n";
+        throw -1;
+    }
+    size_t num_segments = segment_starts.size();
+    vector<string> segment_paths;
+    for (size_t i = 0; i < num_segments; i++) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), ".seg%03zu.mkv", i);
+        segment_paths.push_back(output_path + suffix);
+    }
+    cerr << "Rendering " << num_segments << " segments on " << num_workers << " threads\n";
+
+    vector<long> segment_frames(num_segments, 0);
+    vector<exception_ptr> errors(num_segments);
+    atomic<size_t> next_segment(0);
+    vector<thread> workers;
+    for (int i = 0; i < num_workers; i++) {
+        workers.push_back(thread([&]() {
+            Tracer::enable_opencl_profiling();
+            size_t segment_index;
+            while ((segment_index = next_segment++) < num_segments) {
+                try {
+                    segment_frames[segment_index] = render_segment(
+                        job,
+                        segment_starts[segment_index],
+                        segment_index + 1 < num_segments ?
+                            segment_starts[segment_index + 1] : INT64_MAX,
+                        segment_paths[segment_index]
+                    );
+                } catch (...) {
+                    errors[segment_index] = current_exception();
+                }
+            }
+        }));
+    }
+    for (thread &worker : workers) {
+        worker.join();
+    }
+
+    exception_ptr error;
+    vector<string> rendered_paths;
+    long num_frames = 0;
+    for (size_t i = 0; i < num_segments; i++) {
+        if (errors[i] && !error) {
+            error = errors[i];
+        }
+        // A segment can be empty if it only contained the first frame
+        if (segment_frames[i] > 0) {
+            rendered_paths.push_back(segment_paths[i]);
+            num_frames += segment_frames[i];
+        }
+    }
+    if (!error) {
+        try {
+            concatenate_videos(rendered_paths, output_path);
+        } catch (...) {
+            error = current_exception();
+        }
+    }
+    for (string segment_path : segment_paths) {
+        remove(segment_path.c_str());
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+    return num_frames;
+}
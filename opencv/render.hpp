@@ -0,0 +1,39 @@
+#ifndef _RENDER_HPP_
+#define _RENDER_HPP_
+
+#include <string>
+#include <opencv2/imgproc.hpp>
+
+#include "Camera.hpp"
+#include "FrameWarper.hpp"
+
+/**
+ * Stabilise a video with a trajectory measured beforehand (see `analyse_trajectory`)
+ * and encode it to `output_path`.
+ *
+ * The video is split at keyframes into segments which are decoded, warped and encoded
+ * in parallel on `num_workers` threads (0 for one per core), each with its own software
+ * decoder and encoder. The encoded segments are then joined without reencoding. Like
+ * `FrameSourceTrajectoryWarp`, the first frame is skipped.
+ *
+ * `encoder_options` are `key=value` pairs separated by `:`. Returns the number of frames
+ * rendered.
+ */
+long render_trajectory_parallel(
+    std::string video_path,
+    std::string trajectory_path,
+    std::string output_path,
+    CameraPreset input_camera,
+    double scale = 1,
+    bool crop_borders = false,
+    double zoom = 1,
+    int smooth_radius = 30,
+    cv::InterpolationFlags interpolation = cv::INTER_LINEAR,
+    WarpMode warp_mode = WARP_MODE_MAPS,
+    int mesh_spacing = 0,
+    std::string encoder_name = "libx264",
+    std::string encoder_options = "",
+    int num_workers = 0
+);
+
+#endif // _RENDER_HPP_
@@ -0,0 +1,220 @@
+#include <opencv2/core.hpp>
+#include <opencv2/calib3d.hpp>
+
+#include <Eigen/Geometry>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <stdio.h>
+
+#include "FrameSourceWarp.hpp"
+#include "RotationEstimator.hpp"
+
+using namespace cv;
+using namespace std;
+using namespace std::chrono;
+
+/**
+ * Compares the rotation-only RANSAC estimator against the previous solvePnPRansac based
+ * estimation, for speed and angular accuracy, on synthetic point pairs with a known
+ * rotation, pixel noise and a varying share of outliers
+ */
+
+const int TRIALS = 300;
+const int NUM_POINTS = 200;
+const double PIXEL_NOISE = 0.5;
+const double MAX_ROTATION = 0.05;
+const double THRESHOLD_PIXELS = 8.0;
+
+struct Trial {
+    vector<Point2f> points_prev;
+    vector<Point2f> points_current;
+    Matx33d rotation;
+};
+
+struct Result {
+    double microseconds = 0;
+    double mean_error = 0;
+    double max_error = 0;
+};
+
+Trial create_trial(Camera camera, double outlier_ratio, mt19937 &rng) {
+    uniform_real_distribution<double> x_distribution(0, camera.size.width - 1);
+    uniform_real_distribution<double> y_distribution(0, camera.size.height - 1);
+    uniform_real_distribution<double> angle_distribution(-MAX_ROTATION, MAX_ROTATION);
+    uniform_real_distribution<double> unit_distribution(0, 1);
+    normal_distribution<double> noise_distribution(0, PIXEL_NOISE);
+
+    Trial trial;
+    Vec3d rotation_vector(angle_distribution(rng), angle_distribution(rng), angle_distribution(rng));
+    Rodrigues(rotation_vector, trial.rotation);
+
+    for (int i = 0; i < NUM_POINTS; i++) {
+        trial.points_prev.push_back(Point2f(x_distribution(rng), y_distribution(rng)));
+    }
+
+    vector<Point2f> identity;
+    fisheye::undistortPoints(trial.points_prev, identity, camera.matrix, camera.distortion_coefficients);
+    vector<Point3d> bearings;
+    for (Point2f point : identity) {
+        bearings.push_back(Point3d(point.x, point.y, 1));
+    }
+    vector<Point2d> projected;
+    fisheye::projectPoints(
+        bearings,
+        projected,
+        rotation_vector,
+        Vec3d(0, 0, 0),
+        camera.matrix,
+        camera.distortion_coefficients
+    );
+
+    for (Point2d point : projected) {
+        if (unit_distribution(rng) < outlier_ratio) {
+            trial.points_current.push_back(Point2f(x_distribution(rng), y_distribution(rng)));
+        } else {
+            trial.points_current.push_back(Point2f(
+                point.x + noise_distribution(rng),
+                point.y + noise_distribution(rng)
+            ));
+        }
+    }
+    return trial;
+}
+
+/**
+ * The estimation FrameSourceWarp used before RotationEstimator
+ */
+Matx33d guess_rotation_pnp(Camera camera, Camera output_camera, const Trial &trial) {
+    vector<Point2f> corners_output;
+    fisheye::undistortPoints(
+        trial.points_current,
+        corners_output,
+        camera.matrix,
+        camera.distortion_coefficients,
+        Matx33d::eye(),
+        output_camera.matrix
+    );
+
+    vector<Point2f> prev_corners_identity;
+    fisheye::undistortPoints(
+        trial.points_prev,
+        prev_corners_identity,
+        camera.matrix,
+        camera.distortion_coefficients
+    );
+
+    vector<Point3d> last_frame_corner_coordinates;
+    for (size_t i = 0; i < prev_corners_identity.size(); ++i) {
+        double scale = rand() * 1. / RAND_MAX;
+        last_frame_corner_coordinates.push_back(Point3d(
+            prev_corners_identity[i].x * scale,
+            prev_corners_identity[i].y * scale,
+            scale
+        ));
+    }
+
+    Mat rotation_vector, translation;
+    vector<int> inliers;
+    solvePnPRansac(
+        last_frame_corner_coordinates,
+        corners_output,
+        output_camera.matrix,
+        output_camera.distortion_coefficients,
+        rotation_vector,
+        translation,
+        false,
+        100,
+        THRESHOLD_PIXELS,
+        0.99,
+        inliers
+    );
+
+    Matx33d rotation;
+    Rodrigues(rotation_vector, rotation);
+    return rotation;
+}
+
+Matx33d guess_rotation_ransac(Camera camera, RotationEstimator &estimator, const Trial &trial) {
+    vector<Point2f> prev_corners_identity, corners_identity;
+    fisheye::undistortPoints(trial.points_prev, prev_corners_identity, camera.matrix, camera.distortion_coefficients);
+    fisheye::undistortPoints(trial.points_current, corners_identity, camera.matrix, camera.distortion_coefficients);
+
+    estimator.resize(prev_corners_identity.size());
+    for (size_t i = 0; i < prev_corners_identity.size(); ++i) {
+        estimator.set_point(
+            i,
+            Eigen::Vector3f(prev_corners_identity[i].x, prev_corners_identity[i].y, 1),
+            Eigen::Vector3f(corners_identity[i].x, corners_identity[i].y, 1)
+        );
+    }
+
+    Eigen::Matrix3d estimated;
+    estimator.estimate(estimated);
+    Matx33d rotation;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            rotation(i, j) = estimated(i, j);
+        }
+    }
+    return rotation;
+}
+
+/**
+ * Angle in degrees of the rotation between two rotations
+ */
+double angular_error(Matx33d estimated, Matx33d actual) {
+    Vec3d difference;
+    Rodrigues(Mat(estimated * actual.t()), difference);
+    return norm(difference) * 180 / CV_PI;
+}
+
+template<class Estimate>
+Result run(const vector<Trial> &trials, Estimate estimate) {
+    Result result;
+    for (const Trial &trial : trials) {
+        steady_clock::time_point start = steady_clock::now();
+        Matx33d rotation = estimate(trial);
+        result.microseconds += duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1000.0;
+
+        double error = angular_error(rotation, trial.rotation);
+        result.mean_error += error;
+        result.max_error = max(result.max_error, error);
+    }
+    result.microseconds /= trials.size();
+    result.mean_error /= trials.size();
+    return result;
+}
+
+int main() {
+    Camera camera = get_preset_camera(GOPRO_H4B_WIDE43_MEASURED, Size(1920, 1440));
+    Camera output_camera = get_output_camera(camera, 1, false, 1);
+    RotationEstimator estimator(0, 100, THRESHOLD_PIXELS / output_camera.matrix(0, 0));
+    mt19937 rng(0);
+    srand(0);
+
+    double outlier_ratios[] = { 0, 0.2, 0.4, 0.6 };
+
+    printf("%-8s %-8s %10s %12s %12s\n", "outliers", "method", "us/frame", "mean_err_deg", "max_err_deg");
+    for (double outlier_ratio : outlier_ratios) {
+        vector<Trial> trials;
+        for (int i = 0; i < TRIALS; i++) {
+            trials.push_back(create_trial(camera, outlier_ratio, rng));
+        }
+
+        Result pnp = run(trials, [&](const Trial &trial) {
+            return guess_rotation_pnp(camera, output_camera, trial);
+        });
+        Result ransac = run(trials, [&](const Trial &trial) {
+            return guess_rotation_ransac(camera, estimator, trial);
+        });
+
+        printf("%-8.1f %-8s %10.1f %12.4f %12.4f\n",
+            outlier_ratio, "pnp", pnp.microseconds, pnp.mean_error, pnp.max_error);
+        printf("%-8.1f %-8s %10.1f %12.4f %12.4f\n",
+            outlier_ratio, "ransac", ransac.microseconds, ransac.mean_error, ransac.max_error);
+    }
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <gram_savitzky_golay/spatial_filters.h>
+
+#include <Eigen/Geometry>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#include "RotationSmoother.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+/**
+ * Compares RotationSmoother (incremental and batch) against gram_sg::RotationFilter, the
+ * filter FrameSourceWarp used before, for speed and the largest difference in their
+ * output, on a random walk of camera orientations
+ */
+
+const int NUM_FRAMES = 20000;
+const double STEP_RADIANS = 0.01;
+
+vector<Eigen::Matrix3d> create_orientations(mt19937 &rng) {
+    normal_distribution<double> step_distribution(0, STEP_RADIANS);
+    vector<Eigen::Matrix3d> orientations;
+    Eigen::Matrix3d orientation = Eigen::Matrix3d::Identity();
+    for (int i = 0; i < NUM_FRAMES; i++) {
+        Eigen::Vector3d step(step_distribution(rng), step_distribution(rng), step_distribution(rng));
+        orientation = Eigen::AngleAxisd(step.norm(), step.normalized()).toRotationMatrix() * orientation;
+        orientations.push_back(orientation);
+    }
+    return orientations;
+}
+
+template<class Smooth>
+double run(const vector<Eigen::Matrix3d> &orientations, vector<Eigen::Matrix3d> &smoothed, Smooth smooth) {
+    steady_clock::time_point start = steady_clock::now();
+    smoothed = smooth(orientations);
+    return duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1000.0 / orientations.size();
+}
+
+double max_difference(const vector<Eigen::Matrix3d> &a, const vector<Eigen::Matrix3d> &b) {
+    double difference = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        difference = max(difference, (a[i] - b[i]).cwiseAbs().maxCoeff());
+    }
+    return difference;
+}
+
+int main() {
+    mt19937 rng(0);
+    vector<Eigen::Matrix3d> orientations = create_orientations(rng);
+    int radii[] = { 15, 30, 60, 90, 180 };
+
+    printf("%-8s %-12s %10s %14s\n", "radius", "method", "us/frame", "max_difference");
+    for (int radius : radii) {
+        vector<Eigen::Matrix3d> reference, incremental, batch;
+        double reference_us = run(orientations, reference, [&](const vector<Eigen::Matrix3d> &input) {
+            gram_sg::RotationFilter filter(gram_sg::SavitzkyGolayFilterConfig(radius, 0, 2, 0));
+            vector<Eigen::Matrix3d> output;
+            for (const Eigen::Matrix3d &orientation : input) {
+                filter.add(orientation);
+                output.push_back(filter.filter());
+            }
+            return output;
+        });
+        double incremental_us = run(orientations, incremental, [&](const vector<Eigen::Matrix3d> &input) {
+            RotationSmoother filter(radius);
+            vector<Eigen::Matrix3d> output;
+            for (const Eigen::Matrix3d &orientation : input) {
+                filter.add(orientation);
+                output.push_back(filter.filter());
+            }
+            return output;
+        });
+        double batch_us = run(orientations, batch, [&](const vector<Eigen::Matrix3d> &input) {
+            return RotationSmoother::smooth(input, radius);
+        });
+
+        printf("%-8d %-12s %10.2f %14s\n", radius, "gram_sg", reference_us, "-");
+        printf("%-8d %-12s %10.2f %14.3g\n", radius, "incremental", incremental_us,
+            max_difference(incremental, reference));
+        printf("%-8d %-12s %10.2f %14.3g\n", radius, "batch", batch_us,
+            max_difference(batch, reference));
+    }
+
+    return 0;
+}
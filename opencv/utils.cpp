@@ -1,5 +1,11 @@
 #include "utils.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
 extern "C" {
     #include <libavutil/error.h>
 }
@@ -11,3 +17,185 @@ char err_string[ERR_STRING_BUF_SIZE];
 char* errString(int errnum) {
     return av_make_error_string(err_string, ERR_STRING_BUF_SIZE, errnum);
 }
+
+std::string json_string(const std::string &value) {
+    std::string quoted = "\"";
+    for (char c : value) {
+        switch (c) {
+        case '"':
+            quoted += "\\\"";
+            break;
+        case '\\':
+            quoted += "\\\\";
+            break;
+        case '\b':
+            quoted += "\\b";
+            break;
+        case '\f':
+            quoted += "\\f";
+            break;
+        case '\n':
+            quoted += "\\n";
+            break;
+        case '\r':
+            quoted += "\\r";
+            break;
+        case '\t':
+            quoted += "\\t";
+            break;
+        default:
+            if ((unsigned char) c < 0x20) {
+                char escaped[7];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                quoted += escaped;
+            } else {
+                quoted += c;
+            }
+        }
+    }
+    return quoted + "\"";
+}
+
+int get_gpmf_stream_id(AVFormatContext *format_ctx) {
+    int result = -1;
+    for (unsigned int i = 0; i < format_ctx->nb_streams; i++) {
+        AVStream *stream = format_ctx->streams[i];
+        AVDictionaryEntry *entry = av_dict_get(stream->metadata, "handler_name", NULL, 0);
+        if (entry != NULL && strcmp(entry->value, "	GoPro MET") == 0) {
+            result = i;
+            break;
+        }
+    }
+    return result;
+}
+
+double get_av_frame_time(const AVFrame *frame, AVRational time_base) {
+    int64_t timestamp = frame->best_effort_timestamp;
+    if (timestamp == AV_NOPTS_VALUE) {
+        timestamp = frame->pts;
+    }
+    if (timestamp == AV_NOPTS_VALUE || time_base.num == 0) {
+        return NAN;
+    }
+    return timestamp * av_q2d(time_base);
+}
+
+/**
+ * Read a keyframe's presentation timestamp, given its index entry. The index has
+ * decode timestamps, so this seeks to the keyframe (or, depending on the demuxer, the
+ * one before it) and reads packets up to it. Returns AV_NOPTS_VALUE if it isn't found.
+ */
+static int64_t read_keyframe_timestamp(AVFormatContext *format_ctx, int video_stream, const AVIndexEntry &entry) {
+    int err = av_seek_frame(format_ctx, video_stream, entry.timestamp, AVSEEK_FLAG_BACKWARD);
+    if (err < 0) {
+        std::cerr << "Failed to seek to keyframe:" << errString(err) << "\n";
+        throw err;
+    }
+    int64_t timestamp = AV_NOPTS_VALUE;
+    AVPacket packet;
+    while (av_read_frame(format_ctx, &packet) >= 0) {
+        bool is_video = packet.stream_index == video_stream;
+        bool found = is_video && packet.pos == entry.pos;
+        // Past the keyframe, or packets without positions can't be matched to it
+        bool missed = is_video && (packet.pos > entry.pos || packet.pos < 0);
+        if (found) {
+            timestamp = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+        }
+        av_packet_unref(&packet);
+        if (found || missed) {
+            break;
+        }
+    }
+    return timestamp;
+}
+
+/**
+ * Open a video file for demuxing its video stream, skipping the other streams' packets
+ */
+static AVFormatContext *open_video_input(const std::string &file_path, int &video_stream) {
+    AVFormatContext *format_ctx = NULL;
+    int err = avformat_open_input(&format_ctx, file_path.c_str(), NULL, NULL);
+    if (err) {
+        std::cerr << "Failed to open input file:" << errString(err) << "\n";
+        throw err;
+    }
+    err = avformat_find_stream_info(format_ctx, NULL);
+    if (err < 0) {
+        std::cerr << "Failed to find input stream information:" << errString(err) << "\n";
+        avformat_close_input(&format_ctx);
+        throw err;
+    }
+    video_stream = av_find_best_stream(format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (video_stream < 0) {
+        std::cerr << "Failed to find a video stream in the input file:" << errString(video_stream) << "\n";
+        avformat_close_input(&format_ctx);
+        throw video_stream;
+    }
+    for (unsigned int i = 0; i < format_ctx->nb_streams; i++) {
+        if ((int) i != video_stream) {
+            format_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    return format_ctx;
+}
+
+std::vector<int64_t> find_keyframe_timestamps(std::string file_path, AVRational *time_base, size_t num_chunks) {
+    int video_stream;
+    AVFormatContext *format_ctx = open_video_input(file_path, video_stream);
+    AVStream *stream = format_ctx->streams[video_stream];
+    *time_base = stream->time_base;
+
+    // Containers with an index (e.g. MP4) list their keyframes' positions up front
+    std::vector<AVIndexEntry> index_keyframes;
+    int num_entries = avformat_index_get_entries_count(stream);
+    for (int i = 0; i < num_entries; i++) {
+        const AVIndexEntry *entry = avformat_index_get_entry(stream, i);
+        if (entry->flags & AVINDEX_KEYFRAME) {
+            index_keyframes.push_back(*entry);
+        }
+    }
+
+    std::vector<int64_t> timestamps;
+    if (!index_keyframes.empty()) {
+        // Only the keyframes chunks start at are read
+        size_t step = std::max((size_t) 1, index_keyframes.size() / std::max(num_chunks, (size_t) 1));
+        for (size_t i = 0; i < index_keyframes.size(); i += step) {
+            int64_t timestamp;
+            try {
+                timestamp = read_keyframe_timestamp(format_ctx, video_stream, index_keyframes[i]);
+            } catch (int seek_err) {
+                avformat_close_input(&format_ctx);
+                throw seek_err;
+            }
+            if (timestamp == AV_NOPTS_VALUE) {
+                // The index doesn't match the packets, so scan them from the start instead
+                timestamps.clear();
+                avformat_close_input(&format_ctx);
+                format_ctx = open_video_input(file_path, video_stream);
+                break;
+            }
+            timestamps.push_back(timestamp);
+        }
+    }
+
+    if (timestamps.empty()) {
+        // Otherwise every packet has to be read to find the keyframes
+        std::vector<int64_t> keyframes;
+        AVPacket packet;
+        while (av_read_frame(format_ctx, &packet) >= 0) {
+            if (packet.stream_index == video_stream && (packet.flags & AV_PKT_FLAG_KEY)) {
+                keyframes.push_back(packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts);
+            }
+            av_packet_unref(&packet);
+        }
+        std::sort(keyframes.begin(), keyframes.end());
+        size_t step = std::max((size_t) 1, keyframes.size() / std::max(num_chunks, (size_t) 1));
+        for (size_t i = 0; i < keyframes.size(); i += step) {
+            timestamps.push_back(keyframes[i]);
+        }
+    }
+    avformat_close_input(&format_ctx);
+
+    std::sort(timestamps.begin(), timestamps.end());
+    return timestamps;
+}
@@ -1,6 +1,38 @@
 #ifndef _UTILS_H_
 #define _UTILS_H_
 
+#include <string>
+#include <vector>
+
+extern "C" {
+    #include <libavformat/avformat.h>
+}
+
 char* errString(int errnum);
 
+/**
+ * Quote a string for JSON, escaping quotes, backslashes and control characters
+ */
+std::string json_string(const std::string &value);
+
+/**
+ * Find the index of the GoPro metadata stream, or -1 if there is none
+ */
+int get_gpmf_stream_id(AVFormatContext *format_ctx);
+
+/**
+ * Presentation time of a decoded frame in seconds, or NaN if it has no timestamp
+ */
+double get_av_frame_time(const AVFrame *frame, AVRational time_base);
+
+/**
+ * Find the timestamps of evenly spaced keyframes in a video file's video stream, to
+ * start about `num_chunks` chunks at (every `max(1, keyframes / num_chunks)`th keyframe,
+ * starting with the first), in the stream's time base (written to `time_base`)
+ *
+ * With a container index (e.g. MP4), only those keyframes are read, otherwise every
+ * packet is. Nothing is decoded.
+ */
+std::vector<int64_t> find_keyframe_timestamps(std::string file_path, AVRational *time_base, size_t num_chunks);
+
 #endif // _UTILS_H_